@@ -125,6 +125,26 @@ class Blob {
    * shared_ptr calls its destructor when reset with the "=" operator.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Set the data_ shared_ptr to point to the SyncedMemory memory, which
+   *        may be larger than this Blob and back other Blob%s as well --
+   *        useful to Net to reuse memory between blobs whose lifetimes do not
+   *        overlap.
+   *
+   * memory must hold at least the capacity of this Blob. Reshaping the Blob
+   * beyond it gives it memory of its own again.
+   */
+  void ShareDataMemory(const shared_ptr<SyncedMemory>& memory);
+  /**
+   * @brief Exchange the data of this Blob with the data of Blob other without
+   *        copying -- useful to hand a prefetched batch over to a top blob.
+   *
+   * Unlike ShareData, the SyncedMemory objects stay with their Blob%s and only
+   * trade their buffers, so any Blob sharing data with either one sees the
+   * exchanged contents. Both Blob%s must have the same count. If their
+   * allocated capacities differ, the data of other is copied instead.
+   */
+  void SwapData(Blob* other);
 
  protected:
   shared_ptr<SyncedMemory> data_;
@@ -12,6 +12,7 @@
 #include "caffe/loss_layers.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
@@ -212,6 +213,7 @@ class FlattenLayer : public Layer<Dtype> {
   }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool SharesBottomData() const { return true; }
 
  protected:
   /**
@@ -318,6 +320,74 @@ class MVNLayer : public Layer<Dtype> {
   Blob<Dtype> sum_multiplier_;
 };
 
+/**
+ * @brief Reduces the items of each segment of a batch to one, e.g. pools
+ *        the scores of the items of each weak bag for multiple-instance
+ *        learning.
+ *
+ * The segments are given by a second bottom of one label per item: each run
+ * of consecutive items sharing a label >= 0 is a segment, as is each item of
+ * label < 0, so that the batches of SemiLossLayer pool their bags and keep
+ * their positives and negatives apart. The top holds one item per segment,
+ * each of its values the reduction of the values at the same place in the
+ * items of the segment; an optional second top holds the label of each
+ * segment. The number of segments, and so the num of the tops, may change
+ * from batch to batch.
+ *
+ * The gradient reaches the argmax of each value for MAX, all the items of
+ * the segment evenly for MEAN and in proportion to their softmax for
+ * LOGSUMEXP. The GPU implementation runs a thread per segment and value, and
+ * one per bottom value backward.
+ */
+template <typename Dtype>
+class SegmentReductionLayer : public Layer<Dtype> {
+ public:
+  /**
+   * @param param provides SegmentReductionParameter segment_reduction_param,
+   *     with SegmentReductionLayer options:
+   *   - operation (\b optional, default MAX).
+   *     the reduction: MAX, MEAN or LOGSUMEXP.
+   *   - workers (\b optional, default 1).
+   *     the number of threads splitting the segments of the CPU path.
+   */
+  explicit SegmentReductionLayer(const LayerParameter& param)
+      : Layer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+
+  virtual inline LayerParameter_LayerType type() const {
+    return LayerParameter_LayerType_SEGMENT_REDUCTION;
+  }
+  virtual inline int ExactNumBottomBlobs() const { return 2; }
+  virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline int MaxTopBlobs() const { return 2; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
+  SegmentReductionParameter_SegmentOp op_;
+  int num_segments_;
+  // The number of values of an item.
+  int dim_;
+  // The first item of each segment, then the number of items.
+  Blob<int> segment_begin_;
+  // The segment of each item.
+  Blob<int> item_segment_;
+  // The item each value of the top comes from, for MAX.
+  Blob<int> max_idx_;
+  // The threads of the CPU path, if there is more than one.
+  shared_ptr<WorkerPool> workers_;
+};
+
 /**
  * @brief Ignores bottom blobs while producing no top blobs. (This is useful
  *        to suppress outputs during testing.)
@@ -431,6 +501,7 @@ class SplitLayer : public Layer<Dtype> {
   }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int MinTopBlobs() const { return 1; }
+  virtual inline bool SharesBottomData() const { return true; }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
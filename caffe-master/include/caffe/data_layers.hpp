@@ -1,6 +1,8 @@
 #ifndef CAFFE_DATA_LAYERS_HPP_
 #define CAFFE_DATA_LAYERS_HPP_
 
+#include <stdint.h>
+
 #include <string>
 #include <utility>
 #include <vector>
@@ -12,14 +14,23 @@
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
+#include "caffe/data_reader.hpp"
 #include "caffe/data_transformer.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/hdf5_reader.hpp"
 #include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/datum_cache.hpp"
+#include "caffe/util/raw_file.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
+template <typename Dtype> class HardNegativeCache;
+
 #define HDF5_DATA_DATASET_NAME "data"
 #define HDF5_DATA_LABEL_NAME "label"
 
@@ -67,12 +78,36 @@ class BaseDataLayer : public Layer<Dtype> {
   bool output_labels_;
 };
 
+/**
+ * @brief A batch of data and labels filled by the prefetch thread of a
+ *        BasePrefetchingDataLayer.
+ */
+template <typename Dtype>
+class Batch {
+ public:
+  Blob<Dtype> data_, label_;
+  // When the prefetch thread started and stopped waiting for the batch to be
+  // free before loading it.
+  boost::posix_time::ptime idle_begin_;
+  boost::posix_time::ptime idle_end_;
+};
+
+/**
+ * @brief Provides base for data layers that prepare their batches in a
+ *        background thread.
+ *
+ * A single long-lived prefetch thread keeps filling free batches and queueing
+ * them, so that data loading overlaps several Forward/Backward passes. The
+ * number of batches in flight is given by PrefetchCount(). Subclasses only
+ * implement LoadBatch to fill one batch.
+ */
 template <typename Dtype>
 class BasePrefetchingDataLayer :
     public BaseDataLayer<Dtype>, public InternalThread {
  public:
   explicit BasePrefetchingDataLayer(const LayerParameter& param)
-      : BaseDataLayer<Dtype>(param) {}
+      : BaseDataLayer<Dtype>(param), batches_loaded_(0),
+        forward_wait_time_(0), prefetch_idle_time_(0) {}
   virtual ~BasePrefetchingDataLayer() {}
   // LayerSetUp: implements common data layer setup functionality, and calls
   // DataLayerSetUp to do special data layer setup for individual layer types.
@@ -85,14 +120,88 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
 
+  // Starts the prefetch thread, which runs until JoinPrefetchThread is called.
   virtual void CreatePrefetchThread();
+  // Stops the prefetch thread and waits for it to exit.
   virtual void JoinPrefetchThread();
-  // The thread's function
-  virtual void InternalThreadEntry() {}
+
+  // The milliseconds LoadBatch spent in each of its stages, e.g. "read" or
+  // "transform", summed over the batches_loaded() batches loaded since the
+  // prefetch thread was started. Read them while the thread is stopped.
+  const map<string, double>& stage_times() const { return stage_times_; }
+  int batches_loaded() const { return batches_loaded_; }
+  // The milliseconds Forward waited for the prefetch thread to load batches,
+  // and the prefetch thread waited for Forward to free batches, since the
+  // last ResetPrefetchTimes. Unlike the stage times, they may be read any
+  // time from the thread calling Forward.
+  double forward_wait_time() const { return forward_wait_time_; }
+  double prefetch_idle_time() const { return prefetch_idle_time_; }
+  void ResetPrefetchTimes();
 
  protected:
-  Blob<Dtype> prefetch_data_;
-  Blob<Dtype> prefetch_label_;
+  // The thread's function: fills free batches until asked to stop.
+  virtual void InternalThreadEntry();
+  // Fills one batch; called from the prefetch thread.
+  virtual void LoadBatch(Batch<Dtype>* batch) = 0;
+  // The number of batches the prefetch thread may prepare ahead of Forward.
+  virtual inline int PrefetchCount() const { return 3; }
+  // Sets up num_workers transformers, and a pool of as many threads if there
+  // is more than one, for LoadBatch to split its batches with RunTask.
+  void SetUpWorkers(const int num_workers);
+  // Runs task on the workers, or on the prefetch thread without a pool.
+  void RunTask(ParallelTask* task);
+  // Takes the next filled batch for Forward, waiting for the prefetch thread
+  // if needed.
+  Batch<Dtype>* PopFullBatch();
+  // Called by Forward with each batch, before it is moved to the tops.
+  virtual void OnForward(const Batch<Dtype>& batch) {}
+  // Adds the time since the previous stage of LoadBatch ended, or since it
+  // was called, to the time of stage.
+  void EndStage(const string& stage);
+  // Like EndStage, but splits the time between several stages in proportion
+  // to their weights, e.g. the time the workers spent in each of them.
+  void EndStages(const map<string, double>& weights);
+
+  vector<shared_ptr<Batch<Dtype> > > prefetch_;
+  BlockingQueue<Batch<Dtype>*> prefetch_free_;
+  BlockingQueue<Batch<Dtype>*> prefetch_full_;
+  // Each worker transforms its slice of a batch with its own transformer,
+  // and thus its own RNG stream: the first one is data_transformer_.
+  shared_ptr<WorkerPool> workers_;
+  vector<shared_ptr<DataTransformer<Dtype> > > worker_transformers_;
+  vector<DataTransformer<Dtype>*> transformers_;
+  CPUTimer stage_timer_;
+  map<string, double> stage_times_;
+  int batches_loaded_;
+  CPUTimer wait_timer_;
+  double forward_wait_time_;
+  double prefetch_idle_time_;
+  // When the prefetch times were last reset: the idle time of the prefetch
+  // thread before it, e.g. during a test pass, does not count.
+  boost::posix_time::ptime prefetch_times_reset_;
+};
+
+/**
+ * @brief A dataset held in memory by DataLayer (see DataParameter.in_memory):
+ *        the uint8 pixels of all its datums, decoded if need be, back to
+ *        back in one arena, and their labels.
+ *
+ * It is loaded once per process and shared by the layers reading the same
+ * sources, e.g. the train and test nets of a solver.
+ */
+class DataArena {
+ public:
+  // The shape of the datums, without their data.
+  Datum datum_;
+  int datum_size_;
+  vector<uint8_t> data_;
+  vector<int> labels_;
+
+  int size() const { return labels_.size(); }
+  const char* data(const int index) const {
+    return reinterpret_cast<const char*>(&data_[0]) +
+        static_cast<size_t>(index) * datum_size_;
+  }
 };
 
 template <typename Dtype>
@@ -112,17 +221,59 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int MaxTopBlobs() const { return 2; }
 
  protected:
-  virtual void InternalThreadEntry();
-
-  // LEVELDB
-  shared_ptr<leveldb::DB> db_;
-  shared_ptr<leveldb::Iterator> iter_;
-  // LMDB
-  MDB_env* mdb_env_;
-  MDB_dbi mdb_dbi_;
-  MDB_txn* mdb_txn_;
-  MDB_cursor* mdb_cursor_;
-  MDB_val mdb_key_, mdb_value_;
+  virtual void LoadBatch(Batch<Dtype>* batch);
+  virtual inline int PrefetchCount() const {
+    return this->layer_param_.data_param().prefetch();
+  }
+  // The shard to take the next record of a batch from.
+  int NextShard();
+  // Loads the whole dataset into arena_, or shares a loaded one.
+  void LoadArena(const vector<string>& sources);
+  // Fills one batch from arena_, in place of LoadBatch.
+  void LoadArenaBatch(Batch<Dtype>* batch);
+  // Maps the RAW files of sources into raw_files_.
+  void OpenRawFiles(const vector<string>& sources);
+  // Fills one batch from raw_files_, in place of LoadBatch.
+  void LoadRawBatch(Batch<Dtype>* batch);
+  // Starts serving the records of the arena or RAW files, of which there
+  // are size, in order_.
+  void InitOrder(const int size);
+  // The index of the next record to serve, reshuffling at every epoch.
+  int NextIndex();
+  // Fills one batch from readers_, in place of LoadBatch.
+  void LoadDBBatch(Batch<Dtype>* batch);
+  // Replaces replay_ratio of the negatives of a loaded batch with the
+  // hardest ones of hard_negatives_.
+  void ReplayHardNegatives(Batch<Dtype>* batch);
+  // Stages the negatives of the TRAIN batches in hard_negatives_, for the
+  // SemiLossLayer to report their loss.
+  virtual void OnForward(const Batch<Dtype>& batch);
+
+  // One reader per database shard, each reading ahead on its own thread.
+  vector<shared_ptr<DataReader> > readers_;
+  int next_shard_;
+  shared_ptr<Caffe::RNG> shard_rng_;
+  // The prefetch thread collects the records of a batch from the readers
+  // into records_; parsing, decoding (encoded datums) and transforming them
+  // is split across the workers, each filling a disjoint slice of the batch.
+  // The (address, size) of the serialized records of the batch, and where
+  // they come from, to give them back to their readers once transformed.
+  vector<pair<const char*, int> > records_;
+  vector<DataRecord*> batch_records_;
+  vector<int> batch_shards_;
+  // In memory, the dataset replaces the readers.
+  shared_ptr<DataArena> arena_;
+  // RAW files are mapped and indexed directly; the records of file i are
+  // numbered from raw_offsets_[i].
+  vector<shared_ptr<RawFile> > raw_files_;
+  vector<int> raw_offsets_;
+  // The records of the arena or RAW files are served in order_, reshuffled
+  // every epoch with order_rng_ if shuffle is set.
+  vector<int> order_;
+  int order_pos_;
+  shared_ptr<Caffe::RNG> order_rng_;
+  // The hard negatives replayed in the TRAIN batches, if any.
+  shared_ptr<HardNegativeCache<Dtype> > hard_negatives_;
 };
 
 /**
@@ -162,19 +313,20 @@ class DummyDataLayer : public Layer<Dtype> {
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * The files listed in the source are streamed in chunks of rows by an
+ * HDF5Reader, so they need not fit in memory, and batches are assembled
+ * from the chunks on the prefetch thread. With shuffle, the rows of a batch
+ * are sampled at random, without replacement, from a window of a few chunks,
+ * each of which is replaced by the next one once all its rows are used.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : BasePrefetchingDataLayer<Dtype>(param), chunk_(NULL) {}
   virtual ~HDF5DataLayer();
-  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
-  // Data layers have no bottoms, so reshaping is trivial.
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      vector<Blob<Dtype>*>* top) {}
 
   virtual inline LayerParameter_LayerType type() const {
     return LayerParameter_LayerType_HDF5_DATA;
@@ -183,31 +335,39 @@ class HDF5DataLayer : public Layer<Dtype> {
   virtual inline int ExactNumTopBlobs() const { return 2; }
 
  protected:
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      vector<Blob<Dtype>*>* top);
-  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
-      vector<Blob<Dtype>*>* top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom) {}
-  virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom) {}
-  virtual void LoadHDF5FileData(const char* filename);
+  virtual void LoadBatch(Batch<Dtype>* batch);
+  virtual inline int PrefetchCount() const {
+    return this->layer_param_.hdf5_data_param().prefetch();
+  }
+  // Takes the next chunk from the reader into the given slot of the window.
+  void FillWindow(const int slot);
 
   std::vector<std::string> hdf_filenames_;
-  unsigned int num_files_;
-  unsigned int current_file_;
-  hsize_t current_row_;
-  Blob<Dtype> data_blob_;
-  Blob<Dtype> label_blob_;
+  shared_ptr<HDF5Reader<Dtype> > reader_;
+  // The chunk the rows of the batches are taken from, and its next row.
+  HDF5Chunk<Dtype>* chunk_;
+  int chunk_row_;
+  // With shuffle, the chunks of the window, how many of their rows are left,
+  // and the (slot, row) pairs of the rows left.
+  shared_ptr<Caffe::RNG> shuffle_rng_;
+  vector<HDF5Chunk<Dtype>*> window_;
+  vector<int> window_rows_left_;
+  vector<std::pair<int, int> > window_rows_;
 };
 
 /**
  * @brief Write blobs to disk as HDF5 files.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * Forward only copies its bottoms into one of a few preallocated batches and
+ * queues it: a writer thread appends the queued batches to the "data" and
+ * "label" datasets, so the net waits for the disk only once queue_size
+ * batches are pending. The datasets are extendible and chunked, optionally
+ * gzip compressed, and grow by one hyperslab write per batch. The batches
+ * still queued are written when the layer is destroyed, before the file is
+ * closed.
  */
 template <typename Dtype>
-class HDF5OutputLayer : public Layer<Dtype> {
+class HDF5OutputLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5OutputLayer(const LayerParameter& param);
   virtual ~HDF5OutputLayer();
@@ -235,12 +395,21 @@ class HDF5OutputLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
-  virtual void SaveBlobs();
+  virtual void InternalThreadEntry();
+  // Appends the rows of batch to the datasets, creating them first.
+  virtual void SaveBlobs(const Batch<Dtype>& batch);
+  // Creates an extendible, chunked dataset of rows shaped like blob's.
+  hid_t CreateDataset(const char* dataset_name, const Blob<Dtype>& blob);
+  void AppendRows(hid_t dataset_id, const Blob<Dtype>& blob);
 
   std::string file_name_;
   hid_t file_id_;
-  Blob<Dtype> data_blob_;
-  Blob<Dtype> label_blob_;
+  hid_t data_id_;
+  hid_t label_id_;
+  hsize_t rows_;
+  vector<shared_ptr<Batch<Dtype> > > batches_;
+  BlockingQueue<Batch<Dtype>*> batch_free_;
+  BlockingQueue<Batch<Dtype>*> batch_full_;
 };
 
 /**
@@ -263,25 +432,45 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int ExactNumTopBlobs() const { return 2; }
 
+  // Reads the (resized) image of filename, from the cache if it holds it.
+  // Returns NULL if the image cannot be read. Safe to call from several
+  // workers at once.
+  shared_ptr<const Datum> ReadImage(const string& filename);
+
  protected:
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
-  virtual void InternalThreadEntry();
+  virtual void LoadBatch(Batch<Dtype>* batch);
+  virtual inline int PrefetchCount() const {
+    return this->layer_param_.image_data_param().prefetch();
+  }
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // The lines of the batch being loaded, in batch order.
+  vector<std::pair<std::string, int> > batch_lines_;
+  // Decoded images, if image_data_param.cache_size is set.
+  shared_ptr<DatumCache> cache_;
 };
 
 /**
  * @brief Provides data to the Net from memory.
  *
- * TODO(dox): thorough documentation for Forward and proto params.
+ * By default, the layer walks through an array given to Reset, without
+ * copying it, or repeats the batch last given to AddDatumVector.
+ *
+ * With a ring_size, it owns a ring of that many preallocated batches
+ * instead, shared by producers and the net: producers fill the free batches
+ * (AddBatches, AddDatumVector) while the net consumes the ready ones, each
+ * Forward taking the next ready batch and releasing the previous one.
+ * Producers block while no batch is free and Forward blocks while none is
+ * ready, so requests can be prepared on other threads while the net runs.
  */
 template <typename Dtype>
 class MemoryDataLayer : public BaseDataLayer<Dtype> {
  public:
   explicit MemoryDataLayer(const LayerParameter& param)
-      : BaseDataLayer<Dtype>(param), has_new_data_(false) {}
+      : BaseDataLayer<Dtype>(param), has_new_data_(false), current_(NULL) {}
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
 
@@ -291,13 +480,19 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int ExactNumTopBlobs() const { return 2; }
 
+  // With a ring, transforms the datums into the next free batch; it must not
+  // be called by several producers at once.
   virtual void AddDatumVector(const vector<Datum>& datum_vector);
+  // Copies n rows (a multiple of the batch size) of data and labels into
+  // free batches of the ring, waiting for them as needed. Thread-safe.
+  void AddBatches(const Dtype* data, const Dtype* labels, int n);
 
   // Reset should accept const pointers, but can't, because the memory
   //  will be given to Blob, which is mutable
   void Reset(Dtype* data, Dtype* label, int n);
 
   int batch_size() { return batch_size_; }
+  int ring_size() const { return ring_.size(); }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -311,6 +506,12 @@ class MemoryDataLayer : public BaseDataLayer<Dtype> {
   Blob<Dtype> added_data_;
   Blob<Dtype> added_label_;
   bool has_new_data_;
+  // The ring of batches, the ones free or ready, and the one held by the
+  // tops since the last Forward.
+  vector<shared_ptr<Batch<Dtype> > > ring_;
+  BlockingQueue<Batch<Dtype>*> ring_free_;
+  BlockingQueue<Batch<Dtype>*> ring_full_;
+  Batch<Dtype>* current_;
 };
 
 /**
@@ -334,15 +535,38 @@ class WindowDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int ExactNumTopBlobs() const { return 2; }
 
+  // Called by the workers while a batch is loaded. DecodeImage decodes the
+  // i-th distinct image of the batch, from the cache if it holds it, and
+  // WarpWindow writes the item_id-th window of the batch, cropped out of its
+  // decoded image, into top_data and top_label.
+  void DecodeImage(const int i);
+  void WarpWindow(const int item_id, Dtype* top_data, Dtype* top_label);
+
  protected:
   virtual unsigned int PrefetchRand();
-  virtual void InternalThreadEntry();
+  virtual void LoadBatch(Batch<Dtype>* batch);
+  virtual inline int PrefetchCount() const {
+    return this->layer_param_.window_data_param().prefetch();
+  }
 
   shared_ptr<Caffe::RNG> prefetch_rng_;
   vector<std::pair<std::string, vector<int> > > image_database_;
   enum WindowField { IMAGE_INDEX, LABEL, OVERLAP, X1, Y1, X2, Y2, NUM };
   vector<vector<float> > fg_windows_;
   vector<vector<float> > bg_windows_;
+  // The windows sampled for the batch being loaded, whether to mirror them,
+  // and which of the batch's distinct images they are cropped out of.
+  vector<const vector<float>*> batch_windows_;
+  vector<int> batch_mirrors_;
+  vector<int> batch_window_images_;
+  // The distinct images of the batch (indices into image_database_), and
+  // their decoded pixels, kept as Datums in OpenCV's interleaved (HWC)
+  // layout so that they can be cached.
+  vector<int> batch_images_;
+  vector<shared_ptr<const Datum> > batch_decoded_;
+  // Decoded images kept across batches, if window_data_param.cache_size is
+  // set.
+  shared_ptr<DatumCache> cache_;
 };
 
 }  // namespace caffe
@@ -0,0 +1,95 @@
+#ifndef CAFFE_DATA_READER_HPP_
+#define CAFFE_DATA_READER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/bag_sampler.hpp"
+#include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/db.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A serialized record read by a DataReader.
+ *
+ * data_ points either straight into the database, when its values stay
+ * valid (LMDB), or into buffer_.
+ */
+class DataRecord {
+ public:
+  const char* data_;
+  int size_;
+  string buffer_;
+};
+
+/**
+ * @brief Reads the records of one database on its own thread, ahead of the
+ *        data layer using them.
+ *
+ * Records cycle between two queues: the reader fills the ones it pops from
+ * free() and pushes them to full(), in database order, wrapping around at the
+ * end. The consumer pops from full() and pushes records back to free() once
+ * it is done with them.
+ *
+ * If shuffle is set, the reader indexes all the keys and reads them in a
+ * random order instead, reshuffled every epoch. Records are then looked up
+ * by key in chunks of half the queue: each chunk is looked up in key order,
+ * for locality, and its pages are advised to the kernel so that they are
+ * read concurrently, before the records are queued in shuffled order.
+ *
+ * With bag sampling, the labels are indexed along with the keys, and the
+ * records are read the same way, in the order of the batches a BagSampler
+ * assembles.
+ */
+class DataReader : public InternalThread {
+ public:
+  // Opens source, one of the sources of param, and skips its first skip
+  // records, or the whole batches they span with bag sampling. queue_size
+  // records are allocated to read ahead.
+  DataReader(const DataParameter& param, const string& source,
+      const int queue_size, const unsigned int skip);
+  virtual ~DataReader();
+
+  BlockingQueue<DataRecord*>& free() { return free_; }
+  BlockingQueue<DataRecord*>& full() { return full_; }
+  const string& source() const { return source_; }
+
+ protected:
+  virtual void InternalThreadEntry();
+  // Moves the cursor to the next record, wrapping around at the end.
+  void Next();
+  // Points record at the current value of the cursor, or copies it.
+  void Read(DataRecord* record);
+  // Reads the next chunk of records of the shuffled or sampled order.
+  void ReadShuffledChunk();
+  void ShuffleKeys();
+
+  const string source_;
+  shared_ptr<db::DB> db_;
+  shared_ptr<db::Cursor> cursor_;
+  vector<shared_ptr<DataRecord> > records_;
+  // Shuffled reading: the keys, their order in the current epoch, and the
+  // position of the next one to read.
+  vector<string> keys_;
+  vector<int> order_;
+  int order_pos_;
+  shared_ptr<Caffe::RNG> shuffle_rng_;
+  // Bag sampling: order_ holds the records of one batch at a time.
+  shared_ptr<BagSampler> bag_sampler_;
+  // The chunk being read: the (key index, slot) of its lookups, and its
+  // records by slot, i.e. in shuffled order.
+  vector<pair<int, int> > chunk_;
+  vector<DataRecord*> chunk_records_;
+  BlockingQueue<DataRecord*> free_;
+  BlockingQueue<DataRecord*> full_;
+
+  DISABLE_COPY_AND_ASSIGN(DataReader);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DATA_READER_HPP_
@@ -1,6 +1,8 @@
 #ifndef CAFFE_DATA_TRANSFORMER_HPP
 #define CAFFE_DATA_TRANSFORMER_HPP
 
+#include <vector>
+
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 
@@ -16,6 +18,9 @@ class DataTransformer {
   explicit DataTransformer(const TransformationParameter& param)
     : param_(param) {
     phase_ = Caffe::phase();
+    for (int c = 0; c < param_.mean_value_size(); ++c) {
+      mean_values_.push_back(param_.mean_value(c));
+    }
   }
   virtual ~DataTransformer() {}
 
@@ -31,6 +36,8 @@ class DataTransformer {
    * @param datum
    *    Datum containing the data to be transformed.
    * @param mean
+   *    The mean image to subtract, of the same size as the datum, or NULL if
+   *    there is none. Ignored if mean_value is set in the transform_param.
    * @param transformed_data
    *    This is meant to be the top blob's data. The transformed data will be
    *    written at the appropriate place within the blob's data.
@@ -38,12 +45,30 @@ class DataTransformer {
   void Transform(const int batch_item_id, const Datum& datum,
                  const Dtype* mean, Dtype* transformed_data);
 
+  /**
+   * @brief Same as above, but the uint8 pixels are given by data and
+   * data_size instead of datum.data(), e.g. to read them straight from a
+   * database record (see ParseDatumSkippingData). The other fields, such as
+   * the shape, still come from datum.
+   */
+  void Transform(const int batch_item_id, const Datum& datum,
+                 const char* data, const int data_size,
+                 const Dtype* mean, Dtype* transformed_data);
+
+  /**
+   * @brief Same as above, for float values given by float_data instead of
+   * datum.float_data(). They can't be cropped or mirrored.
+   */
+  void Transform(const int batch_item_id, const Datum& datum,
+                 const float* float_data,
+                 const Dtype* mean, Dtype* transformed_data);
+
  protected:
   virtual unsigned int Rand();
 
   // Tranformation parameters
   TransformationParameter param_;
-
+  vector<Dtype> mean_values_;
 
   shared_ptr<Caffe::RNG> rng_;
   Caffe::Phase phase_;
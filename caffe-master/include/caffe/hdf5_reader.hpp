@@ -0,0 +1,102 @@
+#ifndef CAFFE_HDF5_READER_HPP_
+#define CAFFE_HDF5_READER_HPP_
+
+#include <string>
+#include <vector>
+
+#include "hdf5.h"
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A chunk of consecutive rows of the "data" and "label" datasets of an
+ *        HDF5 file, read by an HDF5Reader.
+ */
+template <typename Dtype>
+class HDF5Chunk {
+ public:
+  vector<Dtype> data_;
+  vector<Dtype> label_;
+  int rows_;
+};
+
+/**
+ * @brief Reads HDF5 files chunk by chunk on its own thread, ahead of the
+ *        HDF5DataLayer using them.
+ *
+ * Every file holds a "data" dataset of 2 to 4 dimensions and a "label"
+ * dataset of 1 or 2, with as many rows (first dimension) each. Chunks of up
+ * to chunk_size rows are read with hyperslab selections, so only the rows in
+ * flight are held in memory, however large the files are.
+ *
+ * Like DataReader, chunks cycle between two queues: the reader fills the
+ * ones it pops from free() and pushes them to full(), going through the
+ * files in order and wrapping around at the end; the consumer pushes them
+ * back to free() once done with them. A chunk never spans two files. Since
+ * the reader runs queue_size - 1 chunks ahead, the next file is opened and
+ * read before the consumer runs out of the current one.
+ *
+ * If shuffle is set, the files are read in a random order, drawn anew every
+ * epoch, and the chunks of each file in a random order too: every chunk is
+ * still a contiguous read.
+ */
+template <typename Dtype>
+class HDF5Reader : public InternalThread {
+ public:
+  // Opens the first file to know the shape of the rows.
+  HDF5Reader(const vector<string>& filenames, const int chunk_size,
+      const int queue_size, const bool shuffle);
+  virtual ~HDF5Reader();
+
+  BlockingQueue<HDF5Chunk<Dtype>*>& free() { return free_; }
+  BlockingQueue<HDF5Chunk<Dtype>*>& full() { return full_; }
+  // The dimensions of the datasets, the first one (rows) excepted.
+  const vector<hsize_t>& data_dims() const { return data_dims_; }
+  const vector<hsize_t>& label_dims() const { return label_dims_; }
+  int data_row_size() const { return data_row_size_; }
+  int label_row_size() const { return label_row_size_; }
+
+ protected:
+  virtual void InternalThreadEntry();
+  // Opens filenames_[file], checking its datasets against the first file's,
+  // and orders its chunks.
+  void OpenFile(const int file);
+  void CloseFile();
+  // Reads the next rows of the current file into chunk.
+  void ReadChunk(HDF5Chunk<Dtype>* chunk);
+
+  const vector<string> filenames_;
+  const int chunk_size_;
+  const bool shuffle_;
+  shared_ptr<Caffe::RNG> shuffle_rng_;
+  // The order of the files in the current epoch, and the position of the
+  // current one.
+  vector<int> file_order_;
+  int file_pos_;
+  vector<hsize_t> data_dims_;
+  vector<hsize_t> label_dims_;
+  int data_row_size_;
+  int label_row_size_;
+  // The file being read, its datasets and number of rows, and the first rows
+  // of its chunks in reading order, with the position of the next one.
+  int file_;
+  hid_t file_id_;
+  hid_t data_id_;
+  hid_t label_id_;
+  hsize_t rows_;
+  vector<hsize_t> chunk_rows_;
+  int chunk_pos_;
+  vector<shared_ptr<HDF5Chunk<Dtype> > > chunks_;
+  BlockingQueue<HDF5Chunk<Dtype>*> free_;
+  BlockingQueue<HDF5Chunk<Dtype>*> full_;
+
+  DISABLE_COPY_AND_ASSIGN(HDF5Reader);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_HDF5_READER_HPP_
@@ -15,6 +15,7 @@ class Thread {
   Thread(Callable func, A1 a1);
   void join();
   bool joinable();
+  void interrupt();
  private:
   void* thread_;
 };
@@ -35,6 +36,13 @@ class InternalThread {
   /** Will not return until the internal thread has exited. */
   bool WaitForInternalThreadToExit();
 
+  /**
+   * Requests the internal thread to stop and waits for it to exit. The thread
+   * is interrupted at its next boost interruption point (e.g. a blocking
+   * BlockingQueue::pop), or stops on its own by polling must_stop().
+   */
+  bool StopInternalThread();
+
   bool is_started() const { return thread_ != NULL && thread_->joinable(); }
 
  protected:
@@ -42,6 +50,9 @@ class InternalThread {
       with the code you want your thread to run. */
   virtual void InternalThreadEntry() {}
 
+  /* Should be tested when running loops to exit when requested. */
+  bool must_stop();
+
   caffe::Thread* thread_;
 };
 
@@ -9,6 +9,7 @@
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/device_alternate.hpp"
+#include "caffe/util/streaming_metrics.hpp"
 
 namespace caffe {
 
@@ -269,6 +270,24 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether the top blobs of the layer share the data of its
+   *        bottom[0] in Forward rather than holding their own.
+   *
+   * Net relies on this to keep such blobs in the same memory when it reuses
+   * the memory of blobs whose lifetimes do not overlap.
+   */
+  virtual inline bool SharesBottomData() const { return false; }
+
+  /**
+   * @brief Return the StreamingMetrics the layer accumulates its outputs
+   *        into over a test pass, or NULL if it keeps none.
+   *
+   * Solver::Test resets the metrics of each layer of the test net before a
+   * pass and reports them after it.
+   */
+  virtual StreamingMetrics* metrics() { return NULL; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -10,9 +10,12 @@
 #include "caffe/layer.hpp"
 #include "caffe/neuron_layers.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/streaming_metrics.hpp"
 
 namespace caffe {
 
+template <typename Dtype> class HardNegativeCache;
+
 const float kLOG_THRESHOLD = 1e-20;
 
 /**
@@ -84,6 +87,55 @@ class AccuracyLayer : public Layer<Dtype> {
   int top_k_;
 };
 
+/**
+ * @brief Indexes the labels of a batch for SemiLossLayer and
+ *        SemiAccuracyLayer: its positives (label -1), its negatives
+ *        (label -2), and its weak bags, the runs of consecutive equal labels
+ *        >= 0. Other labels are ignored.
+ */
+class BagSegments {
+ public:
+  // Indexes the num labels found every stride values from labels, e.g. the
+  // labels of one class among per-class labels.
+  template <typename Dtype>
+  void Build(const Dtype* labels, const int num, const int stride) {
+    positives_.clear();
+    negatives_.clear();
+    bags_.clear();
+    for (int i = 0; i < num; ++i) {
+      const Dtype label = labels[i * stride];
+      if (label == Dtype(-1)) {
+        positives_.push_back(i);
+      } else if (label == Dtype(-2)) {
+        negatives_.push_back(i);
+      } else if (label >= Dtype(0)) {
+        if (i > 0 && labels[(i - 1) * stride] == label) {
+          bags_.back().second = i + 1;
+        } else {
+          bags_.push_back(std::make_pair(i, i + 1));
+        }
+      }
+    }
+  }
+
+  vector<int> positives_;
+  vector<int> negatives_;
+  // The [begin, end) items of each bag.
+  vector<pair<int, int> > bags_;
+};
+
+/**
+ * @brief Computes the accuracy of sigmoid scores on the positives, negatives
+ *        and weak bags of a batch labelled as for SemiLossLayer.
+ *
+ * A positive is right if its score is above 0, a negative if it is not, and
+ * a bag if the score of its best item is above 0. The accuracy is the share
+ * of the positives, negatives and bags, of all the classes, that are right.
+ *
+ * With streaming_metrics, the layer also accumulates its scores over the
+ * batches of the TEST phase into metrics(), from which Solver::Test reports
+ * the AUC, precision and recall of the whole test pass.
+ */
 template <typename Dtype>
 class SemiAccuracyLayer: public Layer<Dtype> {
  public:
@@ -101,6 +153,10 @@ class SemiAccuracyLayer: public Layer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 2; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
 
+  // The metrics accumulated since their last Reset, or NULL without
+  // streaming_metrics.
+  virtual StreamingMetrics* metrics() { return metrics_.get(); }
+
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top);
@@ -113,10 +169,11 @@ class SemiAccuracyLayer: public Layer<Dtype> {
       if (propagate_down[i]) { NOT_IMPLEMENTED; }
     }
   }
-    
-};
-
 
+  /// The bag segments of each column of labels.
+  vector<BagSegments> segments_;
+  shared_ptr<StreamingMetrics> metrics_;
+};
 
 /**
  * @brief An interface for Layer%s that take two Blob%s as input -- usually
@@ -425,49 +482,81 @@ class HingeLossLayer : public LossLayer<Dtype> {
       const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
 };
 
+/**
+ * @brief Computes a multiple instance learning loss on sigmoid scores, from
+ *        positives, negatives and weakly labelled bags of the same batch.
+ *
+ * The labels are -1 for a positive, -2 for a negative, and a bag id >= 0
+ * for the items of a weak bag, which are consecutive. The loss is
+ * @f$ \alpha L_p + \beta L_n + \gamma L_w @f$, the means of the sigmoid
+ * cross-entropy losses of the positives (as positives), of the negatives
+ * (as negatives), and of the best scoring item of each bag (as a positive).
+ *
+ * With @f$ C > 1 @f$ scores per item, each class is scored on its own and
+ * the losses are averaged over the classes. The labels are then either
+ * shared by the classes (@f$ N \times 1 @f$) or given per class
+ * (@f$ N \times C @f$), in which case each class has its own bags.
+ *
+ * Forward computes every sigmoid and log-sigmoid at once, stably, and
+ * keeps the gradient for Backward. With hard_negative_cache, it also reports
+ * the loss of each negative of the TRAIN batches to the HardNegativeCache of
+ * the data layer, which keeps the hardest ones for it to replay.
+ */
 template <typename Dtype>
 class SemiLossLayer : public LossLayer<Dtype> {
-	public:
-	 /**
-	  * @param param provides SemiLossParameter semi_loss_param,
-      *     with SemiLossLayer options:
-      *   -	alpha (\b optional, default 1) the loss weight on positive data
-      *   - beta  (\b optional, default 1) the loss weight on negative data
-      *   - gamma (\b optional, default 1) the loss weight on weakly data	  
-	  */
-	 explicit SemiLossLayer(const LayerParameter& param)
-	     : LossLayer<Dtype>(param) {}
-	 virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
-	     vector<Blob<Dtype>*>* top);
-	 
-	 virtual inline int ExactNumBottomBlobs() const { return 2; }
-	 //bottom[0]:data;
-	 //bottom[1]:label;
-     //negative images: -2
-     //positive images: -1
-     //weakly bags: 0,1,2,3,...	 
-	 
-	 virtual inline LayerParameter_LayerType type() const {
-	   return LayerParameter_LayerType_SEMI_LOSS;
-	 }
-	 
-	 protected:
-	 /// @copydoc SemiLossLayer
-	 virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-	     vector<Blob<Dtype>*>* top);
-		 
-	 virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-         const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
-		 
-	 Dtype alpha_;
-	 Dtype beta_;
-	 Dtype gamma_;
-	 Blob<Dtype> positive_weights_;
-	 Blob<Dtype> negative_weights_;
-	 Blob<Dtype> weakly_weights_;
-	 Dtype num_p;
-	 Dtype num_n;
-	 Dtype num_w;
+ public:
+  /**
+   * @param param provides SemiLossParameter semi_loss_param,
+   *     with SemiLossLayer options:
+   *   - alpha (\b optional, default 0.5) the loss weight on positive data
+   *   - beta  (\b optional, default 0.4) the loss weight on negative data
+   *   - gamma (\b optional, default 0.3) the loss weight on weakly data
+   *   - hard_negative_cache (\b optional) the name of the hard negative
+   *     cache to report the loss of the negatives to
+   */
+  explicit SemiLossLayer(const LayerParameter& param)
+      : LossLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+
+  virtual inline int ExactNumBottomBlobs() const { return 2; }
+
+  virtual inline LayerParameter_LayerType type() const {
+    return LayerParameter_LayerType_SEMI_LOSS;
+  }
+
+ protected:
+  /// @copydoc SemiLossLayer
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      vector<Blob<Dtype>*>* top);
+
+  /**
+   * @brief Computes the SemiLoss error gradient w.r.t. the predictions: it
+   *        is zero but for the positives, the negatives, and the best item
+   *        of each bag.
+   *
+   * Gradients cannot be computed with respect to the label inputs (bottom[1]),
+   * so this method ignores bottom[1] and requires !propagate_down[1], crashing
+   * if propagate_down[1] is set.
+   */
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, vector<Blob<Dtype>*>* bottom);
+
+  Dtype alpha_;
+  Dtype beta_;
+  Dtype gamma_;
+  /// The bag segments of each column of labels.
+  vector<BagSegments> segments_;
+  /// For each score x: the sigmoid, and log(1 + exp(-|x|)).
+  Blob<Dtype> sigmoid_;
+  Blob<Dtype> log_term_;
+  /// The gradient of the loss w.r.t. the scores, computed by Forward.
+  Blob<Dtype> diff_;
+  shared_ptr<HardNegativeCache<Dtype> > hard_negatives_;
+  /// The loss of each item as a negative, for hard_negatives_.
+  vector<Dtype> negative_loss_;
 };
 
 /**
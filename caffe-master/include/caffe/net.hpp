@@ -172,6 +172,15 @@ class Net {
   void AppendParam(const NetParameter& param, const int layer_id,
                    const int param_id);
 
+  /**
+   * @brief Back the blobs whose lifetimes do not overlap with the same memory,
+   *        if no layer needs backward computation.
+   *
+   * Keeps the inputs and outputs of the net and the blobs named in the
+   * keep_blob field of param in memory of their own.
+   */
+  void ReuseBlobMemory(const NetParameter& param);
+
   /// @brief Helper for displaying debug info in Forward.
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
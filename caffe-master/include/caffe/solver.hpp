@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "caffe/net.hpp"
+#include "caffe/util/benchmark.hpp"
 
 namespace caffe {
 
@@ -53,11 +54,20 @@ class Solver {
   void Restore(const char* resume_file);
   virtual void RestoreSolverState(const SolverState& state) = 0;
   void DisplayOutputBlobs(const int net_id);
+  // Logs the share of the time since the previous display, test or snapshot
+  // that Forward waited for the prefetching data layers of the train net,
+  // i.e. that the net was starved of data, and that their prefetch threads
+  // were idle.
+  void DisplayDataStarvation();
+  // Starts the time DisplayDataStarvation reports on over, so that tests and
+  // snapshots do not count as training time.
+  void ResetDataStarvation();
 
   SolverParameter param_;
   int iter_;
   shared_ptr<Net<Dtype> > net_;
   vector<shared_ptr<Net<Dtype> > > test_nets_;
+  CPUTimer display_timer_;
 
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
@@ -51,6 +51,10 @@ class SyncedMemory {
   const void* gpu_data();
   void* mutable_cpu_data();
   void* mutable_gpu_data();
+  // Exchanges the buffers (and their sync state) of this and other, which
+  // must have the same size. Owners of either SyncedMemory see the swapped
+  // contents without any copy.
+  void swap(SyncedMemory* other);
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() { return head_; }
   size_t size() { return size_; }
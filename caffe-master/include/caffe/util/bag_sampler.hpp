@@ -0,0 +1,62 @@
+#ifndef CAFFE_UTIL_BAG_SAMPLER_HPP_
+#define CAFFE_UTIL_BAG_SAMPLER_HPP_
+
+#include <utility>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Assembles the batches of SemiLossLayer out of whole weak bags and
+ *        quotas of positives and negatives (see BagSamplingParameter).
+ *
+ * A batch lists the indices of its positives, then of its negatives, then of
+ * its bags, so that SemiLossLayer sees each bag of the batch whole. Two bags
+ * of the same label are never put in the same batch, where they would read
+ * as one.
+ */
+class BagSampler {
+ public:
+  // labels are those of the records, in key order.
+  BagSampler(const BagSamplingParameter& param, const int batch_size,
+      const vector<int>& labels, const bool shuffle);
+
+  // Appends the record indices of the next batch to batch.
+  void NextBatch(vector<int>* batch);
+
+  int num_bags() const { return bags_.size(); }
+  int num_positives() const { return positive_order_.size(); }
+  int num_negatives() const { return negative_order_.size(); }
+
+ protected:
+  // Returns the next item of order, starting over, reshuffled if need be,
+  // at its end.
+  int NextItem(vector<int>* order, int* pos);
+  void Shuffle(vector<int>* order);
+
+  const int batch_size_;
+  const int num_positives_;
+  const int num_negatives_;
+  const int lookahead_;
+  // The (first record, size) of the bags, and their labels.
+  vector<pair<int, int> > bags_;
+  vector<int> bag_labels_;
+  // The order in which the bags, and the records of the positives and
+  // negatives, are taken, and the position of the next one.
+  vector<int> bag_order_;
+  vector<int> positive_order_;
+  vector<int> negative_order_;
+  int bag_pos_;
+  int positive_pos_;
+  int negative_pos_;
+  shared_ptr<Caffe::RNG> rng_;
+
+  DISABLE_COPY_AND_ASSIGN(BagSampler);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BAG_SAMPLER_HPP_
@@ -35,6 +35,26 @@ class Timer {
   float elapsed_milliseconds_;
 };
 
+// Times intervals on the host clock, with microsecond resolution, whatever
+// the mode: e.g. the stages of a data layer's prefetch thread.
+class CPUTimer {
+ public:
+  CPUTimer() : running_(false), has_run_at_least_once_(false) {}
+  void Start();
+  void Stop();
+  float MilliSeconds();
+  float Seconds();
+
+  inline bool running() { return running_; }
+  inline bool has_run_at_least_once() { return has_run_at_least_once_; }
+
+ protected:
+  bool running_;
+  bool has_run_at_least_once_;
+  boost::posix_time::ptime start_cpu_;
+  boost::posix_time::ptime stop_cpu_;
+};
+
 }  // namespace caffe
 
 #endif   // CAFFE_UTIL_BENCHMARK_H_
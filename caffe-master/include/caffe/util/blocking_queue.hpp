@@ -0,0 +1,48 @@
+#ifndef CAFFE_UTIL_BLOCKING_QUEUE_HPP_
+#define CAFFE_UTIL_BLOCKING_QUEUE_HPP_
+
+#include <queue>
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A thread-safe FIFO queue whose pop blocks until an element is
+ *        available.
+ *
+ * Used to hand batches back and forth between the prefetch thread of a data
+ * layer and the thread running Forward. Blocking pops are boost interruption
+ * points, so a thread waiting on the queue can be stopped with
+ * InternalThread::StopInternalThread.
+ */
+template <typename T>
+class BlockingQueue {
+ public:
+  BlockingQueue();
+
+  void push(const T& t);
+  bool try_pop(T* t);
+  // Blocks until an element is available. If log_on_wait is not empty, it is
+  // logged (at most once every few calls) whenever the caller has to wait,
+  // which helps detecting e.g. data feeding that is too slow.
+  T pop(const string& log_on_wait = "");
+  bool try_peek(T* t);
+  T peek();
+  size_t size() const;
+
+ protected:
+  // The synchronization primitives live in the .cpp file so that this header
+  // does not pull boost/thread.hpp into code compiled by nvcc.
+  class Sync;
+
+  std::queue<T> queue_;
+  shared_ptr<Sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(BlockingQueue);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLOCKING_QUEUE_HPP_
@@ -0,0 +1,60 @@
+#ifndef CAFFE_UTIL_DATUM_CACHE_HPP_
+#define CAFFE_UTIL_DATUM_CACHE_HPP_
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A thread-safe, size-bounded cache of decoded Datum%s, which evicts
+ *        the least recently used ones first.
+ *
+ * Data layers reading image files use it to decode (and resize) every image
+ * once instead of once per epoch. Cached datums are immutable and shared, so
+ * a hit costs a lookup, not a copy, and an evicted datum stays valid for as
+ * long as a reader holds it.
+ */
+class DatumCache {
+ public:
+  // Holds datums of up to capacity bytes in total.
+  explicit DatumCache(const size_t capacity);
+
+  // Returns the datum cached under key, or NULL, and counts a hit or a miss.
+  shared_ptr<const Datum> Get(const string& key);
+  // Caches datum under key, evicting the least recently used datums to make
+  // room. Datums larger than the whole cache are not cached.
+  void Put(const string& key, const shared_ptr<const Datum>& datum);
+
+  size_t capacity() const { return capacity_; }
+  size_t size() const;
+  size_t count() const;
+  size_t hits() const;
+  size_t misses() const;
+
+ protected:
+  // The synchronization primitives live in the .cpp file so that this header
+  // does not pull boost/thread.hpp into code compiled by nvcc.
+  class Sync;
+  typedef std::list<std::pair<string, shared_ptr<const Datum> > > Entries;
+
+  const size_t capacity_;
+  size_t size_;
+  size_t hits_;
+  size_t misses_;
+  // The entries, most recently used first, and where they are by key.
+  Entries entries_;
+  std::map<string, Entries::iterator> index_;
+  shared_ptr<Sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(DatumCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DATUM_CACHE_HPP_
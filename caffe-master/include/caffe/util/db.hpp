@@ -0,0 +1,139 @@
+#ifndef CAFFE_UTIL_DB_HPP_
+#define CAFFE_UTIL_DB_HPP_
+
+#include <string>
+
+#include "leveldb/db.h"
+#include "lmdb.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe { namespace db {
+
+/**
+ * @brief Reads the records of a database in key order.
+ */
+class Cursor {
+ public:
+  Cursor() {}
+  virtual ~Cursor() {}
+  virtual void SeekToFirst() = 0;
+  // Moves to the record with the given key; invalid if there is none.
+  virtual void Seek(const string& key) = 0;
+  virtual void Next() = 0;
+  virtual bool valid() const = 0;
+  virtual string key() const = 0;
+  // The serialized value of the current record. Unless stable_values() is
+  // true, it is only valid until the cursor moves.
+  virtual const char* value_data() const = 0;
+  virtual int value_size() const = 0;
+  virtual bool stable_values() const = 0;
+
+  DISABLE_COPY_AND_ASSIGN(Cursor);
+};
+
+/**
+ * @brief A database opened for reading, LevelDB or LMDB.
+ */
+class DB {
+ public:
+  DB() {}
+  virtual ~DB() {}
+  virtual void Open(const string& source) = 0;
+  virtual void Close() = 0;
+  // The cursor is positioned on the first record.
+  virtual Cursor* NewCursor() = 0;
+
+  DISABLE_COPY_AND_ASSIGN(DB);
+};
+
+class LevelDBCursor : public Cursor {
+ public:
+  explicit LevelDBCursor(leveldb::Iterator* iter)
+      : iter_(iter), missed_seek_(false) { SeekToFirst(); }
+  ~LevelDBCursor() { delete iter_; }
+  virtual void SeekToFirst() {
+    iter_->SeekToFirst();
+    missed_seek_ = false;
+  }
+  virtual void Seek(const string& key);
+  virtual void Next() { iter_->Next(); }
+  virtual bool valid() const { return !missed_seek_ && iter_->Valid(); }
+  virtual string key() const { return iter_->key().ToString(); }
+  virtual const char* value_data() const { return iter_->value().data(); }
+  virtual int value_size() const { return iter_->value().size(); }
+  virtual bool stable_values() const { return false; }
+
+ private:
+  leveldb::Iterator* iter_;
+  // leveldb seeks to the first key at or past the given one.
+  bool missed_seek_;
+};
+
+class LevelDB : public DB {
+ public:
+  LevelDB() : db_(NULL) {}
+  virtual ~LevelDB() { Close(); }
+  virtual void Open(const string& source);
+  virtual void Close();
+  virtual LevelDBCursor* NewCursor();
+
+ private:
+  leveldb::DB* db_;
+};
+
+// Each cursor has its own read-only transaction, during which the values
+// stay mapped in memory.
+class LMDBCursor : public Cursor {
+ public:
+  LMDBCursor(MDB_txn* mdb_txn, MDB_cursor* mdb_cursor)
+      : mdb_txn_(mdb_txn), mdb_cursor_(mdb_cursor), valid_(false) {
+    SeekToFirst();
+  }
+  virtual ~LMDBCursor() {
+    mdb_cursor_close(mdb_cursor_);
+    mdb_txn_abort(mdb_txn_);
+  }
+  virtual void SeekToFirst() { Get(MDB_FIRST); }
+  virtual void Seek(const string& key);
+  virtual void Next() { Get(MDB_NEXT); }
+  virtual bool valid() const { return valid_; }
+  virtual string key() const {
+    return string(static_cast<const char*>(mdb_key_.mv_data),
+        mdb_key_.mv_size);
+  }
+  virtual const char* value_data() const {
+    return static_cast<const char*>(mdb_value_.mv_data);
+  }
+  virtual int value_size() const { return mdb_value_.mv_size; }
+  virtual bool stable_values() const { return true; }
+
+ private:
+  void Get(MDB_cursor_op op);
+
+  MDB_txn* mdb_txn_;
+  MDB_cursor* mdb_cursor_;
+  MDB_val mdb_key_, mdb_value_;
+  bool valid_;
+};
+
+class LMDB : public DB {
+ public:
+  LMDB() : mdb_env_(NULL) {}
+  virtual ~LMDB() { Close(); }
+  virtual void Open(const string& source);
+  virtual void Close();
+  virtual LMDBCursor* NewCursor();
+
+ private:
+  MDB_env* mdb_env_;
+  MDB_dbi mdb_dbi_;
+};
+
+DB* GetDB(DataParameter::DB backend);
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_HPP_
@@ -0,0 +1,76 @@
+#ifndef CAFFE_UTIL_HARD_NEGATIVE_CACHE_HPP_
+#define CAFFE_UTIL_HARD_NEGATIVE_CACHE_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Keeps the preprocessed pixels of the hardest negatives (label -2)
+ *        seen recently, for DataLayer to replay them (see
+ *        HardNegativeParameter).
+ *
+ * The data layer stages the negatives of each batch it forwards; the
+ * SemiLossLayer reading the batch then reports the loss of its items, and the
+ * cache keeps the staged negatives whose loss is among the capacity highest
+ * it holds. The prefetch thread of the data layer pops the hardest ones to
+ * replay them in its next batches; a replayed negative is only kept again if
+ * its new loss is still high, so the cache follows the hardest negatives of
+ * the current net.
+ *
+ * The layers of a process find a cache by name, like the data arenas.
+ */
+template <typename Dtype>
+class HardNegativeCache {
+ public:
+  // Returns the cache of that name, created for items of dim values if no
+  // layer holds it yet.
+  static shared_ptr<HardNegativeCache> Get(const string& name,
+      const int capacity, const int dim);
+  // Returns the cache of that name, or NULL if no layer holds it.
+  static shared_ptr<HardNegativeCache> Find(const string& name);
+
+  HardNegativeCache(const int capacity, const int dim);
+
+  // Copies the negatives among the num items of data, labelled by labels,
+  // in place of the ones staged before.
+  void Stage(const Dtype* data, const Dtype* labels, const int num);
+  // Caches the staged negatives of the highest losses, given the loss of
+  // each of the num items of their batch, and unstages them. Does nothing if
+  // no batch is staged.
+  void Update(const Dtype* losses, const int num);
+  // Moves the hardest cached negative to data, or returns false if the cache
+  // is empty.
+  bool Pop(Dtype* data);
+
+  int capacity() const { return capacity_; }
+  int dim() const { return dim_; }
+  int size();
+
+ protected:
+  // The mutex lives in the .cpp file so that this header does not pull
+  // boost/thread.hpp into code compiled by nvcc.
+  class Sync;
+
+  const int capacity_;
+  const int dim_;
+  shared_ptr<Sync> sync_;
+  // The slot of the pixels of each cached negative, by loss.
+  std::multimap<Dtype, int> entries_;
+  vector<vector<Dtype> > slots_;
+  vector<int> free_slots_;
+  // The staged negatives: their index in their batch, and their pixels.
+  vector<int> staged_items_;
+  vector<Dtype> staged_data_;
+  int staged_num_;
+
+  DISABLE_COPY_AND_ASSIGN(HardNegativeCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HARD_NEGATIVE_CACHE_HPP_
@@ -102,8 +102,39 @@ inline bool ReadImageToDatum(const string& filename, const int label,
   return ReadImageToDatum(filename, label, 0, 0, datum);
 }
 
+// Stores the compressed image file as it is in an encoded datum. If height
+// and width are positive, the image is resized first and re-encoded in the
+// format given by the file extension.
+bool ReadEncodedImageToDatum(const string& filename, const int label,
+    const int height, const int width, const bool is_color, Datum* datum);
+
+// Parses a serialized Datum without copying its data field: *data and
+// *data_size point into buffer instead (NULL and 0 if there is no data), and
+// datum->data() is left empty. Returns false if buffer is not a valid Datum.
+bool ParseDatumSkippingData(const char* buffer, const int size, Datum* datum,
+    const char** data, int* data_size);
+
+// Decodes an encoded datum in place into uint8 pixels; does nothing if the
+// datum is not encoded. Returns false if the data could not be decoded.
+bool DecodeDatum(Datum* datum);
+
 leveldb::Options GetLevelDBOptions();
 
+// HDF5 is usually built without thread safety: code that may call it
+// concurrently with other threads (e.g. HDF5Reader) holds an HDF5Lock
+// meanwhile. The lock is recursive.
+class HDF5Lock {
+ public:
+  HDF5Lock();
+  ~HDF5Lock();
+
+  DISABLE_COPY_AND_ASSIGN(HDF5Lock);
+};
+
+// The HDF5 memory type of Dtype values.
+template <typename Dtype>
+hid_t hdf5_native_type();
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
   hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -88,6 +88,10 @@ void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r);
 template <typename Dtype>
 void caffe_exp(const int n, const Dtype* a, Dtype* y);
 
+// y[i] = log(1 + a[i]), accurate for small a[i].
+template <typename Dtype>
+void caffe_log1p(const int n, const Dtype* a, Dtype* y);
+
 template <typename Dtype>
 void caffe_abs(const int n, const Dtype* a, Dtype* y);
 
@@ -0,0 +1,90 @@
+#ifndef CAFFE_UTIL_RAW_FILE_HPP_
+#define CAFFE_UTIL_RAW_FILE_HPP_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A dataset of fixed-size records, stored flat in one file: a header,
+ *        then the records, uint8 or float pixels in channel, height, width
+ *        order, then their int32 labels.
+ *
+ * RawFile maps the file in memory, so that a record is found by its index
+ * alone, without database lookup or protobuf parsing, and read by the kernel
+ * on demand. The values are stored in host byte order.
+ */
+class RawFile {
+ public:
+  RawFile();
+  ~RawFile();
+
+  // Maps filename, advising the kernel that the records will be read in
+  // random order if shuffle, sequentially otherwise.
+  void Open(const string& filename, const bool shuffle);
+  void Close();
+
+  int size() const { return size_; }
+  // The shape of the records, without their data.
+  const Datum& datum() const { return datum_; }
+  bool float_data() const { return float_data_; }
+  // The size of a record in bytes.
+  size_t record_size() const { return record_size_; }
+  const char* record(const int index) const {
+    return records_ + index * record_size_;
+  }
+  int label(const int index) const { return labels_[index]; }
+  // Advises the kernel to read the pages of a record ahead.
+  void WillNeed(const int index) const;
+
+ protected:
+  string filename_;
+  void* map_;
+  size_t map_size_;
+  int size_;
+  Datum datum_;
+  bool float_data_;
+  size_t record_size_;
+  const char* records_;
+  const int32_t* labels_;
+
+  DISABLE_COPY_AND_ASSIGN(RawFile);
+};
+
+/**
+ * @brief Writes the datums given to it to a RawFile, e.g. for
+ *        convert_imageset --backend raw.
+ *
+ * The first datum fixes the shape of the records, and whether they hold
+ * uint8 (data) or float (float_data) values; the others must match it.
+ */
+class RawFileWriter {
+ public:
+  RawFileWriter() : file_(NULL), float_data_(false) {}
+  ~RawFileWriter() { Close(); }
+
+  void Open(const string& filename);
+  void Write(const Datum& datum);
+  // Writes the labels and the header.
+  void Close();
+
+ protected:
+  string filename_;
+  FILE* file_;
+  Datum datum_;
+  bool float_data_;
+  vector<int32_t> labels_;
+
+  DISABLE_COPY_AND_ASSIGN(RawFileWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_RAW_FILE_HPP_
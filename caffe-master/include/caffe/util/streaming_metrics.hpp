@@ -0,0 +1,72 @@
+#ifndef CAFFE_UTIL_STREAMING_METRICS_HPP_
+#define CAFFE_UTIL_STREAMING_METRICS_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Accumulates the raw scores (the inputs of the sigmoid) of
+ *        positives, negatives and weak bags over a whole test pass, to report
+ *        the AUC, precision and recall of the dataset rather than the mean of
+ *        those of its batches.
+ *
+ * The scores are clamped to [-score_range, score_range] and kept in
+ * histograms of num_bins bins of equal width over that range, so that the
+ * memory used is bounded whatever the size of the dataset. Binning the scores rather than their sigmoid keeps
+ * the confident scores of a trained net apart. The AUC and average precision
+ * are computed from the histograms, and so are exact but for the pairs of
+ * scores that fall in the same bin, which count as ties, as do the scores
+ * beyond the range. Precision, recall and bag accuracy, at a score of 0, are
+ * exact.
+ */
+class StreamingMetrics {
+ public:
+  explicit StreamingMetrics(const int num_bins = 1000,
+      const double score_range = 20);
+
+  void Reset();
+  void AddPositive(const double score);
+  void AddNegative(const double score);
+  // Adds a weak bag by the score of its best item; it is right if the score
+  // is above 0.
+  void AddBag(const double best_score);
+
+  // The area under the ROC curve of the positives against the negatives.
+  double AUC() const;
+  // The area under their precision-recall curve.
+  double AveragePrecision() const;
+  // The share of the scores above 0 that are positives.
+  double Precision() const;
+  // The share of the positives scored above 0.
+  double Recall() const;
+  // The share of the bags whose best item is scored above 0.
+  double BagAccuracy() const;
+
+  int num_bins() const { return positives_.size(); }
+  double score_range() const { return score_range_; }
+  uint64_t num_positives() const { return num_positives_; }
+  uint64_t num_negatives() const { return num_negatives_; }
+  uint64_t num_bags() const { return num_bags_; }
+
+ protected:
+  int Bin(const double score) const;
+
+  double score_range_;
+  vector<uint64_t> positives_;
+  vector<uint64_t> negatives_;
+  uint64_t num_positives_;
+  uint64_t num_negatives_;
+  uint64_t num_bags_;
+  uint64_t true_positives_;
+  uint64_t false_positives_;
+  uint64_t right_bags_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_STREAMING_METRICS_HPP_
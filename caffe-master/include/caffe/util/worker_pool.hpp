@@ -0,0 +1,55 @@
+#ifndef CAFFE_UTIL_WORKER_POOL_HPP_
+#define CAFFE_UTIL_WORKER_POOL_HPP_
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A unit of work that a WorkerPool splits across its workers.
+ *
+ * Run is called once on every worker of the pool, concurrently, and must only
+ * touch the part of the work (e.g. the slice of a batch) that belongs to the
+ * given worker_id.
+ */
+class ParallelTask {
+ public:
+  virtual ~ParallelTask() {}
+  virtual void Run(const int worker_id, const int num_workers) = 0;
+};
+
+/**
+ * @brief A fixed set of long-lived worker threads that run ParallelTask%s.
+ *
+ * The threads are started once by the constructor and stopped by the
+ * destructor, so running a task does not pay for thread creation.
+ */
+class WorkerPool {
+ public:
+  explicit WorkerPool(const int num_workers);
+  ~WorkerPool();
+
+  /**
+   * Runs task on all the workers and returns once every worker is done.
+   * Waiting for the workers is not an interruption point: the task usually
+   * lives on the caller's stack and must outlive the workers using it.
+   */
+  void Run(ParallelTask* task);
+
+  int num_workers() const { return workers_.size(); }
+
+ protected:
+  class Worker;
+
+  vector<shared_ptr<Worker> > workers_;
+  BlockingQueue<int> done_;
+
+  DISABLE_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WORKER_POOL_HPP_
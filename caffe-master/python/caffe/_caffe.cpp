@@ -117,6 +117,19 @@ void PyNet::set_input_arrays(bp::object data_obj, bp::object labels_obj) {
         " multiple of batch size");
   }
 
+  if (md_layer->ring_size() > 0) {
+    // The arrays are copied into the ring of the layer. Release the GIL
+    // meanwhile, so that other Python threads run while this one waits for
+    // free batches.
+    float* data = static_cast<float*>(PyArray_DATA(data_arr));
+    float* labels = static_cast<float*>(PyArray_DATA(labels_arr));
+    const int n = PyArray_DIMS(data_arr)[0];
+    Py_BEGIN_ALLOW_THREADS
+    md_layer->AddBatches(data, labels, n);
+    Py_END_ALLOW_THREADS
+    return;
+  }
+
   // hold references
   input_data_ = data_obj;
   input_labels_ = labels_obj;
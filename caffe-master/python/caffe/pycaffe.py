@@ -338,6 +338,8 @@ def _Net_set_input_arrays(self, data, labels):
     """
     Set input arrays of the in-memory MemoryDataLayer.
     (Note: this is only for networks declared with the memory data layer.)
+    If the layer has a ring_size, the arrays are copied into its ring
+    instead, blocking until there is room for them.
     """
     if labels.ndim == 1:
         labels = np.ascontiguousarray(labels[:, np.newaxis, np.newaxis,
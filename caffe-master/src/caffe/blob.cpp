@@ -103,6 +103,26 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
   diff_ = other.diff();
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ShareDataMemory(const shared_ptr<SyncedMemory>& memory) {
+  CHECK(memory);
+  CHECK_GE(memory->size(), capacity_ * sizeof(Dtype));
+  data_ = memory;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::SwapData(Blob* other) {
+  CHECK(other);
+  CHECK_EQ(count_, other->count());
+  CHECK(data_);
+  CHECK(other->data_);
+  if (data_->size() == other->data_->size()) {
+    data_->swap(other->data_.get());
+  } else {
+    caffe_copy(count_, other->cpu_data(), mutable_cpu_data());
+  }
+}
+
 // The "update" method is used for parameter blobs in a Net, which are stored
 // as Blob<float> or Blob<double> -- hence we do not define it for
 // Blob<int> or Blob<unsigned int>.
@@ -0,0 +1,168 @@
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/data_reader.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+// Asks the kernel to read the memory mapped pages of [data, data + size)
+// ahead. It is only a hint, so failures are ignored.
+static void AdviseWillNeed(const char* data, const int size) {
+  static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(data) & ~(page_size - 1);
+  const uintptr_t end = reinterpret_cast<uintptr_t>(data) + size;
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+DataReader::DataReader(const DataParameter& param, const string& source,
+    const int queue_size, const unsigned int skip)
+    : source_(source), order_pos_(0) {
+  CHECK_GT(queue_size, 0);
+  db_.reset(db::GetDB(param.backend()));
+  db_->Open(source);
+  cursor_.reset(db_->NewCursor());
+  CHECK(cursor_->valid()) << "Database " << source << " is empty";
+  if (param.has_bag_sampling()) {
+    vector<int> labels;
+    Datum datum;
+    for (; cursor_->valid(); cursor_->Next()) {
+      keys_.push_back(cursor_->key());
+      CHECK(datum.ParseFromArray(cursor_->value_data(),
+          cursor_->value_size())) << "Failed to parse a datum of " << source;
+      labels.push_back(datum.label());
+    }
+    LOG(INFO) << "Indexed " << keys_.size() << " keys and labels of " << source
+        << " to sample batches of bags";
+    bag_sampler_.reset(new BagSampler(param.bag_sampling(),
+        param.batch_size(), labels, param.shuffle()));
+    // Skip whole batches, to stay aligned on those of the data layer.
+    for (unsigned int i = 0; i <= skip / param.batch_size(); ++i) {
+      order_.clear();
+      bag_sampler_->NextBatch(&order_);
+    }
+  } else if (param.shuffle()) {
+    for (; cursor_->valid(); cursor_->Next()) {
+      keys_.push_back(cursor_->key());
+    }
+    LOG(INFO) << "Indexed " << keys_.size() << " keys of " << source
+        << " to read them in shuffled order";
+    const unsigned int shuffle_rng_seed = caffe_rng_rand();
+    shuffle_rng_.reset(new Caffe::RNG(shuffle_rng_seed));
+    order_.resize(keys_.size());
+    for (int i = 0; i < order_.size(); ++i) {
+      order_[i] = i;
+    }
+    ShuffleKeys();
+    order_pos_ = skip % keys_.size();
+  } else if (skip) {
+    LOG(INFO) << "Skipping first " << skip << " data points of " << source;
+    for (unsigned int i = 0; i < skip; ++i) {
+      Next();
+    }
+  }
+  records_.resize(queue_size);
+  for (int i = 0; i < queue_size; ++i) {
+    records_[i].reset(new DataRecord());
+    free_.push(records_[i].get());
+  }
+  CHECK(StartInternalThread()) << "Thread execution failed";
+}
+
+DataReader::~DataReader() {
+  CHECK(StopInternalThread()) << "Thread joining failed";
+  cursor_.reset();
+  db_->Close();
+}
+
+void DataReader::Next() {
+  cursor_->Next();
+  if (!cursor_->valid()) {
+    // We have reached the end. Restart from the first.
+    DLOG(INFO) << "Restarting data prefetching from start of " << source_;
+    cursor_->SeekToFirst();
+  }
+}
+
+void DataReader::Read(DataRecord* record) {
+  if (cursor_->stable_values()) {
+    record->data_ = cursor_->value_data();
+    record->size_ = cursor_->value_size();
+  } else {
+    // The strings keep their capacity, so this rarely allocates.
+    record->buffer_.assign(cursor_->value_data(), cursor_->value_size());
+    record->data_ = record->buffer_.data();
+    record->size_ = record->buffer_.size();
+  }
+}
+
+void DataReader::ShuffleKeys() {
+  caffe::rng_t* shuffle_rng =
+      static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+  shuffle(order_.begin(), order_.end(), shuffle_rng);
+}
+
+void DataReader::ReadShuffledChunk() {
+  const int chunk_size = std::min<int>(std::max<int>(records_.size() / 2, 1),
+      order_.size() - order_pos_);
+  chunk_.resize(chunk_size);
+  chunk_records_.resize(chunk_size);
+  for (int i = 0; i < chunk_size; ++i) {
+    chunk_[i] = make_pair(order_[order_pos_ + i], i);
+    chunk_records_[i] = free_.pop();
+  }
+  // The keys were indexed in key order, so sorting their indices gives the
+  // order of the records in the database.
+  std::sort(chunk_.begin(), chunk_.end());
+  for (int i = 0; i < chunk_size; ++i) {
+    cursor_->Seek(keys_[chunk_[i].first]);
+    CHECK(cursor_->valid()) << "Key " << keys_[chunk_[i].first]
+        << " is missing from " << source_;
+    DataRecord* record = chunk_records_[chunk_[i].second];
+    Read(record);
+    if (cursor_->stable_values()) {
+      AdviseWillNeed(record->data_, record->size_);
+    }
+  }
+  for (int i = 0; i < chunk_size; ++i) {
+    full_.push(chunk_records_[i]);
+  }
+  order_pos_ += chunk_size;
+  if (order_pos_ == order_.size()) {
+    if (bag_sampler_) {
+      order_.clear();
+      bag_sampler_->NextBatch(&order_);
+    } else {
+      DLOG(INFO) << "Reshuffling " << source_;
+      ShuffleKeys();
+    }
+    order_pos_ = 0;
+  }
+}
+
+void DataReader::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      if (keys_.size()) {
+        ReadShuffledChunk();
+      } else {
+        DataRecord* record = free_.pop();
+        Read(record);
+        full_.push(record);
+        Next();
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted while waiting for a free record; exit cleanly.
+  }
+}
+
+}  // namespace caffe
@@ -1,3 +1,9 @@
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <string>
 
 #include "caffe/data_transformer.hpp"
@@ -6,16 +12,129 @@
 
 namespace caffe {
 
+// Writes (src[j] - mean) * scale for the n uint8 pixels of a row into dst, in
+// reverse order if mirror is set. The mean is either a row of the mean image
+// (mean_row) or, if mean_row is NULL, the constant mean_value.
+template <typename Dtype>
+static void transform_row_scalar(const int n, const uint8_t* src,
+    const Dtype* mean_row, const Dtype mean_value, const Dtype scale,
+    const bool mirror, Dtype* dst) {
+  const int step = mirror ? -1 : 1;
+  Dtype* out = mirror ? dst + n - 1 : dst;
+  if (mean_row) {
+    for (int j = 0; j < n; ++j, out += step) {
+      *out = (static_cast<Dtype>(src[j]) - mean_row[j]) * scale;
+    }
+  } else {
+    for (int j = 0; j < n; ++j, out += step) {
+      *out = (static_cast<Dtype>(src[j]) - mean_value) * scale;
+    }
+  }
+}
+
+// Vectorized (SSE2 or AVX2) for float when the compiler targets it.
+template <typename Dtype>
+static void transform_row(const int n, const uint8_t* src,
+    const Dtype* mean_row, const Dtype mean_value, const Dtype scale,
+    const bool mirror, Dtype* dst) {
+  transform_row_scalar(n, src, mean_row, mean_value, scale, mirror, dst);
+}
+
+#if defined(__AVX2__)
+
+// Converts 8 pixels at a time, the remainder is left to the scalar version.
+template <>
+void transform_row<float>(const int n, const uint8_t* src,
+    const float* mean_row, const float mean_value, const float scale,
+    const bool mirror, float* dst) {
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  const __m256 mean_value_v = _mm256_set1_ps(mean_value);
+  const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  const int n_vec = n - n % 8;
+  for (int j = 0; j < n_vec; j += 8) {
+    const __m128i pixels =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + j));
+    const __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(pixels));
+    const __m256 mean = mean_row ? _mm256_loadu_ps(mean_row + j)
+        : mean_value_v;
+    const __m256 result = _mm256_mul_ps(_mm256_sub_ps(values, mean), scale_v);
+    if (mirror) {
+      _mm256_storeu_ps(dst + n - j - 8,
+          _mm256_permutevar8x32_ps(result, reverse));
+    } else {
+      _mm256_storeu_ps(dst + j, result);
+    }
+  }
+  transform_row_scalar<float>(n - n_vec, src + n_vec,
+      mean_row ? mean_row + n_vec : NULL, mean_value, scale, mirror,
+      mirror ? dst : dst + n_vec);
+}
+
+#elif defined(__SSE2__)
+
+// Converts 16 pixels at a time, the remainder is left to the scalar version.
+template <>
+void transform_row<float>(const int n, const uint8_t* src,
+    const float* mean_row, const float mean_value, const float scale,
+    const bool mirror, float* dst) {
+  const __m128 scale_v = _mm_set1_ps(scale);
+  const __m128 mean_value_v = _mm_set1_ps(mean_value);
+  const __m128i zero = _mm_setzero_si128();
+  const int n_vec = n - n % 16;
+  for (int j = 0; j < n_vec; j += 16) {
+    const __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+    const __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+    const __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+    __m128 values[4];
+    values[0] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero));
+    values[1] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero));
+    values[2] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero));
+    values[3] = _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero));
+    for (int k = 0; k < 4; ++k) {
+      const __m128 mean = mean_row ? _mm_loadu_ps(mean_row + j + 4 * k)
+          : mean_value_v;
+      const __m128 result = _mm_mul_ps(_mm_sub_ps(values[k], mean), scale_v);
+      if (mirror) {
+        _mm_storeu_ps(dst + n - j - 4 * k - 4,
+            _mm_shuffle_ps(result, result, _MM_SHUFFLE(0, 1, 2, 3)));
+      } else {
+        _mm_storeu_ps(dst + j + 4 * k, result);
+      }
+    }
+  }
+  transform_row_scalar<float>(n - n_vec, src + n_vec,
+      mean_row ? mean_row + n_vec : NULL, mean_value, scale, mirror,
+      mirror ? dst : dst + n_vec);
+}
+
+#endif
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const int batch_item_id,
+                                       const Datum& datum,
+                                       const Dtype* mean,
+                                       Dtype* transformed_data) {
+  Transform(batch_item_id, datum, datum.data().data(), datum.data().size(),
+      mean, transformed_data);
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const int batch_item_id,
                                        const Datum& datum,
+                                       const char* data,
+                                       const int data_size,
                                        const Dtype* mean,
                                        Dtype* transformed_data) {
-  const string& data = datum.data();
+  if (!data_size) {
+    Transform(batch_item_id, datum, datum.float_data().data(), mean,
+        transformed_data);
+    return;
+  }
   const int channels = datum.channels();
   const int height = datum.height();
   const int width = datum.width();
-  const int size = datum.channels() * datum.height() * datum.width();
+  CHECK_EQ(data_size, channels * height * width) << "Incorrect data size";
 
   const int crop_size = param_.crop_size();
   const bool mirror = param_.mirror();
@@ -25,10 +144,21 @@ void DataTransformer<Dtype>::Transform(const int batch_item_id,
     LOG(FATAL) << "Current implementation requires mirror and crop_size to be "
                << "set at the same time.";
   }
+  // The per-channel mean values, if any, take the place of the mean image.
+  if (mean_values_.size()) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == channels) <<
+        "Specify either 1 mean_value or as many as channels: " << channels;
+    mean = NULL;
+  }
 
+  // Each output channel is made of rows rows of row_size pixels, which are
+  // contiguous in the datum: the crop rows, or the whole uncropped channel.
+  int h_off = 0;
+  int w_off = 0;
+  int rows = 1;
+  int row_size = height * width;
+  bool do_mirror = false;
   if (crop_size) {
-    CHECK(data.size()) << "Image cropping only support uint8 data";
-    int h_off, w_off;
     // We only do random crop when we do training.
     if (phase_ == Caffe::TRAIN) {
       h_off = Rand() % (height - crop_size);
@@ -37,51 +167,51 @@ void DataTransformer<Dtype>::Transform(const int batch_item_id,
       h_off = (height - crop_size) / 2;
       w_off = (width - crop_size) / 2;
     }
-    if (mirror && Rand() % 2) {
-      // Copy mirrored version
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < crop_size; ++h) {
-          for (int w = 0; w < crop_size; ++w) {
-            int data_index = (c * height + h + h_off) * width + w + w_off;
-            int top_index = ((batch_item_id * channels + c) * crop_size + h)
-                * crop_size + (crop_size - 1 - w);
-            Dtype datum_element =
-                static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-            transformed_data[top_index] =
-                (datum_element - mean[data_index]) * scale;
-          }
-        }
-      }
-    } else {
-      // Normal copy
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < crop_size; ++h) {
-          for (int w = 0; w < crop_size; ++w) {
-            int top_index = ((batch_item_id * channels + c) * crop_size + h)
-                * crop_size + w;
-            int data_index = (c * height + h + h_off) * width + w + w_off;
-            Dtype datum_element =
-                static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-            transformed_data[top_index] =
-                (datum_element - mean[data_index]) * scale;
-          }
-        }
-      }
+    do_mirror = mirror && Rand() % 2;
+    rows = crop_size;
+    row_size = crop_size;
+  }
+  Dtype* top_data =
+      transformed_data + batch_item_id * channels * rows * row_size;
+
+  const uint8_t* pixels = reinterpret_cast<const uint8_t*>(data);
+  for (int c = 0; c < channels; ++c) {
+    const Dtype mean_value = mean_values_.empty() ? Dtype(0)
+        : mean_values_[mean_values_.size() == 1 ? 0 : c];
+    for (int h = 0; h < rows; ++h) {
+      const int data_index = (c * height + h + h_off) * width + w_off;
+      transform_row(row_size, pixels + data_index,
+          mean ? mean + data_index : NULL, mean_value, scale, do_mirror,
+          top_data + (c * rows + h) * row_size);
     }
-  } else {
-    // we will prefer to use data() first, and then try float_data()
-    if (data.size()) {
-      for (int j = 0; j < size; ++j) {
-        Dtype datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[j]));
-        transformed_data[j + batch_item_id * size] =
-            (datum_element - mean[j]) * scale;
-      }
-    } else {
-      for (int j = 0; j < size; ++j) {
-        transformed_data[j + batch_item_id * size] =
-            (datum.float_data(j) - mean[j]) * scale;
-      }
+  }
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const int batch_item_id,
+                                       const Datum& datum,
+                                       const float* float_data,
+                                       const Dtype* mean,
+                                       Dtype* transformed_data) {
+  const int channels = datum.channels();
+  const int size = datum.height() * datum.width();
+  CHECK_EQ(param_.crop_size(), 0) << "Image cropping only support uint8 data";
+  if (param_.mirror()) {
+    LOG(FATAL) << "Current implementation requires mirror and crop_size to be "
+               << "set at the same time.";
+  }
+  if (mean_values_.size()) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == channels) <<
+        "Specify either 1 mean_value or as many as channels: " << channels;
+    mean = NULL;
+  }
+  const Dtype scale = param_.scale();
+  Dtype* top_data = transformed_data + batch_item_id * channels * size;
+  for (int c = 0; c < channels; ++c) {
+    const Dtype mean_value = mean_values_.empty() ? Dtype(0)
+        : mean_values_[mean_values_.size() == 1 ? 0 : c];
+    for (int j = c * size; j < (c + 1) * size; ++j) {
+      top_data[j] = (float_data[j] - (mean ? mean[j] : mean_value)) * scale;
     }
   }
 }
@@ -0,0 +1,201 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "hdf5.h"
+
+#include "caffe/data_layers.hpp"
+#include "caffe/hdf5_reader.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+// Opens dataset_name of file_id, checks that it holds between min_dim and
+// max_dim dimensions of floating point values, and returns its dimensions.
+static hid_t OpenDataset(hid_t file_id, const string& filename,
+    const char* dataset_name, const int min_dim, const int max_dim,
+    vector<hsize_t>* dims) {
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open dataset " << dataset_name
+      << " of " << filename;
+  hid_t type_id = H5Dget_type(dataset_id);
+  CHECK_EQ(H5Tget_class(type_id), H5T_FLOAT) << "Expected float or double "
+      << "data in dataset " << dataset_name << " of " << filename;
+  H5Tclose(type_id);
+  hid_t space_id = H5Dget_space(dataset_id);
+  const int ndims = H5Sget_simple_extent_ndims(space_id);
+  CHECK_GE(ndims, min_dim);
+  CHECK_LE(ndims, max_dim);
+  dims->resize(ndims);
+  H5Sget_simple_extent_dims(space_id, dims->data(), NULL);
+  H5Sclose(space_id);
+  return dataset_id;
+}
+
+// Reads rows [row, row + num_rows) of dataset_id into buffer.
+template <typename Dtype>
+static void ReadRows(hid_t dataset_id, const hsize_t row,
+    const hsize_t num_rows, Dtype* buffer) {
+  hid_t file_space = H5Dget_space(dataset_id);
+  const int ndims = H5Sget_simple_extent_ndims(file_space);
+  vector<hsize_t> start(ndims, 0);
+  vector<hsize_t> count(ndims);
+  H5Sget_simple_extent_dims(file_space, count.data(), NULL);
+  start[0] = row;
+  count[0] = num_rows;
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      start.data(), NULL, count.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows " << row << " to "
+      << row + num_rows;
+  hid_t mem_space = H5Screate_simple(ndims, count.data(), NULL);
+  status = H5Dread(dataset_id, hdf5_native_type<Dtype>(), mem_space,
+      file_space, H5P_DEFAULT, buffer);
+  CHECK_GE(status, 0) << "Failed to read rows " << row << " to "
+      << row + num_rows;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+}
+
+static int RowSize(const vector<hsize_t>& dims) {
+  int row_size = 1;
+  for (int i = 0; i < dims.size(); ++i) {
+    row_size *= dims[i];
+  }
+  return row_size;
+}
+
+template <typename Dtype>
+HDF5Reader<Dtype>::HDF5Reader(const vector<string>& filenames,
+    const int chunk_size, const int queue_size, const bool shuffle)
+    : filenames_(filenames), chunk_size_(chunk_size), shuffle_(shuffle),
+      file_pos_(0), file_(-1), file_id_(-1), data_id_(-1), label_id_(-1),
+      rows_(0), chunk_pos_(0) {
+  CHECK(!filenames_.empty()) << "No HDF5 file to read";
+  CHECK_GT(chunk_size_, 0) << "chunk_size must be positive";
+  CHECK_GT(queue_size, 0);
+  file_order_.resize(filenames_.size());
+  for (int i = 0; i < file_order_.size(); ++i) {
+    file_order_[i] = i;
+  }
+  if (shuffle_) {
+    const unsigned int shuffle_rng_seed = caffe_rng_rand();
+    shuffle_rng_.reset(new Caffe::RNG(shuffle_rng_seed));
+    caffe::rng_t* shuffle_rng =
+        static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+    caffe::shuffle(file_order_.begin(), file_order_.end(), shuffle_rng);
+  }
+  OpenFile(file_order_[0]);
+  data_row_size_ = RowSize(data_dims_);
+  label_row_size_ = RowSize(label_dims_);
+  chunks_.resize(queue_size);
+  for (int i = 0; i < queue_size; ++i) {
+    chunks_[i].reset(new HDF5Chunk<Dtype>());
+    chunks_[i]->data_.resize(chunk_size_ * data_row_size_);
+    chunks_[i]->label_.resize(chunk_size_ * label_row_size_);
+    chunks_[i]->rows_ = 0;
+    free_.push(chunks_[i].get());
+  }
+  CHECK(StartInternalThread()) << "Thread execution failed";
+}
+
+template <typename Dtype>
+HDF5Reader<Dtype>::~HDF5Reader() {
+  CHECK(StopInternalThread()) << "Thread joining failed";
+  CloseFile();
+}
+
+template <typename Dtype>
+void HDF5Reader<Dtype>::OpenFile(const int file) {
+  HDF5Lock lock;
+  CloseFile();
+  const string& filename = filenames_[file];
+  DLOG(INFO) << "Opening HDF5 file " << filename;
+  file_id_ = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  CHECK_GE(file_id_, 0) << "Failed opening HDF5 file " << filename;
+  vector<hsize_t> data_dims;
+  vector<hsize_t> label_dims;
+  data_id_ = OpenDataset(file_id_, filename, HDF5_DATA_DATASET_NAME, 2, 4,
+      &data_dims);
+  label_id_ = OpenDataset(file_id_, filename, HDF5_DATA_LABEL_NAME, 1, 2,
+      &label_dims);
+  CHECK_EQ(data_dims[0], label_dims[0])
+      << "data and label row counts differ in " << filename;
+  rows_ = data_dims[0];
+  chunk_rows_.clear();
+  for (hsize_t row = 0; row < rows_; row += chunk_size_) {
+    chunk_rows_.push_back(row);
+  }
+  if (shuffle_) {
+    caffe::rng_t* shuffle_rng =
+        static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+    shuffle(chunk_rows_.begin(), chunk_rows_.end(), shuffle_rng);
+  }
+  chunk_pos_ = 0;
+  data_dims.erase(data_dims.begin());
+  label_dims.erase(label_dims.begin());
+  if (file_ < 0) {
+    data_dims_ = data_dims;
+    label_dims_ = label_dims;
+  } else {
+    CHECK(data_dims == data_dims_ && label_dims == label_dims_)
+        << "The rows of " << filename << " differ in shape from the ones of "
+        << "the other files";
+  }
+  file_ = file;
+}
+
+template <typename Dtype>
+void HDF5Reader<Dtype>::CloseFile() {
+  if (file_id_ < 0) {
+    return;
+  }
+  HDF5Lock lock;
+  H5Dclose(data_id_);
+  H5Dclose(label_id_);
+  herr_t status = H5Fclose(file_id_);
+  CHECK_GE(status, 0) << "Failed to close HDF5 file " << filenames_[file_];
+  file_id_ = data_id_ = label_id_ = -1;
+}
+
+template <typename Dtype>
+void HDF5Reader<Dtype>::ReadChunk(HDF5Chunk<Dtype>* chunk) {
+  for (int skipped = 0; chunk_pos_ == chunk_rows_.size(); ++skipped) {
+    // We have reached the end of the file. Go on with the next one.
+    CHECK_LT(skipped, filenames_.size()) << "All the HDF5 files are empty";
+    if (++file_pos_ == file_order_.size()) {
+      DLOG(INFO) << "Looping around to the first HDF5 file";
+      file_pos_ = 0;
+      if (shuffle_) {
+        caffe::rng_t* shuffle_rng =
+            static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+        shuffle(file_order_.begin(), file_order_.end(), shuffle_rng);
+      }
+    }
+    OpenFile(file_order_[file_pos_]);
+  }
+  const hsize_t row = chunk_rows_[chunk_pos_++];
+  chunk->rows_ = std::min<hsize_t>(chunk_size_, rows_ - row);
+  HDF5Lock lock;
+  ReadRows(data_id_, row, chunk->rows_, chunk->data_.data());
+  ReadRows(label_id_, row, chunk->rows_, chunk->label_.data());
+}
+
+template <typename Dtype>
+void HDF5Reader<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      HDF5Chunk<Dtype>* chunk = free_.pop();
+      ReadChunk(chunk);
+      full_.push(chunk);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted while waiting for a free chunk; exit cleanly.
+  }
+}
+
+INSTANTIATE_CLASS(HDF5Reader);
+
+}  // namespace caffe
@@ -36,4 +36,19 @@ bool InternalThread::WaitForInternalThreadToExit() {
   return true;
 }
 
+bool InternalThread::StopInternalThread() {
+  if (is_started()) {
+    try {
+      thread_->interrupt();
+    } catch (...) {
+      return false;
+    }
+  }
+  return WaitForInternalThreadToExit();
+}
+
+bool InternalThread::must_stop() {
+  return boost::this_thread::interruption_requested();
+}
+
 }  // namespace caffe
@@ -235,6 +235,8 @@ Layer<Dtype>* GetLayer(const LayerParameter& param) {
     return new PowerLayer<Dtype>(param);
   case LayerParameter_LayerType_RELU:
     return GetReLULayer<Dtype>(name, param);
+  case LayerParameter_LayerType_SEGMENT_REDUCTION:
+    return new SegmentReductionLayer<Dtype>(param);
   case LayerParameter_LayerType_SEMI_LOSS:
     return new SemiLossLayer<Dtype>(param);
   case LayerParameter_LayerType_SILENCE:
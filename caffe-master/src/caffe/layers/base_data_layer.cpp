@@ -1,3 +1,6 @@
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -31,6 +34,9 @@ void BaseDataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GE(datum_width_, transform_param_.crop_size());
   }
   // check if we want to have mean
+  CHECK(!(transform_param_.has_mean_file() &&
+          transform_param_.mean_value_size())) <<
+      "Cannot specify mean_file and mean_value at the same time";
   if (transform_param_.has_mean_file()) {
     const string& mean_file = transform_param_.mean_file();
     LOG(INFO) << "Loading mean file from" << mean_file;
@@ -45,21 +51,37 @@ void BaseDataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     // Simply initialize an all-empty mean.
     data_mean_.Reshape(1, datum_channels_, datum_height_, datum_width_);
   }
-  mean_ = data_mean_.cpu_data();
+  // Without a mean file, there is no mean image to stream through.
+  mean_ = transform_param_.has_mean_file() ? data_mean_.cpu_data() : NULL;
   data_transformer_.InitRand();
 }
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  // Setting the layer up again starts over with a new prefetch thread.
+  JoinPrefetchThread();
+  Batch<Dtype>* stale;
+  while (prefetch_free_.try_pop(&stale)) {}
+  while (prefetch_full_.try_pop(&stale)) {}
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
-  // Now, start the prefetch thread. Before calling prefetch, we make two
-  // cpu_data calls so that the prefetch thread does not accidentally make
-  // simultaneous cudaMalloc calls when the main thread is running. In some
-  // GPUs this seems to cause failures if we do not so.
-  this->prefetch_data_.mutable_cpu_data();
-  if (this->output_labels_) {
-    this->prefetch_label_.mutable_cpu_data();
+  // Allocate the prefetch batches in the shape DataLayerSetUp gave the tops.
+  // Before starting the prefetch thread, we make cpu_data calls so that the
+  // prefetch thread does not accidentally make simultaneous cudaMalloc calls
+  // when the main thread is running. In some GPUs this seems to cause
+  // failures if we do not so.
+  const int prefetch_count = PrefetchCount();
+  CHECK_GT(prefetch_count, 0) << "prefetch must be positive";
+  prefetch_.resize(prefetch_count);
+  for (int i = 0; i < prefetch_count; ++i) {
+    prefetch_[i].reset(new Batch<Dtype>());
+    prefetch_[i]->data_.ReshapeLike(*(*top)[0]);
+    prefetch_[i]->data_.mutable_cpu_data();
+    if (this->output_labels_) {
+      prefetch_[i]->label_.ReshapeLike(*(*top)[1]);
+      prefetch_[i]->label_.mutable_cpu_data();
+    }
+    prefetch_free_.push(prefetch_[i].get());
   }
   DLOG(INFO) << "Initializing prefetch";
   this->CreatePrefetchThread();
@@ -70,28 +92,130 @@ template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::CreatePrefetchThread() {
   this->phase_ = Caffe::phase();
   this->data_transformer_.InitRand();
+  // Seed each worker's RNG from the Caffe RNG, so runs stay reproducible.
+  for (int i = 0; i < worker_transformers_.size(); ++i) {
+    worker_transformers_[i]->InitRand();
+  }
+  stage_times_.clear();
+  batches_loaded_ = 0;
+  ResetPrefetchTimes();
   CHECK(StartInternalThread()) << "Thread execution failed";
 }
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::JoinPrefetchThread() {
-  CHECK(WaitForInternalThreadToExit()) << "Thread joining failed";
+  CHECK(StopInternalThread()) << "Thread joining failed";
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::SetUpWorkers(const int num_workers) {
+  CHECK_GT(num_workers, 0) << "workers must be positive";
+  transformers_.clear();
+  transformers_.push_back(&this->data_transformer_);
+  worker_transformers_.clear();
+  for (int i = 1; i < num_workers; ++i) {
+    worker_transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+        new DataTransformer<Dtype>(this->transform_param_)));
+    transformers_.push_back(worker_transformers_.back().get());
+  }
+  if (num_workers > 1) {
+    LOG(INFO) << "Transforming data with " << num_workers << " workers";
+    workers_.reset(new WorkerPool(num_workers));
+  } else {
+    workers_.reset();
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::RunTask(ParallelTask* task) {
+  if (workers_) {
+    workers_->Run(task);
+  } else {
+    task->Run(0, 1);
+  }
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::EndStage(const string& stage) {
+  stage_times_[stage] += stage_timer_.MilliSeconds();
+  stage_timer_.Start();
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::EndStages(
+    const map<string, double>& weights) {
+  const double time = stage_timer_.MilliSeconds();
+  double total_weight = 0;
+  for (map<string, double>::const_iterator it = weights.begin();
+       it != weights.end(); ++it) {
+    total_weight += it->second;
+  }
+  for (map<string, double>::const_iterator it = weights.begin();
+       it != weights.end(); ++it) {
+    stage_times_[it->first] += total_weight > 0 ?
+        time * it->second / total_weight : time / weights.size();
+  }
+  stage_timer_.Start();
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      const boost::posix_time::ptime idle_begin =
+          boost::posix_time::microsec_clock::local_time();
+      Batch<Dtype>* batch = prefetch_free_.pop();
+      // The idle time travels with the batch, so that it is only ever
+      // accumulated by the thread calling Forward.
+      batch->idle_begin_ = idle_begin;
+      batch->idle_end_ = boost::posix_time::microsec_clock::local_time();
+      stage_timer_.Start();
+      LoadBatch(batch);
+      stage_timer_.Stop();
+      ++batches_loaded_;
+      prefetch_full_.push(batch);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted while waiting for a free batch; exit cleanly.
+  }
+}
+
+template <typename Dtype>
+Batch<Dtype>* BasePrefetchingDataLayer<Dtype>::PopFullBatch() {
+  wait_timer_.Start();
+  Batch<Dtype>* batch = prefetch_full_.pop("Data layer prefetch queue empty");
+  forward_wait_time_ += wait_timer_.MilliSeconds();
+  // Only count the idle time since the prefetch times were reset.
+  const boost::posix_time::ptime idle_begin =
+      std::max(batch->idle_begin_, prefetch_times_reset_);
+  if (batch->idle_end_ > idle_begin) {
+    prefetch_idle_time_ +=
+        (batch->idle_end_ - idle_begin).total_microseconds() / 1000.;
+  }
+  return batch;
+}
+
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::ResetPrefetchTimes() {
+  forward_wait_time_ = 0;
+  prefetch_idle_time_ = 0;
+  prefetch_times_reset_ = boost::posix_time::microsec_clock::local_time();
 }
 
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
     const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
-  // First, join the thread
-  JoinPrefetchThread();
-  // Copy the data
-  caffe_copy(prefetch_data_.count(), prefetch_data_.cpu_data(),
-             (*top)[0]->mutable_cpu_data());
+  // Take the next filled batch, waiting for the prefetch thread if needed.
+  Batch<Dtype>* batch = PopFullBatch();
+  OnForward(*batch);
+  // Swap the prefetched buffers into the tops instead of copying them; the
+  // batch takes over the previous top buffers and is refilled in place.
+  (*top)[0]->SwapData(&batch->data_);
   if (this->output_labels_) {
-    caffe_copy(prefetch_label_.count(), prefetch_label_.cpu_data(),
-               (*top)[1]->mutable_cpu_data());
+    (*top)[1]->SwapData(&batch->label_);
   }
-  // Start a new prefetch thread
-  CreatePrefetchThread();
+  // Hand the batch back to the prefetch thread for refilling.
+  prefetch_free_.push(batch);
 }
 
 #ifdef CPU_ONLY
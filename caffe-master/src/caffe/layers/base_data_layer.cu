@@ -7,17 +7,18 @@ namespace caffe {
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
     const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
-  // First, join the thread
-  JoinPrefetchThread();
+  // Take the next filled batch, waiting for the prefetch thread if needed.
+  Batch<Dtype>* batch = PopFullBatch();
+  OnForward(*batch);
   // Copy the data
-  caffe_copy(prefetch_data_.count(), prefetch_data_.cpu_data(),
+  caffe_copy(batch->data_.count(), batch->data_.cpu_data(),
       (*top)[0]->mutable_gpu_data());
   if (this->output_labels_) {
-    caffe_copy(prefetch_label_.count(), prefetch_label_.cpu_data(),
+    caffe_copy(batch->label_.count(), batch->label_.cpu_data(),
         (*top)[1]->mutable_gpu_data());
   }
-  // Start a new prefetch thread
-  CreatePrefetchThread();
+  // Hand the batch back to the prefetch thread for refilling.
+  prefetch_free_.push(batch);
 }
 
 INSTANTIATE_CLASS(BasePrefetchingDataLayer);
@@ -1,6 +1,11 @@
-#include <leveldb/db.h>
+#include <glob.h>
 #include <stdint.h>
 
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+#include <algorithm>
+#include <map>
+#include <numeric>
 #include <string>
 #include <vector>
 
@@ -8,199 +13,565 @@
 #include "caffe/data_layers.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/hard_negative_cache.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
 
+// Parses, decodes if needed, and transforms the slice of a batch that belongs
+// to each worker, timing the parsing and decoding apart from the transform.
+template <typename Dtype>
+class DataLayerTransformTask : public ParallelTask {
+ public:
+  DataLayerTransformTask(const DataLayer<Dtype>& layer,
+      const vector<pair<const char*, int> >& records,
+      const vector<DataTransformer<Dtype>*>& transformers, const Dtype* mean,
+      Dtype* top_data, Dtype* top_label)
+      : layer_(layer), records_(records), transformers_(transformers),
+        mean_(mean), top_data_(top_data), top_label_(top_label),
+        decode_times_(transformers.size(), 0),
+        transform_times_(transformers.size(), 0) {}
+
+  virtual void Run(const int worker_id, const int num_workers) {
+    const int batch_size = records_.size();
+    const int begin = batch_size * worker_id / num_workers;
+    const int end = batch_size * (worker_id + 1) / num_workers;
+    DataTransformer<Dtype>* transformer = transformers_[worker_id];
+    Datum datum;
+    CPUTimer timer;
+    for (int item_id = begin; item_id < end; ++item_id) {
+      timer.Start();
+      // The pixels are read straight from the record, not copied to datum.
+      const char* data;
+      int data_size;
+      CHECK(ParseDatumSkippingData(records_[item_id].first,
+          records_[item_id].second, &datum, &data, &data_size))
+          << "Could not parse datum " << item_id;
+      if (datum.encoded()) {
+        datum.set_data(data, data_size);
+        CHECK(DecodeDatum(&datum)) << "Could not decode datum " << item_id;
+        // Unlike raw ones, encoded images are not checked at conversion.
+        CHECK(datum.channels() == layer_.datum_channels() &&
+              datum.height() == layer_.datum_height() &&
+              datum.width() == layer_.datum_width())
+            << "All the encoded images must have the same size, "
+            << "use convert_imageset --resize_height and --resize_width";
+        data = datum.data().data();
+        data_size = datum.data().size();
+      }
+      decode_times_[worker_id] += timer.MilliSeconds();
+      timer.Start();
+      // Apply data transformations (mirror, scale, crop...)
+      transformer->Transform(item_id, datum, data, data_size, mean_,
+          top_data_);
+      if (top_label_) {
+        top_label_[item_id] = datum.label();
+      }
+      transform_times_[worker_id] += timer.MilliSeconds();
+    }
+  }
+
+  // The milliseconds the workers spent parsing and decoding, and
+  // transforming, summed over the workers.
+  double decode_time() const {
+    return std::accumulate(decode_times_.begin(), decode_times_.end(), 0.);
+  }
+  double transform_time() const {
+    return std::accumulate(transform_times_.begin(), transform_times_.end(),
+        0.);
+  }
+
+ protected:
+  const DataLayer<Dtype>& layer_;
+  const vector<pair<const char*, int> >& records_;
+  const vector<DataTransformer<Dtype>*>& transformers_;
+  const Dtype* mean_;
+  Dtype* top_data_;
+  Dtype* top_label_;
+  // The time of each worker, which only writes its own.
+  vector<double> decode_times_;
+  vector<double> transform_times_;
+};
+
+// Transforms the slice of a batch that belongs to each worker, from the
+// records of a dataset held in memory.
+template <typename Dtype>
+class DataLayerArenaTask : public ParallelTask {
+ public:
+  DataLayerArenaTask(const DataArena& arena, const vector<int>& indices,
+      const vector<DataTransformer<Dtype>*>& transformers, const Dtype* mean,
+      Dtype* top_data, Dtype* top_label)
+      : arena_(arena), indices_(indices), transformers_(transformers),
+        mean_(mean), top_data_(top_data), top_label_(top_label) {}
+
+  virtual void Run(const int worker_id, const int num_workers) {
+    const int batch_size = indices_.size();
+    const int begin = batch_size * worker_id / num_workers;
+    const int end = batch_size * (worker_id + 1) / num_workers;
+    DataTransformer<Dtype>* transformer = transformers_[worker_id];
+    for (int item_id = begin; item_id < end; ++item_id) {
+      const int index = indices_[item_id];
+      transformer->Transform(item_id, arena_.datum_, arena_.data(index),
+          arena_.datum_size_, mean_, top_data_);
+      if (top_label_) {
+        top_label_[item_id] = arena_.labels_[index];
+      }
+    }
+  }
+
+ protected:
+  const DataArena& arena_;
+  const vector<int>& indices_;
+  const vector<DataTransformer<Dtype>*>& transformers_;
+  const Dtype* mean_;
+  Dtype* top_data_;
+  Dtype* top_label_;
+};
+
+// Transforms the slice of a batch that belongs to each worker, from the
+// records of mapped RAW files, given as (file, index) pairs.
+template <typename Dtype>
+class DataLayerRawTask : public ParallelTask {
+ public:
+  DataLayerRawTask(const vector<shared_ptr<RawFile> >& files,
+      const vector<pair<int, int> >& records,
+      const vector<DataTransformer<Dtype>*>& transformers, const Dtype* mean,
+      Dtype* top_data, Dtype* top_label)
+      : files_(files), records_(records), transformers_(transformers),
+        mean_(mean), top_data_(top_data), top_label_(top_label) {}
+
+  virtual void Run(const int worker_id, const int num_workers) {
+    const int batch_size = records_.size();
+    const int begin = batch_size * worker_id / num_workers;
+    const int end = batch_size * (worker_id + 1) / num_workers;
+    DataTransformer<Dtype>* transformer = transformers_[worker_id];
+    for (int item_id = begin; item_id < end; ++item_id) {
+      const RawFile& file = *files_[records_[item_id].first];
+      const int index = records_[item_id].second;
+      if (file.float_data()) {
+        transformer->Transform(item_id, file.datum(),
+            reinterpret_cast<const float*>(file.record(index)), mean_,
+            top_data_);
+      } else {
+        transformer->Transform(item_id, file.datum(), file.record(index),
+            file.record_size(), mean_, top_data_);
+      }
+      if (top_label_) {
+        top_label_[item_id] = file.label(index);
+      }
+    }
+  }
+
+ protected:
+  const vector<shared_ptr<RawFile> >& files_;
+  const vector<pair<int, int> >& records_;
+  const vector<DataTransformer<Dtype>*>& transformers_;
+  const Dtype* mean_;
+  Dtype* top_data_;
+  Dtype* top_label_;
+};
+
 template <typename Dtype>
 DataLayer<Dtype>::~DataLayer<Dtype>() {
   this->JoinPrefetchThread();
-  // clean up the database resources
-  switch (this->layer_param_.data_param().backend()) {
-  case DataParameter_DB_LEVELDB:
-    break;  // do nothing
-  case DataParameter_DB_LMDB:
-    mdb_cursor_close(mdb_cursor_);
-    mdb_close(mdb_env_, mdb_dbi_);
-    mdb_txn_abort(mdb_txn_);
-    mdb_env_close(mdb_env_);
-    break;
-  default:
-    LOG(FATAL) << "Unknown database backend";
+}
+
+// Expands the glob patterns among the data sources.
+static vector<string> ExpandSources(const DataParameter& param) {
+  vector<string> patterns;
+  if (param.has_source()) {
+    patterns.push_back(param.source());
+  }
+  for (int i = 0; i < param.shard_size(); ++i) {
+    patterns.push_back(param.shard(i));
+  }
+  vector<string> sources;
+  for (int i = 0; i < patterns.size(); ++i) {
+    glob_t matches;
+    // Without a match, the pattern itself is returned and fails to open.
+    CHECK_EQ(glob(patterns[i].c_str(), GLOB_NOCHECK, NULL, &matches), 0)
+        << "Failed to expand source " << patterns[i];
+    for (int j = 0; j < matches.gl_pathc; ++j) {
+      sources.push_back(matches.gl_pathv[j]);
+    }
+    globfree(&matches);
   }
+  return sources;
 }
 
 template <typename Dtype>
 void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
-  // Initialize DB
-  switch (this->layer_param_.data_param().backend()) {
-  case DataParameter_DB_LEVELDB:
-    {
-    leveldb::DB* db_temp;
-    leveldb::Options options = GetLevelDBOptions();
-    options.create_if_missing = false;
-    LOG(INFO) << "Opening leveldb " << this->layer_param_.data_param().source();
-    leveldb::Status status = leveldb::DB::Open(
-        options, this->layer_param_.data_param().source(), &db_temp);
-    CHECK(status.ok()) << "Failed to open leveldb "
-                       << this->layer_param_.data_param().source() << std::endl
-                       << status.ToString();
-    db_.reset(db_temp);
-    iter_.reset(db_->NewIterator(leveldb::ReadOptions()));
-    iter_->SeekToFirst();
-    }
-    break;
-  case DataParameter_DB_LMDB:
-    CHECK_EQ(mdb_env_create(&mdb_env_), MDB_SUCCESS) << "mdb_env_create failed";
-    CHECK_EQ(mdb_env_set_mapsize(mdb_env_, 1099511627776), MDB_SUCCESS);  // 1TB
-    CHECK_EQ(mdb_env_open(mdb_env_,
-             this->layer_param_.data_param().source().c_str(),
-             MDB_RDONLY|MDB_NOTLS, 0664), MDB_SUCCESS) << "mdb_env_open failed";
-    CHECK_EQ(mdb_txn_begin(mdb_env_, NULL, MDB_RDONLY, &mdb_txn_), MDB_SUCCESS)
-        << "mdb_txn_begin failed";
-    CHECK_EQ(mdb_open(mdb_txn_, NULL, 0, &mdb_dbi_), MDB_SUCCESS)
-        << "mdb_open failed";
-    CHECK_EQ(mdb_cursor_open(mdb_txn_, mdb_dbi_, &mdb_cursor_), MDB_SUCCESS)
-        << "mdb_cursor_open failed";
-    LOG(INFO) << "Opening lmdb " << this->layer_param_.data_param().source();
-    CHECK_EQ(mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_, MDB_FIRST),
-        MDB_SUCCESS) << "mdb_cursor_get failed";
-    break;
-  default:
-    LOG(FATAL) << "Unknown database backend";
-  }
-
-  // Check if we would need to randomly skip a few data points
-  if (this->layer_param_.data_param().rand_skip()) {
-    unsigned int skip = caffe_rng_rand() %
-                        this->layer_param_.data_param().rand_skip();
-    LOG(INFO) << "Skipping first " << skip << " data points.";
-    while (skip-- > 0) {
-      switch (this->layer_param_.data_param().backend()) {
-      case DataParameter_DB_LEVELDB:
-        iter_->Next();
-        if (!iter_->Valid()) {
-          iter_->SeekToFirst();
-        }
-        break;
-      case DataParameter_DB_LMDB:
-        if (mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_, MDB_NEXT)
-            != MDB_SUCCESS) {
-          CHECK_EQ(mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_,
-                   MDB_FIRST), MDB_SUCCESS);
-        }
-        break;
-      default:
-        LOG(FATAL) << "Unknown database backend";
-      }
+  const DataParameter& data_param = this->layer_param_.data_param();
+  const int batch_size = data_param.batch_size();
+  const vector<string> sources = ExpandSources(data_param);
+  CHECK(!sources.empty()) << "Specify a source";
+  if (data_param.has_bag_sampling()) {
+    CHECK_EQ(sources.size(), 1) << "Bag sampling reads a single source";
+    CHECK(data_param.backend() != DataParameter_DB_RAW &&
+          !data_param.in_memory())
+        << "Bag sampling reads a LEVELDB or LMDB source, not in memory";
+  }
+  readers_.clear();
+  arena_.reset();
+  raw_files_.clear();
+  if (data_param.backend() == DataParameter_DB_RAW) {
+    LOG_IF(INFO, data_param.in_memory()) << "RAW files are mapped in memory, "
+        << "in_memory is ignored";
+    OpenRawFiles(sources);
+  } else if (data_param.in_memory()) {
+    LoadArena(sources);
+  }
+  // Otherwise initialize a reader per shard, each skipping a few data points
+  // if asked.
+  for (int i = 0; !arena_ && raw_files_.empty() && i < sources.size(); ++i) {
+    unsigned int skip = 0;
+    if (data_param.rand_skip()) {
+      skip = caffe_rng_rand() % data_param.rand_skip();
     }
+    readers_.push_back(shared_ptr<DataReader>(new DataReader(
+        data_param, sources[i], 2 * batch_size, skip)));
+  }
+  if (readers_.size() > 1) {
+    LOG(INFO) << "Reading " << readers_.size() << " shards in "
+        << DataParameter_ShardOrder_Name(data_param.shard_order())
+        << " order";
   }
+  next_shard_ = 0;
+  if (data_param.shard_order() == DataParameter_ShardOrder_RANDOM) {
+    const unsigned int shard_rng_seed = caffe_rng_rand();
+    shard_rng_.reset(new Caffe::RNG(shard_rng_seed));
+  } else {
+    shard_rng_.reset();
+  }
+
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
-  switch (this->layer_param_.data_param().backend()) {
-  case DataParameter_DB_LEVELDB:
-    datum.ParseFromString(iter_->value().ToString());
-    break;
-  case DataParameter_DB_LMDB:
-    datum.ParseFromArray(mdb_value_.mv_data, mdb_value_.mv_size);
-    break;
-  default:
-    LOG(FATAL) << "Unknown database backend";
+  if (arena_) {
+    datum = arena_->datum_;
+  } else if (!raw_files_.empty()) {
+    datum = raw_files_[0]->datum();
+  } else {
+    const DataRecord* first = readers_[0]->full().peek();
+    CHECK(datum.ParseFromArray(first->data_, first->size_))
+        << "Could not parse the first datum of " << readers_[0]->source();
+    if (datum.encoded()) {
+      LOG(INFO) << "Decoding encoded images";
+      CHECK(DecodeDatum(&datum)) << "Could not decode the first datum";
+    }
   }
 
   // image
   int crop_size = this->layer_param_.transform_param().crop_size();
   if (crop_size > 0) {
-    (*top)[0]->Reshape(this->layer_param_.data_param().batch_size(),
-                       datum.channels(), crop_size, crop_size);
-    this->prefetch_data_.Reshape(this->layer_param_.data_param().batch_size(),
-        datum.channels(), crop_size, crop_size);
+    (*top)[0]->Reshape(batch_size, datum.channels(), crop_size, crop_size);
   } else {
-    (*top)[0]->Reshape(
-        this->layer_param_.data_param().batch_size(), datum.channels(),
-        datum.height(), datum.width());
-    this->prefetch_data_.Reshape(this->layer_param_.data_param().batch_size(),
-        datum.channels(), datum.height(), datum.width());
+    (*top)[0]->Reshape(batch_size, datum.channels(), datum.height(),
+        datum.width());
   }
   LOG(INFO) << "output data size: " << (*top)[0]->num() << ","
       << (*top)[0]->channels() << "," << (*top)[0]->height() << ","
       << (*top)[0]->width();
   // label
   if (this->output_labels_) {
-    (*top)[1]->Reshape(this->layer_param_.data_param().batch_size(), 1, 1, 1);
-    this->prefetch_label_.Reshape(this->layer_param_.data_param().batch_size(),
-        1, 1, 1);
+    (*top)[1]->Reshape(batch_size, 1, 1, 1);
   }
   // datum size
   this->datum_channels_ = datum.channels();
   this->datum_height_ = datum.height();
   this->datum_width_ = datum.width();
   this->datum_size_ = datum.channels() * datum.height() * datum.width();
+  // workers
+  this->SetUpWorkers(data_param.workers());
+  // hard negatives
+  if (data_param.has_hard_negatives()) {
+    const HardNegativeParameter& hard_param = data_param.hard_negatives();
+    CHECK(this->output_labels_) << "Replaying hard negatives needs labels";
+    CHECK_GE(hard_param.replay_ratio(), 0);
+    CHECK_LE(hard_param.replay_ratio(), 1);
+    hard_negatives_ = HardNegativeCache<Dtype>::Get(hard_param.cache(),
+        hard_param.capacity(), (*top)[0]->count() / batch_size);
+  } else {
+    hard_negatives_.reset();
+  }
 }
 
-// This function is used to create a thread that prefetches the data.
+// The datasets held in memory, by backend and sources, so that each one is
+// loaded once per process.
+static boost::mutex arenas_mutex;
+static std::map<string, boost::weak_ptr<DataArena> > arenas;
+
 template <typename Dtype>
-void DataLayer<Dtype>::InternalThreadEntry() {
-  Datum datum;
-  CHECK(this->prefetch_data_.count());
-  Dtype* top_data = this->prefetch_data_.mutable_cpu_data();
+void DataLayer<Dtype>::LoadArena(const vector<string>& sources) {
+  const DataParameter& data_param = this->layer_param_.data_param();
+  string key = DataParameter_DB_Name(data_param.backend());
+  for (int i = 0; i < sources.size(); ++i) {
+    key += "\n" + sources[i];
+  }
+  boost::mutex::scoped_lock lock(arenas_mutex);
+  arena_ = arenas[key].lock();
+  if (arena_) {
+    LOG(INFO) << "Sharing the " << arena_->size()
+        << " datums already loaded in memory from " << sources[0];
+  } else {
+    arena_.reset(new DataArena());
+    arena_->datum_size_ = 0;
+    Datum datum;
+    for (int i = 0; i < sources.size(); ++i) {
+      shared_ptr<db::DB> db(db::GetDB(data_param.backend()));
+      db->Open(sources[i]);
+      shared_ptr<db::Cursor> cursor(db->NewCursor());
+      for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+        CHECK(datum.ParseFromArray(cursor->value_data(),
+            cursor->value_size())) << "Could not parse datum "
+            << arena_->size() << " of " << sources[i];
+        if (datum.encoded()) {
+          CHECK(DecodeDatum(&datum)) << "Could not decode datum "
+              << arena_->size() << " of " << sources[i];
+        }
+        if (arena_->size() == 0) {
+          arena_->datum_.set_channels(datum.channels());
+          arena_->datum_.set_height(datum.height());
+          arena_->datum_.set_width(datum.width());
+          arena_->datum_size_ =
+              datum.channels() * datum.height() * datum.width();
+        }
+        CHECK(datum.channels() == arena_->datum_.channels() &&
+              datum.height() == arena_->datum_.height() &&
+              datum.width() == arena_->datum_.width())
+            << "All the datums held in memory must have the same size";
+        CHECK_EQ(datum.data().size(), arena_->datum_size_)
+            << "in_memory only holds datums of uint8 pixels";
+        arena_->data_.insert(arena_->data_.end(), datum.data().begin(),
+            datum.data().end());
+        arena_->labels_.push_back(datum.label());
+      }
+    }
+    CHECK_GT(arena_->size(), 0) << "No datum to load from " << sources[0];
+    LOG(INFO) << "Loaded " << arena_->size() << " datums in memory ("
+        << arena_->data_.size() / (1024 * 1024) << " MB) from "
+        << sources.size() << " source(s)";
+    arenas[key] = arena_;
+  }
+  lock.unlock();
+  // Each layer goes through the dataset in its own order.
+  InitOrder(arena_->size());
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::OpenRawFiles(const vector<string>& sources) {
+  const DataParameter& data_param = this->layer_param_.data_param();
+  raw_offsets_.clear();
+  int size = 0;
+  for (int i = 0; i < sources.size(); ++i) {
+    shared_ptr<RawFile> file(new RawFile());
+    file->Open(sources[i], data_param.shuffle());
+    if (i > 0) {
+      const RawFile& first = *raw_files_[0];
+      CHECK(file->datum().channels() == first.datum().channels() &&
+            file->datum().height() == first.datum().height() &&
+            file->datum().width() == first.datum().width() &&
+            file->float_data() == first.float_data())
+          << "The records of " << sources[i] << " differ from the ones of "
+          << sources[0];
+    }
+    raw_files_.push_back(file);
+    raw_offsets_.push_back(size);
+    size += file->size();
+  }
+  LOG(INFO) << "Mapped " << size << " records of "
+      << (raw_files_[0]->float_data() ? "float" : "uint8") << " values from "
+      << sources.size() << " RAW file(s)";
+  InitOrder(size);
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::InitOrder(const int size) {
+  const DataParameter& data_param = this->layer_param_.data_param();
+  order_.resize(size);
+  for (int i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  if (data_param.shuffle()) {
+    const unsigned int order_rng_seed = caffe_rng_rand();
+    order_rng_.reset(new Caffe::RNG(order_rng_seed));
+    caffe::rng_t* order_rng =
+        static_cast<caffe::rng_t*>(order_rng_->generator());
+    shuffle(order_.begin(), order_.end(), order_rng);
+  } else {
+    order_rng_.reset();
+  }
+  order_pos_ = 0;
+  if (data_param.rand_skip()) {
+    order_pos_ = caffe_rng_rand() % data_param.rand_skip() % size;
+  }
+}
+
+template <typename Dtype>
+int DataLayer<Dtype>::NextIndex() {
+  const int index = order_[order_pos_];
+  if (++order_pos_ == order_.size()) {
+    // A new epoch starts.
+    order_pos_ = 0;
+    if (order_rng_) {
+      caffe::rng_t* order_rng =
+          static_cast<caffe::rng_t*>(order_rng_->generator());
+      shuffle(order_.begin(), order_.end(), order_rng);
+    }
+  }
+  return index;
+}
+
+// This function is called on the prefetch thread to fill one batch.
+template <typename Dtype>
+void DataLayer<Dtype>::LoadBatch(Batch<Dtype>* batch) {
+  CHECK(batch->data_.count());
+  if (arena_) {
+    LoadArenaBatch(batch);
+  } else if (!raw_files_.empty()) {
+    LoadRawBatch(batch);
+  } else {
+    LoadDBBatch(batch);
+  }
+  if (hard_negatives_ && this->phase_ == Caffe::TRAIN) {
+    ReplayHardNegatives(batch);
+  }
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::LoadDBBatch(Batch<Dtype>* batch) {
+  Dtype* top_data = batch->data_.mutable_cpu_data();
   Dtype* top_label = NULL;  // suppress warnings about uninitialized variables
   if (this->output_labels_) {
-    top_label = this->prefetch_label_.mutable_cpu_data();
+    top_label = batch->label_.mutable_cpu_data();
   }
   const int batch_size = this->layer_param_.data_param().batch_size();
 
+  // Collect the records of the batch from the shards.
+  records_.resize(batch_size);
+  batch_records_.resize(batch_size);
+  batch_shards_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    switch (this->layer_param_.data_param().backend()) {
-    case DataParameter_DB_LEVELDB:
-      CHECK(iter_);
-      CHECK(iter_->Valid());
-      datum.ParseFromString(iter_->value().ToString());
-      break;
-    case DataParameter_DB_LMDB:
-      CHECK_EQ(mdb_cursor_get(mdb_cursor_, &mdb_key_,
-              &mdb_value_, MDB_GET_CURRENT), MDB_SUCCESS);
-      datum.ParseFromArray(mdb_value_.mv_data,
-          mdb_value_.mv_size);
-      break;
-    default:
-      LOG(FATAL) << "Unknown database backend";
-    }
+    const int shard = NextShard();
+    DataRecord* record = readers_[shard]->full().pop();
+    records_[item_id] = make_pair(record->data_, record->size_);
+    batch_records_[item_id] = record;
+    batch_shards_[item_id] = shard;
+  }
+  this->EndStage("read");
 
-    // Apply data transformations (mirror, scale, crop...)
-    this->data_transformer_.Transform(item_id, datum, this->mean_, top_data);
+  // Parse and transform the records, in parallel if there are workers.
+  DataLayerTransformTask<Dtype> task(*this, records_, this->transformers_,
+      this->mean_, top_data, top_label);
+  this->RunTask(&task);
+  // Give the records back to their readers.
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    readers_[batch_shards_[item_id]]->free().push(batch_records_[item_id]);
+  }
+  // The workers overlap, so share the time of the batch between the stages
+  // by the time they spent in each.
+  map<string, double> weights;
+  weights["parse+decode"] = task.decode_time();
+  weights["transform"] = task.transform_time();
+  this->EndStages(weights);
+}
 
-    if (this->output_labels_) {
-      top_label[item_id] = datum.label();
-    }
+template <typename Dtype>
+void DataLayer<Dtype>::LoadArenaBatch(Batch<Dtype>* batch) {
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = NULL;
+  if (this->output_labels_) {
+    top_label = batch->label_.mutable_cpu_data();
+  }
+  const int batch_size = this->layer_param_.data_param().batch_size();
+  vector<int> indices(batch_size);
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    indices[item_id] = NextIndex();
+  }
+  DataLayerArenaTask<Dtype> task(*arena_, indices, this->transformers_,
+      this->mean_, top_data, top_label);
+  this->RunTask(&task);
+  this->EndStage("transform");
+}
 
-    // go to the next iter
-    switch (this->layer_param_.data_param().backend()) {
-    case DataParameter_DB_LEVELDB:
-      iter_->Next();
-      if (!iter_->Valid()) {
-        // We have reached the end. Restart from the first.
-        DLOG(INFO) << "Restarting data prefetching from start.";
-        iter_->SeekToFirst();
-      }
-      break;
-    case DataParameter_DB_LMDB:
-      if (mdb_cursor_get(mdb_cursor_, &mdb_key_,
-              &mdb_value_, MDB_NEXT) != MDB_SUCCESS) {
-        // We have reached the end. Restart from the first.
-        DLOG(INFO) << "Restarting data prefetching from start.";
-        CHECK_EQ(mdb_cursor_get(mdb_cursor_, &mdb_key_,
-                &mdb_value_, MDB_FIRST), MDB_SUCCESS);
-      }
+// The (file, index in the file) of a record numbered across RAW files, the
+// records of file i being numbered from offsets[i].
+static pair<int, int> RawRecord(const vector<int>& offsets, const int index) {
+  const int file = std::upper_bound(offsets.begin(), offsets.end(), index)
+      - offsets.begin() - 1;
+  return make_pair(file, index - offsets[file]);
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::LoadRawBatch(Batch<Dtype>* batch) {
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = NULL;
+  if (this->output_labels_) {
+    top_label = batch->label_.mutable_cpu_data();
+  }
+  const int batch_size = this->layer_param_.data_param().batch_size();
+  vector<pair<int, int> > records(batch_size);
+  for (int item_id = 0; item_id < batch_size; ++item_id) {
+    records[item_id] = RawRecord(raw_offsets_, NextIndex());
+  }
+  // Have the kernel read the records of the next batch while this one is
+  // transformed; with shuffle, they are scattered across the files.
+  for (int i = 0; i < batch_size; ++i) {
+    const pair<int, int> record =
+        RawRecord(raw_offsets_, order_[(order_pos_ + i) % order_.size()]);
+    raw_files_[record.first]->WillNeed(record.second);
+  }
+  DataLayerRawTask<Dtype> task(raw_files_, records, this->transformers_,
+      this->mean_, top_data, top_label);
+  this->RunTask(&task);
+  this->EndStage("read+transform");
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::ReplayHardNegatives(Batch<Dtype>* batch) {
+  const Dtype* label = batch->label_.cpu_data();
+  Dtype* data = batch->data_.mutable_cpu_data();
+  const int num = batch->data_.num();
+  const int dim = batch->data_.count() / num;
+  vector<int> negatives;
+  for (int item_id = 0; item_id < num; ++item_id) {
+    if (label[item_id] == Dtype(-2)) {
+      negatives.push_back(item_id);
+    }
+  }
+  // The replayed negatives keep their label, and only their pixels change.
+  const int replays = static_cast<int>(negatives.size() *
+      this->layer_param_.data_param().hard_negatives().replay_ratio() + 0.5);
+  for (int i = 0; i < replays; ++i) {
+    if (!hard_negatives_->Pop(data + negatives[i] * dim)) {
       break;
-    default:
-      LOG(FATAL) << "Unknown database backend";
     }
   }
+  this->EndStage("replay");
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::OnForward(const Batch<Dtype>& batch) {
+  if (hard_negatives_ && Caffe::phase() == Caffe::TRAIN) {
+    hard_negatives_->Stage(batch.data_.cpu_data(), batch.label_.cpu_data(),
+        batch.data_.num());
+  }
+}
+
+template <typename Dtype>
+int DataLayer<Dtype>::NextShard() {
+  const int num_shards = readers_.size();
+  if (shard_rng_) {
+    caffe::rng_t* shard_rng =
+        static_cast<caffe::rng_t*>(shard_rng_->generator());
+    return (*shard_rng)() % num_shards;
+  }
+  const int shard = next_shard_;
+  next_shard_ = (next_shard_ + 1) % num_shards;
+  return shard;
 }
 
 INSTANTIATE_CLASS(DataLayer);
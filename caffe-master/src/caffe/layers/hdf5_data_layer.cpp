@@ -1,59 +1,31 @@
-/*
-TODO:
-- load file in a separate thread ("prefetch")
-- can be smarter about the memcpy call instead of doing it row-by-row
-  :: use util functions caffe_copy, and Blob->offset()
-  :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
-*/
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
 
-#include "hdf5.h"
-#include "hdf5_hl.h"
-#include "stdint.h"
-
+#include "caffe/data_layers.hpp"
 #include "caffe/layer.hpp"
-#include "caffe/util/io.hpp"
-#include "caffe/vision_layers.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
-template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+// The number of chunks of rows in flight besides the ones used by the layer:
+// one ready and one being read.
+static const int kHDF5ReaderChunksAhead = 2;
 
-// Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
-  LOG(INFO) << "Loading HDF5 file" << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
-  if (file_id < 0) {
-    LOG(ERROR) << "Failed opening HDF5 file" << filename;
-    return;
-  }
-
-  const int MIN_DATA_DIM = 2;
-  const int MAX_DATA_DIM = 4;
-  hdf5_load_nd_dataset(
-    file_id, "data",  MIN_DATA_DIM, MAX_DATA_DIM, &data_blob_);
-
-  const int MIN_LABEL_DIM = 1;
-  const int MAX_LABEL_DIM = 2;
-  hdf5_load_nd_dataset(
-    file_id, "label", MIN_LABEL_DIM, MAX_LABEL_DIM, &label_blob_);
-
-  herr_t status = H5Fclose(file_id);
-  CHECK_GE(status, 0) << "Failed to close HDF5 file " << filename;
-  CHECK_EQ(data_blob_.num(), label_blob_.num());
-  LOG(INFO) << "Successully loaded " << data_blob_.num() << " rows";
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->JoinPrefetchThread();
 }
 
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+void HDF5DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
+  const HDF5DataParameter& hdf5_data_param =
+      this->layer_param_.hdf5_data_param();
   // Read the source to parse the filenames.
-  const string& source = this->layer_param_.hdf5_data_param().source();
+  const string& source = hdf5_data_param.source();
   LOG(INFO) << "Loading filename from " << source;
   hdf_filenames_.clear();
   std::ifstream source_file(source.c_str());
@@ -64,55 +36,123 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }
   source_file.close();
-  num_files_ = hdf_filenames_.size();
-  current_file_ = 0;
-  LOG(INFO) << "Number of files: " << num_files_;
-
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[current_file_].c_str());
-  current_row_ = 0;
+  LOG(INFO) << "Number of files: " << hdf_filenames_.size();
+
+  // Start streaming the files.
+  chunk_ = NULL;
+  window_.clear();
+  window_rows_left_.clear();
+  window_rows_.clear();
+  int layer_chunks = 1;
+  if (hdf5_data_param.shuffle()) {
+    layer_chunks = hdf5_data_param.shuffle_window();
+    CHECK_GT(layer_chunks, 0) << "shuffle_window must be positive";
+    LOG(INFO) << "Shuffling rows within windows of " << layer_chunks
+        << " chunks of " << hdf5_data_param.chunk_size() << " rows";
+    const unsigned int shuffle_rng_seed = caffe_rng_rand();
+    shuffle_rng_.reset(new Caffe::RNG(shuffle_rng_seed));
+  } else {
+    shuffle_rng_.reset();
+  }
+  reader_.reset(new HDF5Reader<Dtype>(hdf_filenames_,
+      hdf5_data_param.chunk_size(), layer_chunks + kHDF5ReaderChunksAhead,
+      hdf5_data_param.shuffle()));
 
   // Reshape blobs.
-  const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
-  (*top)[0]->Reshape(batch_size, data_blob_.channels(),
-                     data_blob_.height(), data_blob_.width());
-  (*top)[1]->Reshape(batch_size, label_blob_.channels(),
-                     label_blob_.height(), label_blob_.width());
+  const int batch_size = hdf5_data_param.batch_size();
+  const vector<hsize_t>& data_dims = reader_->data_dims();
+  const vector<hsize_t>& label_dims = reader_->label_dims();
+  (*top)[0]->Reshape(batch_size, data_dims[0],
+      (data_dims.size() > 1) ? data_dims[1] : 1,
+      (data_dims.size() > 2) ? data_dims[2] : 1);
+  (*top)[1]->Reshape(batch_size, label_dims.size() ? label_dims[0] : 1, 1, 1);
   LOG(INFO) << "output data size: " << (*top)[0]->num() << ","
       << (*top)[0]->channels() << "," << (*top)[0]->height() << ","
       << (*top)[0]->width();
+  this->datum_channels_ = (*top)[0]->channels();
+  this->datum_height_ = (*top)[0]->height();
+  this->datum_width_ = (*top)[0]->width();
+  this->datum_size_ = reader_->data_row_size();
 }
 
+// This function is called on the prefetch thread to fill one batch.
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      vector<Blob<Dtype>*>* top) {
+void HDF5DataLayer<Dtype>::LoadBatch(Batch<Dtype>* batch) {
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = batch->label_.mutable_cpu_data();
   const int batch_size = this->layer_param_.hdf5_data_param().batch_size();
-  const int data_count = (*top)[0]->count() / (*top)[0]->num();
-  const int label_data_count = (*top)[1]->count() / (*top)[1]->num();
+  const int data_row_size = reader_->data_row_size();
+  const int label_row_size = reader_->label_row_size();
+
+  if (shuffle_rng_) {
+    if (window_.empty()) {
+      const int window_size =
+          this->layer_param_.hdf5_data_param().shuffle_window();
+      window_.resize(window_size, NULL);
+      window_rows_left_.resize(window_size, 0);
+      for (int slot = 0; slot < window_size; ++slot) {
+        FillWindow(slot);
+      }
+    }
+    caffe::rng_t* shuffle_rng =
+        static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+    for (int item_id = 0; item_id < batch_size; ++item_id) {
+      // Draw one of the rows left in the window.
+      const int i = (*shuffle_rng)() % window_rows_.size();
+      const int slot = window_rows_[i].first;
+      const int row = window_rows_[i].second;
+      window_rows_[i] = window_rows_.back();
+      window_rows_.pop_back();
+      caffe_copy(data_row_size, &window_[slot]->data_[row * data_row_size],
+          top_data + item_id * data_row_size);
+      caffe_copy(label_row_size, &window_[slot]->label_[row * label_row_size],
+          top_label + item_id * label_row_size);
+      if (--window_rows_left_[slot] == 0) {
+        FillWindow(slot);
+      }
+    }
+    this->EndStage("copy");
+    return;
+  }
 
-  for (int i = 0; i < batch_size; ++i, ++current_row_) {
-    if (current_row_ == data_blob_.num()) {
-      if (num_files_ > 1) {
-        current_file_ += 1;
-        if (current_file_ == num_files_) {
-          current_file_ = 0;
-          LOG(INFO) << "looping around to first file";
-        }
-        LoadHDF5FileData(hdf_filenames_[current_file_].c_str());
+  for (int item_id = 0; item_id < batch_size; ) {
+    if (!chunk_ || chunk_row_ == chunk_->rows_) {
+      if (chunk_) {
+        reader_->free().push(chunk_);
       }
-      current_row_ = 0;
+      this->EndStage("copy");
+      chunk_ = reader_->full().pop();
+      this->EndStage("read");
+      chunk_row_ = 0;
     }
-    caffe_copy(data_count, &data_blob_.cpu_data()[current_row_ * data_count],
-               &(*top)[0]->mutable_cpu_data()[i * data_count]);
-    caffe_copy(label_data_count,
-               &label_blob_.cpu_data()[current_row_ * label_data_count],
-               &(*top)[1]->mutable_cpu_data()[i * label_data_count]);
+    // Copy as many consecutive rows of the chunk as the batch takes at once.
+    const int rows = std::min(batch_size - item_id,
+        chunk_->rows_ - chunk_row_);
+    caffe_copy(rows * data_row_size, &chunk_->data_[chunk_row_ * data_row_size],
+        top_data + item_id * data_row_size);
+    caffe_copy(rows * label_row_size,
+        &chunk_->label_[chunk_row_ * label_row_size],
+        top_label + item_id * label_row_size);
+    item_id += rows;
+    chunk_row_ += rows;
   }
+  this->EndStage("copy");
 }
 
-#ifdef CPU_ONLY
-STUB_GPU_FORWARD(HDF5DataLayer, Forward);
-#endif
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::FillWindow(const int slot) {
+  if (window_[slot]) {
+    reader_->free().push(window_[slot]);
+  }
+  this->EndStage("copy");
+  HDF5Chunk<Dtype>* chunk = reader_->full().pop();
+  this->EndStage("read");
+  window_[slot] = chunk;
+  window_rows_left_[slot] = chunk->rows_;
+  for (int row = 0; row < chunk->rows_; ++row) {
+    window_rows_.push_back(std::make_pair(slot, row));
+  }
+}
 
 INSTANTIATE_CLASS(HDF5DataLayer);
 
@@ -1,3 +1,4 @@
+#include <boost/thread.hpp>
 #include <vector>
 
 #include "hdf5.h"
@@ -14,28 +15,141 @@ namespace caffe {
 template <typename Dtype>
 HDF5OutputLayer<Dtype>::HDF5OutputLayer(const LayerParameter& param)
     : Layer<Dtype>(param),
-      file_name_(param.hdf5_output_param().file_name()) {
+      file_name_(param.hdf5_output_param().file_name()),
+      data_id_(-1), label_id_(-1), rows_(0) {
+  const HDF5OutputParameter& hdf5_output_param = param.hdf5_output_param();
+  CHECK_GT(hdf5_output_param.queue_size(), 0) << "queue_size must be positive";
+  CHECK_GT(hdf5_output_param.chunk_size(), 0) << "chunk_size must be positive";
+  CHECK_LE(hdf5_output_param.compression(), 9)
+      << "compression must be a gzip level from 0 to 9";
   /* create a HDF5 file */
-  file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
-                       H5P_DEFAULT);
+  {
+    HDF5Lock lock;
+    file_id_ = H5Fcreate(file_name_.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+                         H5P_DEFAULT);
+  }
   CHECK_GE(file_id_, 0) << "Failed to open HDF5 file" << file_name_;
+  batches_.resize(hdf5_output_param.queue_size());
+  for (int i = 0; i < batches_.size(); ++i) {
+    batches_[i].reset(new Batch<Dtype>());
+    batch_free_.push(batches_[i].get());
+  }
+  CHECK(StartInternalThread()) << "Thread execution failed";
 }
 
 template <typename Dtype>
 HDF5OutputLayer<Dtype>::~HDF5OutputLayer<Dtype>() {
+  // Wait for the writer to be done with all the batches queued.
+  for (int i = 0; i < batches_.size(); ++i) {
+    batch_free_.pop("Waiting for the HDF5 writer to flush");
+  }
+  CHECK(StopInternalThread()) << "Thread joining failed";
+  HDF5Lock lock;
+  if (data_id_ >= 0) {
+    H5Dclose(data_id_);
+    H5Dclose(label_id_);
+  }
   herr_t status = H5Fclose(file_id_);
   CHECK_GE(status, 0) << "Failed to close HDF5 file " << file_name_;
 }
 
+// The dimensions of rows rows shaped like the ones of blob.
+template <typename Dtype>
+static void RowsDims(const Blob<Dtype>& blob, const hsize_t rows,
+    hsize_t* dims) {
+  dims[0] = rows;
+  dims[1] = blob.channels();
+  dims[2] = blob.height();
+  dims[3] = blob.width();
+}
+
+template <typename Dtype>
+hid_t HDF5OutputLayer<Dtype>::CreateDataset(const char* dataset_name,
+    const Blob<Dtype>& blob) {
+  const HDF5OutputParameter& hdf5_output_param =
+      this->layer_param_.hdf5_output_param();
+  hsize_t dims[HDF5_NUM_DIMS];
+  hsize_t max_dims[HDF5_NUM_DIMS];
+  hsize_t chunk_dims[HDF5_NUM_DIMS];
+  RowsDims(blob, 0, dims);
+  RowsDims(blob, H5S_UNLIMITED, max_dims);
+  RowsDims(blob, hdf5_output_param.chunk_size(), chunk_dims);
+  hid_t space_id = H5Screate_simple(HDF5_NUM_DIMS, dims, max_dims);
+  hid_t create_plist = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(create_plist, HDF5_NUM_DIMS, chunk_dims);
+  if (hdf5_output_param.compression() > 0) {
+    H5Pset_deflate(create_plist, hdf5_output_param.compression());
+  }
+  // Cache a couple of chunks, so that a chunk filled by several batches is
+  // compressed and written once, when full, rather than once per batch.
+  const size_t chunk_bytes = static_cast<size_t>(
+      hdf5_output_param.chunk_size()) * blob.count() / blob.num() *
+      sizeof(Dtype);
+  hid_t access_plist = H5Pcreate(H5P_DATASET_ACCESS);
+  H5Pset_chunk_cache(access_plist, H5D_CHUNK_CACHE_NSLOTS_DEFAULT,
+      2 * chunk_bytes, 1.0);
+  hid_t dataset_id = H5Dcreate2(file_id_, dataset_name,
+      hdf5_native_type<Dtype>(), space_id, H5P_DEFAULT, create_plist,
+      access_plist);
+  CHECK_GE(dataset_id, 0) << "Failed to make dataset " << dataset_name
+      << " in " << file_name_;
+  H5Pclose(access_plist);
+  H5Pclose(create_plist);
+  H5Sclose(space_id);
+  return dataset_id;
+}
+
 template <typename Dtype>
-void HDF5OutputLayer<Dtype>::SaveBlobs() {
+void HDF5OutputLayer<Dtype>::AppendRows(hid_t dataset_id,
+    const Blob<Dtype>& blob) {
+  hsize_t dims[HDF5_NUM_DIMS];
+  RowsDims(blob, rows_ + blob.num(), dims);
+  herr_t status = H5Dset_extent(dataset_id, dims);
+  CHECK_GE(status, 0) << "Failed to extend dataset to " << dims[0] << " rows";
+  hsize_t start[HDF5_NUM_DIMS] = {rows_, 0, 0, 0};
+  hsize_t count[HDF5_NUM_DIMS];
+  RowsDims(blob, blob.num(), count);
+  hid_t file_space = H5Dget_space(dataset_id);
+  H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+  hid_t mem_space = H5Screate_simple(HDF5_NUM_DIMS, count, NULL);
+  status = H5Dwrite(dataset_id, hdf5_native_type<Dtype>(), mem_space,
+      file_space, H5P_DEFAULT, blob.cpu_data());
+  CHECK_GE(status, 0) << "Failed to write rows " << rows_ << " to " << dims[0];
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+}
+
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::SaveBlobs(const Batch<Dtype>& batch) {
   // TODO: no limit on the number of blobs
-  LOG(INFO) << "Saving HDF5 file" << file_name_;
-  CHECK_EQ(data_blob_.num(), label_blob_.num()) <<
+  DLOG(INFO) << "Saving HDF5 file " << file_name_;
+  CHECK_EQ(batch.data_.num(), batch.label_.num()) <<
       "data blob and label blob must have the same batch size";
-  hdf5_save_nd_dataset(file_id_, HDF5_DATA_DATASET_NAME, data_blob_);
-  hdf5_save_nd_dataset(file_id_, HDF5_DATA_LABEL_NAME, label_blob_);
-  LOG(INFO) << "Successfully saved " << data_blob_.num() << " rows";
+  if (batch.data_.num() == 0) {
+    return;
+  }
+  HDF5Lock lock;
+  if (data_id_ < 0) {
+    data_id_ = CreateDataset(HDF5_DATA_DATASET_NAME, batch.data_);
+    label_id_ = CreateDataset(HDF5_DATA_LABEL_NAME, batch.label_);
+  }
+  AppendRows(data_id_, batch.data_);
+  AppendRows(label_id_, batch.label_);
+  rows_ += batch.data_.num();
+  DLOG(INFO) << "Successfully saved " << batch.data_.num() << " rows";
+}
+
+template <typename Dtype>
+void HDF5OutputLayer<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      Batch<Dtype>* batch = batch_full_.pop();
+      SaveBlobs(*batch);
+      batch_free_.push(batch);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted while waiting for a batch; exit cleanly.
+  }
 }
 
 template <typename Dtype>
@@ -43,20 +157,14 @@ void HDF5OutputLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
   CHECK_GE(bottom.size(), 2);
   CHECK_EQ(bottom[0]->num(), bottom[1]->num());
-  data_blob_.Reshape(bottom[0]->num(), bottom[0]->channels(),
-                     bottom[0]->height(), bottom[0]->width());
-  label_blob_.Reshape(bottom[1]->num(), bottom[1]->channels(),
-                     bottom[1]->height(), bottom[1]->width());
-  const int data_datum_dim = bottom[0]->count() / bottom[0]->num();
-  const int label_datum_dim = bottom[1]->count() / bottom[1]->num();
-
-  for (int i = 0; i < bottom[0]->num(); ++i) {
-    caffe_copy(data_datum_dim, &bottom[0]->cpu_data()[i * data_datum_dim],
-        &data_blob_.mutable_cpu_data()[i * data_datum_dim]);
-    caffe_copy(label_datum_dim, &bottom[1]->cpu_data()[i * label_datum_dim],
-        &label_blob_.mutable_cpu_data()[i * label_datum_dim]);
-  }
-  SaveBlobs();
+  Batch<Dtype>* batch = batch_free_.pop("Waiting for the HDF5 writer");
+  batch->data_.ReshapeLike(*bottom[0]);
+  batch->label_.ReshapeLike(*bottom[1]);
+  caffe_copy(bottom[0]->count(), bottom[0]->cpu_data(),
+      batch->data_.mutable_cpu_data());
+  caffe_copy(bottom[1]->count(), bottom[1]->cpu_data(),
+      batch->label_.mutable_cpu_data());
+  batch_full_.push(batch);
 }
 
 template <typename Dtype>
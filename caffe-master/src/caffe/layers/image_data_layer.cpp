@@ -1,5 +1,6 @@
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -12,6 +13,50 @@
 
 namespace caffe {
 
+// Reads and transforms the images of the slice of a batch that belongs to each
+// worker.
+template <typename Dtype>
+class ImageDataLayerTask : public ParallelTask {
+ public:
+  ImageDataLayerTask(ImageDataLayer<Dtype>* layer,
+      const vector<std::pair<std::string, int> >& lines,
+      const vector<DataTransformer<Dtype>*>& transformers, const Dtype* mean,
+      const int item_size, Dtype* top_data, Dtype* top_label)
+      : layer_(layer), lines_(lines), transformers_(transformers),
+        mean_(mean), item_size_(item_size), top_data_(top_data),
+        top_label_(top_label) {}
+
+  virtual void Run(const int worker_id, const int num_workers) {
+    const int batch_size = lines_.size();
+    const int begin = batch_size * worker_id / num_workers;
+    const int end = batch_size * (worker_id + 1) / num_workers;
+    DataTransformer<Dtype>* transformer = transformers_[worker_id];
+    for (int item_id = begin; item_id < end; ++item_id) {
+      top_label_[item_id] = lines_[item_id].second;
+      shared_ptr<const Datum> datum = layer_->ReadImage(lines_[item_id].first);
+      if (!datum) {
+        // Zero the item, like WindowDataLayer, rather than leave the image
+        // of an older batch in its place.
+        LOG(ERROR) << "Could not load " << lines_[item_id].first;
+        caffe_set(item_size_, Dtype(0), top_data_ + item_id * item_size_);
+        continue;
+      }
+      // Apply transformations (mirror, crop...) to the data
+      transformer->Transform(item_id, *datum, mean_, top_data_);
+    }
+  }
+
+ protected:
+  ImageDataLayer<Dtype>* layer_;
+  const vector<std::pair<std::string, int> >& lines_;
+  const vector<DataTransformer<Dtype>*>& transformers_;
+  const Dtype* mean_;
+  // The number of values of an item of the batch.
+  const int item_size_;
+  Dtype* top_data_;
+  Dtype* top_label_;
+};
+
 template <typename Dtype>
 ImageDataLayer<Dtype>::~ImageDataLayer<Dtype>() {
   this->JoinPrefetchThread();
@@ -53,34 +98,38 @@ void ImageDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
     CHECK_GT(lines_.size(), skip) << "Not enough points to skip";
     lines_id_ = skip;
   }
+  const int cache_size = this->layer_param_.image_data_param().cache_size();
+  if (cache_size) {
+    LOG(INFO) << "Caching up to " << cache_size << " MB of decoded images";
+    cache_.reset(new DatumCache(static_cast<size_t>(cache_size) << 20));
+  } else {
+    cache_.reset();
+  }
   // Read a data point, and use it to initialize the top blob.
-  Datum datum;
-  CHECK(ReadImageToDatum(lines_[lines_id_].first, lines_[lines_id_].second,
-                         new_height, new_width, &datum));
+  shared_ptr<const Datum> first = ReadImage(lines_[lines_id_].first);
+  CHECK(first) << "Could not read " << lines_[lines_id_].first;
+  const Datum& datum = *first;
   // image
   const int crop_size = this->layer_param_.transform_param().crop_size();
   const int batch_size = this->layer_param_.image_data_param().batch_size();
   if (crop_size > 0) {
     (*top)[0]->Reshape(batch_size, datum.channels(), crop_size, crop_size);
-    this->prefetch_data_.Reshape(batch_size, datum.channels(), crop_size,
-                                 crop_size);
   } else {
     (*top)[0]->Reshape(batch_size, datum.channels(), datum.height(),
                        datum.width());
-    this->prefetch_data_.Reshape(batch_size, datum.channels(), datum.height(),
-        datum.width());
   }
   LOG(INFO) << "output data size: " << (*top)[0]->num() << ","
       << (*top)[0]->channels() << "," << (*top)[0]->height() << ","
       << (*top)[0]->width();
   // label
   (*top)[1]->Reshape(batch_size, 1, 1, 1);
-  this->prefetch_label_.Reshape(batch_size, 1, 1, 1);
   // datum size
   this->datum_channels_ = datum.channels();
   this->datum_height_ = datum.height();
   this->datum_width_ = datum.width();
   this->datum_size_ = datum.channels() * datum.height() * datum.width();
+  // workers
+  this->SetUpWorkers(this->layer_param_.image_data_param().workers());
 }
 
 template <typename Dtype>
@@ -90,33 +139,52 @@ void ImageDataLayer<Dtype>::ShuffleImages() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
-// This function is used to create a thread that prefetches the data.
 template <typename Dtype>
-void ImageDataLayer<Dtype>::InternalThreadEntry() {
-  Datum datum;
-  CHECK(this->prefetch_data_.count());
-  Dtype* top_data = this->prefetch_data_.mutable_cpu_data();
-  Dtype* top_label = this->prefetch_label_.mutable_cpu_data();
-  ImageDataParameter image_data_param = this->layer_param_.image_data_param();
-  const int batch_size = image_data_param.batch_size();
+shared_ptr<const Datum> ImageDataLayer<Dtype>::ReadImage(
+    const string& filename) {
+  const ImageDataParameter& image_data_param =
+      this->layer_param_.image_data_param();
   const int new_height = image_data_param.new_height();
   const int new_width = image_data_param.new_width();
+  // Images are cached under their file name and the size they are resized
+  // to. The same file may be listed with several labels, so the datums have
+  // none: labels are taken from the lines.
+  string key;
+  if (cache_) {
+    std::ostringstream key_stream;
+    key_stream << filename << ":" << new_height << "x" << new_width;
+    key = key_stream.str();
+    shared_ptr<const Datum> cached = cache_->Get(key);
+    if (cached) {
+      return cached;
+    }
+  }
+  shared_ptr<Datum> datum(new Datum());
+  if (!ReadImageToDatum(filename, 0, new_height, new_width, datum.get())) {
+    return shared_ptr<const Datum>();
+  }
+  if (cache_) {
+    cache_->Put(key, datum);
+  }
+  return datum;
+}
+
+// This function is called on the prefetch thread to fill one batch.
+template <typename Dtype>
+void ImageDataLayer<Dtype>::LoadBatch(Batch<Dtype>* batch) {
+  CHECK(batch->data_.count());
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = batch->label_.mutable_cpu_data();
+  ImageDataParameter image_data_param = this->layer_param_.image_data_param();
+  const int batch_size = image_data_param.batch_size();
 
-  // datum scales
+  // Assign the next lines to the items of the batch first, so that the order
+  // does not depend on the workers.
   const int lines_size = lines_.size();
+  batch_lines_.resize(batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
     CHECK_GT(lines_size, lines_id_);
-    if (!ReadImageToDatum(lines_[lines_id_].first,
-          lines_[lines_id_].second,
-          new_height, new_width, &datum)) {
-      continue;
-    }
-
-    // Apply transformations (mirror, crop...) to the data
-    this->data_transformer_.Transform(item_id, datum, this->mean_, top_data);
-
-    top_label[item_id] = datum.label();
+    batch_lines_[item_id] = lines_[lines_id_];
     // go to the next iter
     lines_id_++;
     if (lines_id_ >= lines_size) {
@@ -126,8 +194,23 @@ void ImageDataLayer<Dtype>::InternalThreadEntry() {
       if (this->layer_param_.image_data_param().shuffle()) {
         ShuffleImages();
       }
+      if (cache_) {
+        const size_t hits = cache_->hits();
+        const size_t lookups = hits + cache_->misses();
+        LOG(INFO) << "Image cache: " << hits << " hits out of " << lookups
+            << " lookups (" << 100.0 * hits / lookups << "%), "
+            << cache_->count() << " images in "
+            << (cache_->size() >> 20) << " MB";
+      }
     }
   }
+
+  // Decode, resize and transform the images, in parallel if there are
+  // workers.
+  ImageDataLayerTask<Dtype> task(this, batch_lines_, this->transformers_,
+      this->mean_, batch->data_.count() / batch_size, top_data, top_label);
+  this->RunTask(&task);
+  this->EndStage("decode+transform");
 }
 
 INSTANTIATE_CLASS(ImageDataLayer);
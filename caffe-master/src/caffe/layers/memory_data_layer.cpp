@@ -3,6 +3,7 @@
 #include "caffe/data_layers.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -28,6 +29,20 @@ void MemoryDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   labels_ = NULL;
   added_data_.cpu_data();
   added_label_.cpu_data();
+  // Drop the batches of any earlier setup before making the ring.
+  Batch<Dtype>* batch;
+  while (ring_free_.try_pop(&batch)) {}
+  while (ring_full_.try_pop(&batch)) {}
+  current_ = NULL;
+  ring_.resize(this->layer_param_.memory_data_param().ring_size());
+  for (int i = 0; i < ring_.size(); ++i) {
+    ring_[i].reset(new Batch<Dtype>());
+    ring_[i]->data_.ReshapeLike(added_data_);
+    ring_[i]->label_.ReshapeLike(added_label_);
+    ring_[i]->data_.cpu_data();
+    ring_[i]->label_.cpu_data();
+    ring_free_.push(ring_[i].get());
+  }
 }
 
 template <typename Dtype>
@@ -40,21 +55,50 @@ void MemoryDataLayer<Dtype>::AddDatumVector(const vector<Datum>& datum_vector) {
   CHECK_LE(num, batch_size_) <<
       "The number of added datum must be no greater than the batch size";
 
-  Dtype* top_data = added_data_.mutable_cpu_data();
-  Dtype* top_label = added_label_.mutable_cpu_data();
+  Batch<Dtype>* batch = NULL;
+  if (!ring_.empty()) {
+    batch = ring_free_.pop("Waiting for a free batch");
+  }
+  Dtype* top_data = batch ? batch->data_.mutable_cpu_data() :
+      added_data_.mutable_cpu_data();
+  Dtype* top_label = batch ? batch->label_.mutable_cpu_data() :
+      added_label_.mutable_cpu_data();
   for (int batch_item_id = 0; batch_item_id < num; ++batch_item_id) {
     // Apply data transformations (mirror, scale, crop...)
     this->data_transformer_.Transform(
         batch_item_id, datum_vector[batch_item_id], this->mean_, top_data);
     top_label[batch_item_id] = datum_vector[batch_item_id].label();
   }
+  if (batch) {
+    ring_full_.push(batch);
+    return;
+  }
   // num_images == batch_size_
   Reset(top_data, top_label, batch_size_);
   has_new_data_ = true;
 }
 
+template <typename Dtype>
+void MemoryDataLayer<Dtype>::AddBatches(const Dtype* data,
+    const Dtype* labels, int n) {
+  CHECK(!ring_.empty()) << "AddBatches needs a ring_size";
+  CHECK(data);
+  CHECK(labels);
+  CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
+  for (int pos = 0; pos < n; pos += batch_size_) {
+    Batch<Dtype>* batch = ring_free_.pop("Waiting for a free batch");
+    caffe_copy(batch->data_.count(), data + pos * this->datum_size_,
+        batch->data_.mutable_cpu_data());
+    caffe_copy(batch->label_.count(), labels + pos,
+        batch->label_.mutable_cpu_data());
+    ring_full_.push(batch);
+  }
+}
+
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
+  CHECK(ring_.empty()) << "Reset can't be used with a ring_size; use "
+      << "AddBatches instead";
   CHECK(data);
   CHECK(labels);
   CHECK_EQ(n % batch_size_, 0) << "n must be a multiple of batch size";
@@ -67,6 +111,16 @@ void MemoryDataLayer<Dtype>::Reset(Dtype* data, Dtype* labels, int n) {
 template <typename Dtype>
 void MemoryDataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       vector<Blob<Dtype>*>* top) {
+  if (!ring_.empty()) {
+    // The net is done with the batch of the previous Forward.
+    if (current_) {
+      ring_free_.push(current_);
+    }
+    current_ = ring_full_.pop("Waiting for a batch to be added");
+    (*top)[0]->set_cpu_data(current_->data_.mutable_cpu_data());
+    (*top)[1]->set_cpu_data(current_->label_.mutable_cpu_data());
+    return;
+  }
   CHECK(data_) << "MemoryDataLayer needs to be initalized by calling Reset";
   (*top)[0]->set_cpu_data(data_ + pos_ * this->datum_size_);
   (*top)[1]->set_cpu_data(labels_ + pos_);
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/common_layers.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Reduces the segments of the range that belongs to each worker.
+template <typename Dtype>
+class SegmentReductionForwardTask : public ParallelTask {
+ public:
+  SegmentReductionForwardTask(SegmentReductionParameter_SegmentOp op,
+      const int num_segments, const int dim, const int* segment_begin,
+      const Dtype* bottom_data, Dtype* top_data, int* max_idx)
+      : op_(op), num_segments_(num_segments), dim_(dim),
+        segment_begin_(segment_begin), bottom_data_(bottom_data),
+        top_data_(top_data), max_idx_(max_idx) {}
+
+  virtual void Run(const int worker_id, const int num_workers) {
+    const int first = num_segments_ * worker_id / num_workers;
+    const int last = num_segments_ * (worker_id + 1) / num_workers;
+    for (int s = first; s < last; ++s) {
+      const int begin = segment_begin_[s];
+      const int end = segment_begin_[s + 1];
+      Dtype* segment_top = top_data_ + s * dim_;
+      caffe_copy(dim_, bottom_data_ + begin * dim_, segment_top);
+      switch (op_) {
+      case SegmentReductionParameter_SegmentOp_MAX: {
+        int* max_idx = max_idx_ + s * dim_;
+        caffe_set(dim_, begin, max_idx);
+        for (int i = begin + 1; i < end; ++i) {
+          const Dtype* item = bottom_data_ + i * dim_;
+          for (int j = 0; j < dim_; ++j) {
+            if (item[j] > segment_top[j]) {
+              segment_top[j] = item[j];
+              max_idx[j] = i;
+            }
+          }
+        }
+        break;
+      }
+      case SegmentReductionParameter_SegmentOp_MEAN:
+        for (int i = begin + 1; i < end; ++i) {
+          caffe_axpy(dim_, Dtype(1), bottom_data_ + i * dim_, segment_top);
+        }
+        caffe_scal(dim_, Dtype(1) / (end - begin), segment_top);
+        break;
+      case SegmentReductionParameter_SegmentOp_LOGSUMEXP:
+        // Shift the values by their max before exp, against overflow.
+        for (int i = begin + 1; i < end; ++i) {
+          const Dtype* item = bottom_data_ + i * dim_;
+          for (int j = 0; j < dim_; ++j) {
+            segment_top[j] = std::max(segment_top[j], item[j]);
+          }
+        }
+        for (int j = 0; j < dim_; ++j) {
+          Dtype sum = 0;
+          for (int i = begin; i < end; ++i) {
+            sum += exp(bottom_data_[i * dim_ + j] - segment_top[j]);
+          }
+          segment_top[j] += log(sum);
+        }
+        break;
+      default:
+        LOG(FATAL) << "Unknown segment reduction.";
+      }
+    }
+  }
+
+ protected:
+  const SegmentReductionParameter_SegmentOp op_;
+  const int num_segments_;
+  const int dim_;
+  const int* segment_begin_;
+  const Dtype* bottom_data_;
+  Dtype* top_data_;
+  int* max_idx_;
+};
+
+// Computes the diff of the items of the range that belongs to each worker.
+template <typename Dtype>
+class SegmentReductionBackwardTask : public ParallelTask {
+ public:
+  SegmentReductionBackwardTask(SegmentReductionParameter_SegmentOp op,
+      const int num, const int dim, const int* segment_begin,
+      const int* item_segment, const int* max_idx, const Dtype* top_data,
+      const Dtype* top_diff, const Dtype* bottom_data, Dtype* bottom_diff)
+      : op_(op), num_(num), dim_(dim), segment_begin_(segment_begin),
+        item_segment_(item_segment), max_idx_(max_idx), top_data_(top_data),
+        top_diff_(top_diff), bottom_data_(bottom_data),
+        bottom_diff_(bottom_diff) {}
+
+  virtual void Run(const int worker_id, const int num_workers) {
+    const int first = num_ * worker_id / num_workers;
+    const int last = num_ * (worker_id + 1) / num_workers;
+    for (int i = first; i < last; ++i) {
+      const int s = item_segment_[i];
+      const Dtype* segment_diff = top_diff_ + s * dim_;
+      Dtype* item_diff = bottom_diff_ + i * dim_;
+      switch (op_) {
+      case SegmentReductionParameter_SegmentOp_MAX: {
+        const int* max_idx = max_idx_ + s * dim_;
+        for (int j = 0; j < dim_; ++j) {
+          item_diff[j] = max_idx[j] == i ? segment_diff[j] : Dtype(0);
+        }
+        break;
+      }
+      case SegmentReductionParameter_SegmentOp_MEAN:
+        caffe_cpu_scale(dim_,
+            Dtype(1) / (segment_begin_[s + 1] - segment_begin_[s]),
+            segment_diff, item_diff);
+        break;
+      case SegmentReductionParameter_SegmentOp_LOGSUMEXP: {
+        // The gradient of log-sum-exp is the softmax of the items.
+        const Dtype* segment_top = top_data_ + s * dim_;
+        const Dtype* item = bottom_data_ + i * dim_;
+        for (int j = 0; j < dim_; ++j) {
+          item_diff[j] = segment_diff[j] * exp(item[j] - segment_top[j]);
+        }
+        break;
+      }
+      default:
+        LOG(FATAL) << "Unknown segment reduction.";
+      }
+    }
+  }
+
+ protected:
+  const SegmentReductionParameter_SegmentOp op_;
+  const int num_;
+  const int dim_;
+  const int* segment_begin_;
+  const int* item_segment_;
+  const int* max_idx_;
+  const Dtype* top_data_;
+  const Dtype* top_diff_;
+  const Dtype* bottom_data_;
+  Dtype* bottom_diff_;
+};
+
+template <typename Dtype>
+void SegmentReductionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const SegmentReductionParameter& param =
+      this->layer_param_.segment_reduction_param();
+  op_ = param.operation();
+  CHECK_GT(param.workers(), 0) << "workers must be positive";
+  if (param.workers() > 1) {
+    workers_.reset(new WorkerPool(param.workers()));
+  }
+}
+
+template <typename Dtype>
+void SegmentReductionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const int num = bottom[0]->num();
+  CHECK_EQ(bottom[1]->count(), num)
+      << "SegmentReductionLayer takes one label per item";
+  dim_ = bottom[0]->count() / num;
+  // Index the segments of the batch, which change with its labels.
+  const Dtype* label = bottom[1]->cpu_data();
+  item_segment_.Reshape(num, 1, 1, 1);
+  int* item_segment = item_segment_.mutable_cpu_data();
+  vector<int> segment_begin;
+  for (int i = 0; i < num; ++i) {
+    if (i == 0 || label[i] < 0 || label[i] != label[i - 1]) {
+      segment_begin.push_back(i);
+    }
+    item_segment[i] = segment_begin.size() - 1;
+  }
+  num_segments_ = segment_begin.size();
+  segment_begin.push_back(num);
+  segment_begin_.Reshape(num_segments_ + 1, 1, 1, 1);
+  std::copy(segment_begin.begin(), segment_begin.end(),
+      segment_begin_.mutable_cpu_data());
+  (*top)[0]->Reshape(num_segments_, bottom[0]->channels(),
+      bottom[0]->height(), bottom[0]->width());
+  if (top->size() > 1) {
+    (*top)[1]->Reshape(num_segments_, 1, 1, 1);
+  }
+  if (op_ == SegmentReductionParameter_SegmentOp_MAX) {
+    max_idx_.Reshape(num_segments_, bottom[0]->channels(),
+        bottom[0]->height(), bottom[0]->width());
+  }
+}
+
+template <typename Dtype>
+void SegmentReductionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const int* segment_begin = segment_begin_.cpu_data();
+  int* max_idx = NULL;
+  if (op_ == SegmentReductionParameter_SegmentOp_MAX) {
+    max_idx = max_idx_.mutable_cpu_data();
+  }
+  SegmentReductionForwardTask<Dtype> task(op_, num_segments_, dim_,
+      segment_begin, bottom[0]->cpu_data(), (*top)[0]->mutable_cpu_data(),
+      max_idx);
+  if (workers_) {
+    workers_->Run(&task);
+  } else {
+    task.Run(0, 1);
+  }
+  if (top->size() > 1) {
+    const Dtype* label = bottom[1]->cpu_data();
+    Dtype* top_label = (*top)[1]->mutable_cpu_data();
+    for (int s = 0; s < num_segments_; ++s) {
+      top_label[s] = label[segment_begin[s]];
+    }
+  }
+}
+
+template <typename Dtype>
+void SegmentReductionLayer<Dtype>::Backward_cpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type_name()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  if (!propagate_down[0]) {
+    return;
+  }
+  const int* max_idx = NULL;
+  if (op_ == SegmentReductionParameter_SegmentOp_MAX) {
+    max_idx = max_idx_.cpu_data();
+  }
+  SegmentReductionBackwardTask<Dtype> task(op_, (*bottom)[0]->num(), dim_,
+      segment_begin_.cpu_data(), item_segment_.cpu_data(), max_idx,
+      top[0]->cpu_data(), top[0]->cpu_diff(), (*bottom)[0]->cpu_data(),
+      (*bottom)[0]->mutable_cpu_diff());
+  if (workers_) {
+    workers_->Run(&task);
+  } else {
+    task.Run(0, 1);
+  }
+}
+
+#ifdef CPU_ONLY
+STUB_GPU(SegmentReductionLayer);
+#endif
+
+INSTANTIATE_CLASS(SegmentReductionLayer);
+
+}  // namespace caffe
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/common_layers.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// The forward kernels run a thread per segment and value. Like the CPU path,
+// they start from the first item of the segment, so that -inf and NaN reduce
+// the same way on both.
+template <typename Dtype>
+__global__ void SegmentMaxForward(const int nthreads, const Dtype* bottom_data,
+    const int* segment_begin, const int dim, Dtype* top_data, int* max_idx) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int s = index / dim;
+    const int j = index % dim;
+    int maxidx = segment_begin[s];
+    Dtype maxval = bottom_data[maxidx * dim + j];
+    for (int i = maxidx + 1; i < segment_begin[s + 1]; ++i) {
+      if (bottom_data[i * dim + j] > maxval) {
+        maxidx = i;
+        maxval = bottom_data[i * dim + j];
+      }
+    }
+    top_data[index] = maxval;
+    max_idx[index] = maxidx;
+  }
+}
+
+template <typename Dtype>
+__global__ void SegmentMeanForward(const int nthreads,
+    const Dtype* bottom_data, const int* segment_begin, const int dim,
+    Dtype* top_data) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int s = index / dim;
+    const int j = index % dim;
+    Dtype sum = 0;
+    for (int i = segment_begin[s]; i < segment_begin[s + 1]; ++i) {
+      sum += bottom_data[i * dim + j];
+    }
+    top_data[index] = sum / (segment_begin[s + 1] - segment_begin[s]);
+  }
+}
+
+template <typename Dtype>
+__global__ void SegmentLogSumExpForward(const int nthreads,
+    const Dtype* bottom_data, const int* segment_begin, const int dim,
+    Dtype* top_data) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int s = index / dim;
+    const int j = index % dim;
+    Dtype maxval = bottom_data[segment_begin[s] * dim + j];
+    for (int i = segment_begin[s] + 1; i < segment_begin[s + 1]; ++i) {
+      maxval = max(maxval, bottom_data[i * dim + j]);
+    }
+    Dtype sum = 0;
+    for (int i = segment_begin[s]; i < segment_begin[s + 1]; ++i) {
+      sum += exp(bottom_data[i * dim + j] - maxval);
+    }
+    top_data[index] = maxval + log(sum);
+  }
+}
+
+template <typename Dtype>
+void SegmentReductionLayer<Dtype>::Forward_gpu(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const Dtype* bottom_data = bottom[0]->gpu_data();
+  Dtype* top_data = (*top)[0]->mutable_gpu_data();
+  const int* segment_begin = segment_begin_.gpu_data();
+  const int count = (*top)[0]->count();
+  switch (op_) {
+  case SegmentReductionParameter_SegmentOp_MAX:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    SegmentMaxForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, bottom_data, segment_begin, dim_,
+        top_data, max_idx_.mutable_gpu_data());
+    break;
+  case SegmentReductionParameter_SegmentOp_MEAN:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    SegmentMeanForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, bottom_data, segment_begin, dim_,
+        top_data);
+    break;
+  case SegmentReductionParameter_SegmentOp_LOGSUMEXP:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    SegmentLogSumExpForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, bottom_data, segment_begin, dim_,
+        top_data);
+    break;
+  default:
+    LOG(FATAL) << "Unknown segment reduction.";
+  }
+  CUDA_POST_KERNEL_CHECK;
+  if (top->size() > 1) {
+    // The labels are few, and read on the host to index the segments.
+    const Dtype* label = bottom[1]->cpu_data();
+    const int* segment_begin_cpu = segment_begin_.cpu_data();
+    Dtype* top_label = (*top)[1]->mutable_cpu_data();
+    for (int s = 0; s < num_segments_; ++s) {
+      top_label[s] = label[segment_begin_cpu[s]];
+    }
+  }
+}
+
+// The backward kernels run a thread per bottom value, so that each writes
+// its own diff.
+template <typename Dtype>
+__global__ void SegmentMaxBackward(const int nthreads, const Dtype* top_diff,
+    const int* max_idx, const int* item_segment, const int dim,
+    Dtype* bottom_diff) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int i = index / dim;
+    const int top_index = item_segment[i] * dim + index % dim;
+    bottom_diff[index] = max_idx[top_index] == i ? top_diff[top_index] : 0;
+  }
+}
+
+template <typename Dtype>
+__global__ void SegmentMeanBackward(const int nthreads, const Dtype* top_diff,
+    const int* segment_begin, const int* item_segment, const int dim,
+    Dtype* bottom_diff) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int s = item_segment[index / dim];
+    bottom_diff[index] = top_diff[s * dim + index % dim]
+        / (segment_begin[s + 1] - segment_begin[s]);
+  }
+}
+
+template <typename Dtype>
+__global__ void SegmentLogSumExpBackward(const int nthreads,
+    const Dtype* top_diff, const Dtype* top_data, const Dtype* bottom_data,
+    const int* item_segment, const int dim, Dtype* bottom_diff) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int top_index = item_segment[index / dim] * dim + index % dim;
+    bottom_diff[index] = top_diff[top_index]
+        * exp(bottom_data[index] - top_data[top_index]);
+  }
+}
+
+template <typename Dtype>
+void SegmentReductionLayer<Dtype>::Backward_gpu(
+    const vector<Blob<Dtype>*>& top, const vector<bool>& propagate_down,
+    vector<Blob<Dtype>*>* bottom) {
+  if (propagate_down[1]) {
+    LOG(FATAL) << this->type_name()
+               << " Layer cannot backpropagate to label inputs.";
+  }
+  if (!propagate_down[0]) {
+    return;
+  }
+  const Dtype* top_diff = top[0]->gpu_diff();
+  Dtype* bottom_diff = (*bottom)[0]->mutable_gpu_diff();
+  const int* item_segment = item_segment_.gpu_data();
+  const int count = (*bottom)[0]->count();
+  switch (op_) {
+  case SegmentReductionParameter_SegmentOp_MAX:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    SegmentMaxBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, top_diff, max_idx_.gpu_data(),
+        item_segment, dim_, bottom_diff);
+    break;
+  case SegmentReductionParameter_SegmentOp_MEAN:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    SegmentMeanBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, top_diff, segment_begin_.gpu_data(),
+        item_segment, dim_, bottom_diff);
+    break;
+  case SegmentReductionParameter_SegmentOp_LOGSUMEXP:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    SegmentLogSumExpBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, top_diff, top[0]->gpu_data(),
+        (*bottom)[0]->gpu_data(), item_segment, dim_, bottom_diff);
+    break;
+  default:
+    LOG(FATAL) << "Unknown segment reduction.";
+  }
+  CUDA_POST_KERNEL_CHECK;
+}
+
+
+INSTANTIATE_CLASS(SegmentReductionLayer);
+
+
+}  // namespace caffe
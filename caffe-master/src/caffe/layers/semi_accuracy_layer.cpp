@@ -13,6 +13,12 @@ namespace caffe {
 template <typename Dtype>
 void SemiAccuracyLayer<Dtype>::LayerSetUp(
   const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  const SemiAccuracyParameter& param =
+      this->layer_param_.semi_accuracy_param();
+  if (param.streaming_metrics()) {
+    metrics_.reset(new StreamingMetrics(param.num_bins(),
+        param.score_range()));
+  }
 }
 
 template <typename Dtype>
@@ -20,30 +26,60 @@ void SemiAccuracyLayer<Dtype>::Reshape(
   const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
   CHECK_EQ(bottom[0]->num(), bottom[1]->num())
       << "The data and label should have the same number.";
-  CHECK_EQ(bottom[1]->channels(), 1);
-  CHECK_EQ(bottom[1]->height(), 1);
-  CHECK_EQ(bottom[1]->width(), 1);
+  const int num = bottom[0]->num();
+  const int label_dim = bottom[1]->count() / num;
+  CHECK(label_dim == 1 || label_dim == bottom[0]->count() / num)
+      << "SemiAccuracyLayer takes a label per item, or per item and class";
   (*top)[0]->Reshape(1, 1, 1, 1);
 }
 
 template <typename Dtype>
 void SemiAccuracyLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     vector<Blob<Dtype>*>* top) {
-  Dtype accuracy = 0;
-  Dtype pred = 0;
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  const Dtype* bottom_label = bottom[1]->cpu_data();
-  int num = bottom[0]->num();
-  int dim = bottom[0]->count() / bottom[0]->num();
-  for (int i = 0; i < num; ++i) {
-    pred = bottom_data[i] > Dtype(0) ? Dtype(-1) : Dtype(-2);
-    if (pred == bottom_label[i]) {
-      ++accuracy;
+  const Dtype* score = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const int num = bottom[0]->num();
+  const int dim = bottom[0]->count() / num;
+  const int label_dim = bottom[1]->count() / num;
+  segments_.resize(label_dim);
+  for (int c = 0; c < label_dim; ++c) {
+    segments_[c].Build(label + c, num, label_dim);
+  }
+  StreamingMetrics* metrics =
+      Caffe::phase() == Caffe::TEST ? metrics_.get() : NULL;
+  int right = 0;
+  int total = 0;
+  for (int c = 0; c < dim; ++c) {
+    const BagSegments& segments = segments_[label_dim == 1 ? 0 : c];
+    for (int j = 0; j < segments.positives_.size(); ++j) {
+      const Dtype x = score[segments.positives_[j] * dim + c];
+      right += x > Dtype(0);
+      if (metrics) {
+        metrics->AddPositive(x);
+      }
+    }
+    for (int j = 0; j < segments.negatives_.size(); ++j) {
+      const Dtype x = score[segments.negatives_[j] * dim + c];
+      right += x <= Dtype(0);
+      if (metrics) {
+        metrics->AddNegative(x);
+      }
     }
+    for (int j = 0; j < segments.bags_.size(); ++j) {
+      Dtype best = score[segments.bags_[j].first * dim + c];
+      for (int k = segments.bags_[j].first + 1; k < segments.bags_[j].second;
+           ++k) {
+        best = std::max(best, score[k * dim + c]);
+      }
+      right += best > Dtype(0);
+      if (metrics) {
+        metrics->AddBag(best);
+      }
+    }
+    total += segments.positives_.size() + segments.negatives_.size() +
+        segments.bags_.size();
   }
-
-  // LOG(INFO) << "SemiAccuracy: " << accuracy;
-  (*top)[0]->mutable_cpu_data()[0] = accuracy / num;
+  (*top)[0]->mutable_cpu_data()[0] = total ? Dtype(right) / total : Dtype(0);
   // SemiAccuracy layer should not be used as a loss function.
 }
 
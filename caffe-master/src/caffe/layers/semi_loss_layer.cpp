@@ -4,205 +4,132 @@
 #include <vector>
 
 #include "caffe/layer.hpp"
+#include "caffe/util/hard_negative_cache.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 namespace caffe {
 
+// Computes, for the n scores x, the sigmoid s = 1 / (1 + exp(-x)) and
+// log_term = log(1 + exp(-|x|)), with a single exp and log1p per score and
+// without overflow. The loss of a score as a positive, -log(s), is then
+// log_term - min(x, 0), and as a negative, -log(1 - s), log_term + max(x, 0).
+template <typename Dtype>
+static void StableLogSigmoid(const int n, const Dtype* x, Dtype* sigmoid,
+    Dtype* log_term) {
+  caffe_abs(n, x, log_term);
+  caffe_scal(n, Dtype(-1), log_term);
+  caffe_exp(n, log_term, log_term);
+  for (int i = 0; i < n; ++i) {
+    sigmoid[i] = (x[i] >= 0 ? Dtype(1) : log_term[i]) / (1 + log_term[i]);
+  }
+  caffe_log1p(n, log_term, log_term);
+}
+
 template <typename Dtype>
 void SemiLossLayer<Dtype>::LayerSetUp(
-  const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
   LossLayer<Dtype>::LayerSetUp(bottom, top);
-  CHECK_EQ(bottom[0]->num(), bottom[1]->num());
-  CHECK_EQ(bottom[0]->channels(), 1);
-  CHECK_EQ(bottom[1]->channels(), 1);
-  CHECK_EQ(bottom[0]->height(), 1);
-  CHECK_EQ(bottom[0]->width(), 1);
-  CHECK_EQ(bottom[1]->height(), 1);
-  CHECK_EQ(bottom[1]->width(), 1);
-  
   alpha_ = this->layer_param_.semi_loss_param().alpha();
   beta_ = this->layer_param_.semi_loss_param().beta();
   gamma_ = this->layer_param_.semi_loss_param().gamma();
-  positive_weights_.Reshape(bottom[0]->num(), 1, 1, 1);
-  negative_weights_.Reshape(bottom[0]->num(), 1, 1, 1);
-  weakly_weights_.Reshape(bottom[0]->num(), 1, 1, 1);
-  
-  num_p = Dtype(0);
-  num_n = Dtype(0);
-  num_w = Dtype(0);
+  const string& cache =
+      this->layer_param_.semi_loss_param().hard_negative_cache();
+  if (!cache.empty()) {
+    hard_negatives_ = HardNegativeCache<Dtype>::Find(cache);
+    CHECK(hard_negatives_) << "No data layer holds the hard negative cache "
+        << cache;
+  }
+}
+
+template <typename Dtype>
+void SemiLossLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, vector<Blob<Dtype>*>* top) {
+  LossLayer<Dtype>::Reshape(bottom, top);
+  const int num = bottom[0]->num();
+  const int dim = bottom[0]->count() / num;
+  const int label_dim = bottom[1]->count() / num;
+  CHECK(label_dim == 1 || label_dim == dim)
+      << "SemiLossLayer takes a label per item, or per item and class";
+  sigmoid_.ReshapeLike(*bottom[0]);
+  log_term_.ReshapeLike(*bottom[0]);
+  diff_.ReshapeLike(*bottom[0]);
 }
 
 template <typename Dtype>
 void SemiLossLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     vector<Blob<Dtype>*>* top) {
-  const Dtype* bottom_data = bottom[0]->cpu_data();
-  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
-  const Dtype* label = bottom[1]->cpu_data();//-2(negative);-1(positive);0,1,2,3,...(weakly bags idx)
-  
-  Dtype* pw = positive_weights_.mutable_cpu_data();
-  Dtype* nw = negative_weights_.mutable_cpu_data();
-  Dtype* ww = weakly_weights_.mutable_cpu_data();
-  
-  int num = bottom[0]->num();
-  /*number of samples 
-   *i.e. one batch has 50 samples, num = 50*/
-  int count = bottom[0]->count();
-  int dim = count / num;
-  /*dimension of the sample's score(network's output) 
-   *i.e. there are 20 categories in all, dim = 20*/ 
-   /*in this case, it's a binary classification task, so dim = 1*/
-   
-  //data permutation: positive/negative -> weakly_bags1 ->weakly_bags2 -> ...
-  caffe_set(count, Dtype(0), ww);
-  bool start_count = true;
-  int num_int_p = 0;//number of positive samples
-  int num_int_n = 0;//number of negative samples  
-  int num_int_w = 0;//number of bags
-  int max_idx = 0;
-  float loss_p_single = 0;
-  float loss_n_single = 0;
-  float loss_w_single = 0;
-  float loss_p = 0;
-  float loss_n = 0;
-  float loss_w = 0;
-  for (int i = 0; i < num; ++i) {
-    
-    if (bottom_data[i] > Dtype(20)) {
-      loss_p_single = 0;
-      loss_n_single = bottom_data[i];
-    }
-    else if (bottom_data[i] < Dtype(-20)) {
-      loss_p_single = -bottom_data[i];
-      loss_n_single = 0;
-    }
-    else {
-      loss_p_single = -log(1 / (1 + exp(-bottom_data[i])));
-      loss_n_single = -log(1 / (1 + exp(bottom_data[i])));
-    }
+  const Dtype* score = bottom[0]->cpu_data();
+  const Dtype* label = bottom[1]->cpu_data();
+  const int num = bottom[0]->num();
+  const int count = bottom[0]->count();
+  const int dim = count / num;
+  const int label_dim = bottom[1]->count() / num;
+  Dtype* sigmoid = sigmoid_.mutable_cpu_data();
+  Dtype* log_term = log_term_.mutable_cpu_data();
+  StableLogSigmoid(count, score, sigmoid, log_term);
+  Dtype* diff = diff_.mutable_cpu_data();
+  caffe_set(count, Dtype(0), diff);
+  segments_.resize(label_dim);
+  for (int c = 0; c < label_dim; ++c) {
+    segments_[c].Build(label + c, num, label_dim);
+  }
 
+  const bool report_negatives =
+      hard_negatives_ && Caffe::phase() == Caffe::TRAIN;
+  if (report_negatives) {
+    negative_loss_.assign(num, Dtype(0));
+  }
 
-    //positive
-    if (label[i] == Dtype(-1)) {
-      num_int_p += 1;
-      loss_p += loss_p_single;
-      pw[i] = Dtype(1);
-      nw[i] = Dtype(0);
-      // the last sample is the end of a weakly_bag
-      if (start_count == false) {
-        ww[max_idx] = Dtype(1);
-        start_count = true;
-        if (bottom_data[max_idx] > Dtype(20)) {
-          loss_w_single = 0;
-        }
-        else if (bottom_data[max_idx] < Dtype(-20)) {
-          loss_w_single = -bottom_data[max_idx];
-        }
-        else {
-          loss_w_single = -log(1 / (1 + exp(-bottom_data[max_idx])));
-        }
-        loss_w += loss_w_single;
+  // Each class weighs 1 / dim of the loss, each of its positives alpha_ over
+  // their number, and so on. The gradient of the loss of a score as a
+  // positive is s - 1, as a negative s.
+  Dtype loss = 0;
+  for (int c = 0; c < dim; ++c) {
+    const BagSegments& segments = segments_[label_dim == 1 ? 0 : c];
+    const vector<int>& positives = segments.positives_;
+    const vector<int>& negatives = segments.negatives_;
+    const vector<pair<int, int> >& bags = segments.bags_;
+    if (!positives.empty()) {
+      const Dtype weight = alpha_ / (dim * positives.size());
+      for (int j = 0; j < positives.size(); ++j) {
+        const int i = positives[j] * dim + c;
+        loss += weight * (log_term[i] - std::min(score[i], Dtype(0)));
+        diff[i] = weight * (sigmoid[i] - 1);
       }
     }
-    //negative
-    if (label[i] == Dtype(-2)) {
-      num_int_n += 1;
-      loss_n += loss_n_single;
-      nw[i] = Dtype(1);
-      pw[i] = Dtype(0);
-      // the last sample is the end of a weakly_bag
-      if (start_count == false) {
-        ww[max_idx] = Dtype(1);
-        start_count = true;
-        
-        if (bottom_data[max_idx] > Dtype(20)) {
-          loss_w_single = 0;
-        }
-        else if (bottom_data[max_idx] < Dtype(-20)) {
-          loss_w_single = -bottom_data[max_idx];
+    if (!negatives.empty()) {
+      const Dtype weight = beta_ / (dim * negatives.size());
+      for (int j = 0; j < negatives.size(); ++j) {
+        const int i = negatives[j] * dim + c;
+        const Dtype negative_loss = log_term[i] + std::max(score[i], Dtype(0));
+        loss += weight * negative_loss;
+        diff[i] = weight * sigmoid[i];
+        if (report_negatives) {
+          negative_loss_[negatives[j]] += negative_loss;
         }
-        else {
-          loss_w_single = -log(1 / (1 + exp(-bottom_data[max_idx])));
-        }
-        
-        loss_w += loss_w_single;
       }
     }
-    //weakly_bags
-    if (label[i] >= Dtype(0)) {
-      //the start of a weakly_bag
-      if (start_count == true) {
-        num_int_w += 1;
-        start_count = false;
-        max_idx = i;
-        pw[i] = Dtype(0);
-        nw[i] = Dtype(0);
-      }
-      //not start
-      else {
-        //the end of a weakly_bag, the start of a new weakly_bag
-        if (label[i] != label[i-1]) {
-          ww[max_idx] = Dtype(1);
-          start_count = true;
-          i -= 1;
-          
-          if (bottom_data[max_idx] > Dtype(20)) {
-            loss_w_single = 0;
+    if (!bags.empty()) {
+      // Each bag counts as a positive, scored by its best item.
+      const Dtype weight = gamma_ / (dim * bags.size());
+      for (int j = 0; j < bags.size(); ++j) {
+        int best = bags[j].first * dim + c;
+        for (int k = bags[j].first + 1; k < bags[j].second; ++k) {
+          if (score[k * dim + c] >= score[best]) {
+            best = k * dim + c;
           }
-          else if (bottom_data[max_idx] < Dtype(-20)) {
-            loss_w_single = -bottom_data[max_idx];
-          }
-          else {
-            loss_w_single = -log(1 / (1 + exp(-bottom_data[max_idx])));
-          }
-          
-          loss_w += loss_w_single;
-          
-          pw[i] = Dtype(0);
-          nw[i] = Dtype(0);
-        }
-        //not end
-        else {
-          if (bottom_data[i] >= bottom_data[max_idx]) {
-            max_idx = i;
-          }
-          pw[i] = Dtype(0);
-          nw[i] = Dtype(0);
         }
+        loss += weight * (log_term[best] - std::min(score[best], Dtype(0)));
+        diff[best] = weight * (sigmoid[best] - 1);
       }
     }
   }
-  //the end of the data, and the last sample is a weakly_bag
-  if (start_count == false) { 
-    ww[max_idx] = Dtype(1);
-    
-    if (bottom_data[max_idx] > Dtype(20)) {
-      loss_w_single = 0;
-    }
-    else if (bottom_data[max_idx] < Dtype(-20)) {
-      loss_w_single = -bottom_data[max_idx];
-    }
-    else {
-      loss_w_single = -log(1 / (1 + exp(-bottom_data[max_idx])));
-    }
-    
-    loss_w += loss_w_single;
-  }
-  num_p = Dtype(num_int_p);
-  num_n = Dtype(num_int_n);
-  num_w = Dtype(num_int_w);
-  if (num_int_p != 0) {
-    loss_p /= num_int_p;
+  (*top)[0]->mutable_cpu_data()[0] = loss;
+  if (report_negatives) {
+    hard_negatives_->Update(&negative_loss_[0], num);
   }
-  if (num_int_n != 0) {
-    loss_n /= num_int_n;
-  }  
-  if (num_int_w != 0) {
-    loss_w /= num_int_w;
-  }
-  Dtype* loss = (*top)[0]->mutable_cpu_data();
-  loss[0] = alpha_ * loss_p + beta_ * loss_n + gamma_ * loss_w;    
 }
 
 template <typename Dtype>
@@ -213,51 +140,9 @@ void SemiLossLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
                << " Layer cannot backpropagate to label inputs.";
   }
   if (propagate_down[0]) {
-    const Dtype* bottom_data = (*bottom)[0]->cpu_data();
-    Dtype* bottom_diff = (*bottom)[0]->mutable_cpu_diff();
-	
-    Dtype* pw = positive_weights_.mutable_cpu_data();
-    Dtype* nw = negative_weights_.mutable_cpu_data();
-    Dtype* ww = weakly_weights_.mutable_cpu_data();
-	
-    int count = (*bottom)[0]->count();
-	
-    int num_int_p = static_cast<float>(num_p);
-    int num_int_n = static_cast<float>(num_n);
-    int num_int_w = static_cast<float>(num_w);
-    
-    float diff_p = 0;
-    float diff_n = 0;
-	
     const Dtype loss_weight = top[0]->cpu_diff()[0];
-    for (int i = 0; i < count; ++i) {
-
-      if (bottom_data[i] > Dtype(20)) {
-        diff_p = 0;
-        diff_n = 1;
-      }
-      else if (bottom_data[i] < Dtype(-20)) {
-        diff_p = -1;
-        diff_n = 0;
-      }
-      else {
-        diff_p = 1 / (1 + exp(-bottom_data[i])) - 1;
-        diff_n = 1 - 1 / (1 + exp(bottom_data[i]));
-      }
-
-      if (num_int_p != 0 && pw[i] != 0) {
-        bottom_diff[i] = loss_weight * alpha_ / num_int_p * diff_p;
-      }
-      else if (num_int_n != 0 && nw[i] != 0) {
-        bottom_diff[i] = loss_weight * beta_ / num_int_n * diff_n;
-      }
-      else if (num_int_w != 0 && ww[i] != 0) {
-        bottom_diff[i] = loss_weight * gamma_ / num_int_w * diff_p;
-      }
-      else {
-        bottom_diff[i] = 0;
-      }
-    }
+    caffe_cpu_scale((*bottom)[0]->count(), loss_weight, diff_.cpu_data(),
+        (*bottom)[0]->mutable_cpu_diff());
   }
 }
 
@@ -1,6 +1,7 @@
 #include <stdint.h>
 
 #include <algorithm>
+#include <cstring>
 #include <map>
 #include <string>
 #include <utility>
@@ -23,6 +24,52 @@
 
 namespace caffe {
 
+// Decodes the distinct images of a batch, each worker taking its share.
+template <typename Dtype>
+class WindowDataLayerDecodeTask : public ParallelTask {
+ public:
+  WindowDataLayerDecodeTask(WindowDataLayer<Dtype>* layer,
+      const int num_images)
+      : layer_(layer), num_images_(num_images) {}
+
+  virtual void Run(const int worker_id, const int num_workers) {
+    const int begin = num_images_ * worker_id / num_workers;
+    const int end = num_images_ * (worker_id + 1) / num_workers;
+    for (int i = begin; i < end; ++i) {
+      layer_->DecodeImage(i);
+    }
+  }
+
+ protected:
+  WindowDataLayer<Dtype>* layer_;
+  const int num_images_;
+};
+
+// Crops, warps and mirrors the windows of the slice of a batch that belongs
+// to each worker.
+template <typename Dtype>
+class WindowDataLayerWarpTask : public ParallelTask {
+ public:
+  WindowDataLayerWarpTask(WindowDataLayer<Dtype>* layer, const int batch_size,
+      Dtype* top_data, Dtype* top_label)
+      : layer_(layer), batch_size_(batch_size), top_data_(top_data),
+        top_label_(top_label) {}
+
+  virtual void Run(const int worker_id, const int num_workers) {
+    const int begin = batch_size_ * worker_id / num_workers;
+    const int end = batch_size_ * (worker_id + 1) / num_workers;
+    for (int item_id = begin; item_id < end; ++item_id) {
+      layer_->WarpWindow(item_id, top_data_, top_label_);
+    }
+  }
+
+ protected:
+  WindowDataLayer<Dtype>* layer_;
+  const int batch_size_;
+  Dtype* top_data_;
+  Dtype* top_label_;
+};
+
 template <typename Dtype>
 WindowDataLayer<Dtype>::~WindowDataLayer<Dtype>() {
   this->JoinPrefetchThread();
@@ -153,7 +200,6 @@ void WindowDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   CHECK_GT(crop_size, 0);
   const int batch_size = this->layer_param_.window_data_param().batch_size();
   (*top)[0]->Reshape(batch_size, channels, crop_size, crop_size);
-  this->prefetch_data_.Reshape(batch_size, channels, crop_size, crop_size);
 
   LOG(INFO) << "output data size: " << (*top)[0]->num() << ","
       << (*top)[0]->channels() << "," << (*top)[0]->height() << ","
@@ -166,7 +212,19 @@ void WindowDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       (*top)[0]->channels() * (*top)[0]->height() * (*top)[0]->width();
   // label
   (*top)[1]->Reshape(batch_size, 1, 1, 1);
-  this->prefetch_label_.Reshape(batch_size, 1, 1, 1);
+  const int num_mean_values = this->transform_param_.mean_value_size();
+  CHECK(num_mean_values <= 1 || num_mean_values == channels) <<
+      "Specify either 1 mean_value or as many as channels: " << channels;
+  // decoded images
+  const int cache_size = this->layer_param_.window_data_param().cache_size();
+  if (cache_size) {
+    LOG(INFO) << "Caching up to " << cache_size << " MB of decoded images";
+    cache_.reset(new DatumCache(static_cast<size_t>(cache_size) << 20));
+  } else {
+    cache_.reset();
+  }
+  // workers
+  this->SetUpWorkers(this->layer_param_.window_data_param().workers());
 }
 
 template <typename Dtype>
@@ -177,216 +235,256 @@ unsigned int WindowDataLayer<Dtype>::PrefetchRand() {
   return (*prefetch_rng)();
 }
 
-// Thread fetching the data
+// Called on the prefetch thread to fill one batch
 template <typename Dtype>
-void WindowDataLayer<Dtype>::InternalThreadEntry() {
+void WindowDataLayer<Dtype>::LoadBatch(Batch<Dtype>* batch) {
   // At each iteration, sample N windows where N*p are foreground (object)
   // windows and N*(1-p) are background (non-object) windows
 
-  Dtype* top_data = this->prefetch_data_.mutable_cpu_data();
-  Dtype* top_label = this->prefetch_label_.mutable_cpu_data();
-  const Dtype scale = this->layer_param_.window_data_param().scale();
+  Dtype* top_data = batch->data_.mutable_cpu_data();
+  Dtype* top_label = batch->label_.mutable_cpu_data();
   const int batch_size = this->layer_param_.window_data_param().batch_size();
-  const int context_pad = this->layer_param_.window_data_param().context_pad();
-  const int crop_size = this->transform_param_.crop_size();
   const bool mirror = this->transform_param_.mirror();
   const float fg_fraction =
       this->layer_param_.window_data_param().fg_fraction();
-  const Dtype* mean = this->data_mean_.cpu_data();
-  const int mean_off = (this->data_mean_.width() - crop_size) / 2;
-  const int mean_width = this->data_mean_.width();
-  const int mean_height = this->data_mean_.height();
-  cv::Size cv_crop_size(crop_size, crop_size);
-  const string& crop_mode = this->layer_param_.window_data_param().crop_mode();
-
-  bool use_square = (crop_mode == "square") ? true : false;
-
-  // zero out batch
-  caffe_set(this->prefetch_data_.count(), Dtype(0), top_data);
 
   const int num_fg = static_cast<int>(static_cast<float>(batch_size)
       * fg_fraction);
   const int num_samples[2] = { batch_size - num_fg, num_fg };
 
+  // Sample the windows first, on this thread, so that the batch does not
+  // depend on the workers. Windows are grouped by image, so that each image
+  // is decoded once per batch however many windows are cropped out of it.
+  batch_windows_.resize(batch_size);
+  batch_mirrors_.resize(batch_size);
+  batch_window_images_.resize(batch_size);
+  batch_images_.clear();
+  map<int, int> image_slots;
   int item_id = 0;
   // sample from bg set then fg set
   for (int is_fg = 0; is_fg < 2; ++is_fg) {
     for (int dummy = 0; dummy < num_samples[is_fg]; ++dummy) {
       // sample a window
       const unsigned int rand_index = PrefetchRand();
-      vector<float> window = (is_fg) ?
+      const vector<float>& window = (is_fg) ?
           fg_windows_[rand_index % fg_windows_.size()] :
           bg_windows_[rand_index % bg_windows_.size()];
-
-      bool do_mirror = false;
-      if (mirror && PrefetchRand() % 2) {
-        do_mirror = true;
+      batch_windows_[item_id] = &window;
+      batch_mirrors_[item_id] = mirror && PrefetchRand() % 2;
+
+      const int image_index = window[WindowDataLayer<Dtype>::IMAGE_INDEX];
+      map<int, int>::iterator slot = image_slots.find(image_index);
+      if (slot == image_slots.end()) {
+        slot = image_slots.insert(
+            std::make_pair(image_index, batch_images_.size())).first;
+        batch_images_.push_back(image_index);
       }
+      batch_window_images_[item_id] = slot->second;
+      item_id++;
+    }
+  }
 
-      // load the image containing the window
-      pair<std::string, vector<int> > image =
-          image_database_[window[WindowDataLayer<Dtype>::IMAGE_INDEX]];
+  // Decode the images, then crop the windows out of them, in parallel if
+  // there are workers.
+  batch_decoded_.resize(batch_images_.size());
+  // Allocate the mean before the workers read it.
+  this->data_mean_.cpu_data();
+  this->EndStage("sample");
+  WindowDataLayerDecodeTask<Dtype> decode_task(this, batch_images_.size());
+  this->RunTask(&decode_task);
+  this->EndStage("decode");
+  WindowDataLayerWarpTask<Dtype> warp_task(this, batch_size, top_data,
+      top_label);
+  this->RunTask(&warp_task);
+  // Do not hold on to the images until the next batch.
+  batch_decoded_.clear();
+  this->EndStage("transform");
+}
 
-      cv::Mat cv_img = cv::imread(image.first, CV_LOAD_IMAGE_COLOR);
-      if (!cv_img.data) {
-        LOG(ERROR) << "Could not open or find file " << image.first;
-        return;
-      }
-      const int channels = cv_img.channels();
-
-      // crop window out of image and warp it
-      int x1 = window[WindowDataLayer<Dtype>::X1];
-      int y1 = window[WindowDataLayer<Dtype>::Y1];
-      int x2 = window[WindowDataLayer<Dtype>::X2];
-      int y2 = window[WindowDataLayer<Dtype>::Y2];
-
-      int pad_w = 0;
-      int pad_h = 0;
-      if (context_pad > 0 || use_square) {
-        // scale factor by which to expand the original region
-        // such that after warping the expanded region to crop_size x crop_size
-        // there's exactly context_pad amount of padding on each side
-        Dtype context_scale = static_cast<Dtype>(crop_size) /
-            static_cast<Dtype>(crop_size - 2*context_pad);
-
-        // compute the expanded region
-        Dtype half_height = static_cast<Dtype>(y2-y1+1)/2.0;
-        Dtype half_width = static_cast<Dtype>(x2-x1+1)/2.0;
-        Dtype center_x = static_cast<Dtype>(x1) + half_width;
-        Dtype center_y = static_cast<Dtype>(y1) + half_height;
-        if (use_square) {
-          if (half_height > half_width) {
-            half_width = half_height;
-          } else {
-            half_height = half_width;
-          }
-        }
-        x1 = static_cast<int>(round(center_x - half_width*context_scale));
-        x2 = static_cast<int>(round(center_x + half_width*context_scale));
-        y1 = static_cast<int>(round(center_y - half_height*context_scale));
-        y2 = static_cast<int>(round(center_y + half_height*context_scale));
-
-        // the expanded region may go outside of the image
-        // so we compute the clipped (expanded) region and keep track of
-        // the extent beyond the image
-        int unclipped_height = y2-y1+1;
-        int unclipped_width = x2-x1+1;
-        int pad_x1 = std::max(0, -x1);
-        int pad_y1 = std::max(0, -y1);
-        int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
-        int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
-        // clip bounds
-        x1 = x1 + pad_x1;
-        x2 = x2 - pad_x2;
-        y1 = y1 + pad_y1;
-        y2 = y2 - pad_y2;
-        CHECK_GT(x1, -1);
-        CHECK_GT(y1, -1);
-        CHECK_LT(x2, cv_img.cols);
-        CHECK_LT(y2, cv_img.rows);
-
-        int clipped_height = y2-y1+1;
-        int clipped_width = x2-x1+1;
-
-        // scale factors that would be used to warp the unclipped
-        // expanded region
-        Dtype scale_x =
-            static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_width);
-        Dtype scale_y =
-            static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_height);
-
-        // size to warp the clipped expanded region to
-        cv_crop_size.width =
-            static_cast<int>(round(static_cast<Dtype>(clipped_width)*scale_x));
-        cv_crop_size.height =
-            static_cast<int>(round(static_cast<Dtype>(clipped_height)*scale_y));
-        pad_x1 = static_cast<int>(round(static_cast<Dtype>(pad_x1)*scale_x));
-        pad_x2 = static_cast<int>(round(static_cast<Dtype>(pad_x2)*scale_x));
-        pad_y1 = static_cast<int>(round(static_cast<Dtype>(pad_y1)*scale_y));
-        pad_y2 = static_cast<int>(round(static_cast<Dtype>(pad_y2)*scale_y));
-
-        pad_h = pad_y1;
-        // if we're mirroring, we mirror the padding too (to be pedantic)
-        if (do_mirror) {
-          pad_w = pad_x2;
-        } else {
-          pad_w = pad_x1;
-        }
-
-        // ensure that the warped, clipped region plus the padding fits in the
-        // crop_size x crop_size image (it might not due to rounding)
-        if (pad_h + cv_crop_size.height > crop_size) {
-          cv_crop_size.height = crop_size - pad_h;
-        }
-        if (pad_w + cv_crop_size.width > crop_size) {
-          cv_crop_size.width = crop_size - pad_w;
-        }
-      }
+template <typename Dtype>
+void WindowDataLayer<Dtype>::DecodeImage(const int i) {
+  const string& path = image_database_[batch_images_[i]].first;
+  if (cache_) {
+    batch_decoded_[i] = cache_->Get(path);
+    if (batch_decoded_[i]) {
+      return;
+    }
+  }
+  cv::Mat cv_img = cv::imread(path, CV_LOAD_IMAGE_COLOR);
+  if (!cv_img.data) {
+    LOG(ERROR) << "Could not open or find file " << path;
+    batch_decoded_[i].reset();
+    return;
+  }
+  shared_ptr<Datum> decoded(new Datum());
+  decoded->set_channels(cv_img.channels());
+  decoded->set_height(cv_img.rows);
+  decoded->set_width(cv_img.cols);
+  const int row_size = cv_img.cols * cv_img.channels();
+  string* data = decoded->mutable_data();
+  data->resize(cv_img.rows * row_size);
+  for (int h = 0; h < cv_img.rows; ++h) {
+    memcpy(&(*data)[h * row_size], cv_img.ptr(h), row_size);
+  }
+  if (cache_) {
+    cache_->Put(path, decoded);
+  }
+  batch_decoded_[i] = decoded;
+}
+
+template <typename Dtype>
+void WindowDataLayer<Dtype>::WarpWindow(const int item_id, Dtype* top_data,
+    Dtype* top_label) {
+  const Dtype scale = this->layer_param_.window_data_param().scale();
+  const int context_pad = this->layer_param_.window_data_param().context_pad();
+  const int crop_size = this->transform_param_.crop_size();
+  const Dtype* mean = this->data_mean_.cpu_data();
+  const int mean_off = (this->data_mean_.width() - crop_size) / 2;
+  const int mean_width = this->data_mean_.width();
+  const int mean_height = this->data_mean_.height();
+  // per-channel mean values replace the mean image
+  const int num_mean_values = this->transform_param_.mean_value_size();
+  cv::Size cv_crop_size(crop_size, crop_size);
+  const string& crop_mode = this->layer_param_.window_data_param().crop_mode();
 
-      cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
-      cv::Mat cv_cropped_img = cv_img(roi);
-      cv::resize(cv_cropped_img, cv_cropped_img,
-          cv_crop_size, 0, 0, cv::INTER_LINEAR);
+  bool use_square = (crop_mode == "square") ? true : false;
 
-      // horizontal flip at random
-      if (do_mirror) {
-        cv::flip(cv_cropped_img, cv_cropped_img, 1);
-      }
+  const vector<float>& window = *batch_windows_[item_id];
+  const bool do_mirror = batch_mirrors_[item_id];
 
-      // copy the warped window into top_data
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < cv_cropped_img.rows; ++h) {
-          for (int w = 0; w < cv_cropped_img.cols; ++w) {
-            Dtype pixel =
-                static_cast<Dtype>(cv_cropped_img.at<cv::Vec3b>(h, w)[c]);
-
-            top_data[((item_id * channels + c) * crop_size + h + pad_h)
-                     * crop_size + w + pad_w]
-                = (pixel
-                    - mean[(c * mean_height + h + mean_off + pad_h)
-                           * mean_width + w + mean_off + pad_w])
-                  * scale;
-          }
-        }
-      }
+  // zero out the item
+  caffe_set(this->datum_size_, Dtype(0),
+      top_data + item_id * this->datum_size_);
+  // get window label
+  top_label[item_id] = window[WindowDataLayer<Dtype>::LABEL];
 
-      // get window label
-      top_label[item_id] = window[WindowDataLayer<Dtype>::LABEL];
-
-      #if 0
-      // useful debugging code for dumping transformed windows to disk
-      string file_id;
-      std::stringstream ss;
-      ss << PrefetchRand();
-      ss >> file_id;
-      std::ofstream inf((string("dump/") + file_id +
-          string("_info.txt")).c_str(), std::ofstream::out);
-      inf << image.first << std::endl
-          << window[WindowDataLayer<Dtype>::X1]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::Y1]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::X2]+1 << std::endl
-          << window[WindowDataLayer<Dtype>::Y2]+1 << std::endl
-          << do_mirror << std::endl
-          << top_label[item_id] << std::endl
-          << is_fg << std::endl;
-      inf.close();
-      std::ofstream top_data_file((string("dump/") + file_id +
-          string("_data.txt")).c_str(),
-          std::ofstream::out | std::ofstream::binary);
-      for (int c = 0; c < channels; ++c) {
-        for (int h = 0; h < crop_size; ++h) {
-          for (int w = 0; w < crop_size; ++w) {
-            top_data_file.write(reinterpret_cast<char*>(
-                &top_data[((item_id * channels + c) * crop_size + h)
-                          * crop_size + w]),
-                sizeof(Dtype));
-          }
-        }
+  // the decoded image containing the window, if it could be read
+  const shared_ptr<const Datum>& decoded =
+      batch_decoded_[batch_window_images_[item_id]];
+  if (!decoded) {
+    return;
+  }
+  const cv::Mat cv_img(decoded->height(), decoded->width(), CV_8UC3,
+      const_cast<char*>(decoded->data().data()));
+  const int channels = decoded->channels();
+
+  // crop window out of image and warp it
+  int x1 = window[WindowDataLayer<Dtype>::X1];
+  int y1 = window[WindowDataLayer<Dtype>::Y1];
+  int x2 = window[WindowDataLayer<Dtype>::X2];
+  int y2 = window[WindowDataLayer<Dtype>::Y2];
+
+  int pad_w = 0;
+  int pad_h = 0;
+  if (context_pad > 0 || use_square) {
+    // scale factor by which to expand the original region
+    // such that after warping the expanded region to crop_size x crop_size
+    // there's exactly context_pad amount of padding on each side
+    Dtype context_scale = static_cast<Dtype>(crop_size) /
+        static_cast<Dtype>(crop_size - 2*context_pad);
+
+    // compute the expanded region
+    Dtype half_height = static_cast<Dtype>(y2-y1+1)/2.0;
+    Dtype half_width = static_cast<Dtype>(x2-x1+1)/2.0;
+    Dtype center_x = static_cast<Dtype>(x1) + half_width;
+    Dtype center_y = static_cast<Dtype>(y1) + half_height;
+    if (use_square) {
+      if (half_height > half_width) {
+        half_width = half_height;
+      } else {
+        half_height = half_width;
       }
-      top_data_file.close();
-      #endif
+    }
+    x1 = static_cast<int>(round(center_x - half_width*context_scale));
+    x2 = static_cast<int>(round(center_x + half_width*context_scale));
+    y1 = static_cast<int>(round(center_y - half_height*context_scale));
+    y2 = static_cast<int>(round(center_y + half_height*context_scale));
+
+    // the expanded region may go outside of the image
+    // so we compute the clipped (expanded) region and keep track of
+    // the extent beyond the image
+    int unclipped_height = y2-y1+1;
+    int unclipped_width = x2-x1+1;
+    int pad_x1 = std::max(0, -x1);
+    int pad_y1 = std::max(0, -y1);
+    int pad_x2 = std::max(0, x2 - cv_img.cols + 1);
+    int pad_y2 = std::max(0, y2 - cv_img.rows + 1);
+    // clip bounds
+    x1 = x1 + pad_x1;
+    x2 = x2 - pad_x2;
+    y1 = y1 + pad_y1;
+    y2 = y2 - pad_y2;
+    CHECK_GT(x1, -1);
+    CHECK_GT(y1, -1);
+    CHECK_LT(x2, cv_img.cols);
+    CHECK_LT(y2, cv_img.rows);
+
+    int clipped_height = y2-y1+1;
+    int clipped_width = x2-x1+1;
+
+    // scale factors that would be used to warp the unclipped
+    // expanded region
+    Dtype scale_x =
+        static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_width);
+    Dtype scale_y =
+        static_cast<Dtype>(crop_size)/static_cast<Dtype>(unclipped_height);
+
+    // size to warp the clipped expanded region to
+    cv_crop_size.width =
+        static_cast<int>(round(static_cast<Dtype>(clipped_width)*scale_x));
+    cv_crop_size.height =
+        static_cast<int>(round(static_cast<Dtype>(clipped_height)*scale_y));
+    pad_x1 = static_cast<int>(round(static_cast<Dtype>(pad_x1)*scale_x));
+    pad_x2 = static_cast<int>(round(static_cast<Dtype>(pad_x2)*scale_x));
+    pad_y1 = static_cast<int>(round(static_cast<Dtype>(pad_y1)*scale_y));
+    pad_y2 = static_cast<int>(round(static_cast<Dtype>(pad_y2)*scale_y));
+
+    pad_h = pad_y1;
+    // if we're mirroring, we mirror the padding too (to be pedantic)
+    if (do_mirror) {
+      pad_w = pad_x2;
+    } else {
+      pad_w = pad_x1;
+    }
 
-      item_id++;
+    // ensure that the warped, clipped region plus the padding fits in the
+    // crop_size x crop_size image (it might not due to rounding)
+    if (pad_h + cv_crop_size.height > crop_size) {
+      cv_crop_size.height = crop_size - pad_h;
+    }
+    if (pad_w + cv_crop_size.width > crop_size) {
+      cv_crop_size.width = crop_size - pad_w;
+    }
+  }
+
+  // The image may be shared with other windows and the cache: warp the
+  // window into a new image rather than in place.
+  cv::Rect roi(x1, y1, x2-x1+1, y2-y1+1);
+  cv::Mat cv_cropped_img;
+  cv::resize(cv_img(roi), cv_cropped_img,
+      cv_crop_size, 0, 0, cv::INTER_LINEAR);
+
+  // horizontal flip at random
+  if (do_mirror) {
+    cv::flip(cv_cropped_img, cv_cropped_img, 1);
+  }
+
+  // copy the warped window into top_data
+  for (int c = 0; c < channels; ++c) {
+    const Dtype mean_value = num_mean_values == 0 ? Dtype(0)
+        : this->transform_param_.mean_value(num_mean_values == 1 ? 0 : c);
+    for (int h = 0; h < cv_cropped_img.rows; ++h) {
+      for (int w = 0; w < cv_cropped_img.cols; ++w) {
+        Dtype pixel =
+            static_cast<Dtype>(cv_cropped_img.at<cv::Vec3b>(h, w)[c]);
+        Dtype pixel_mean = num_mean_values ? mean_value
+            : mean[(c * mean_height + h + mean_off + pad_h)
+                   * mean_width + w + mean_off + pad_w];
+
+        top_data[((item_id * channels + c) * crop_size + h + pad_h)
+                 * crop_size + w + pad_w]
+            = (pixel - pixel_mean) * scale;
+      }
     }
   }
 }
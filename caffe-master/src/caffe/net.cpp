@@ -215,6 +215,9 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   for (size_t layer_id = 0; layer_id < layer_names_.size(); ++layer_id) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
+  if (param.reuse_blob_memory()) {
+    ReuseBlobMemory(param);
+  }
   GetLearningRateAndWeightDecay();
   LOG(INFO) << "Network initialization done.";
   LOG(INFO) << "Memory required for data: " << memory_used_ * sizeof(Dtype);
@@ -222,6 +225,175 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   debug_info_ = false;
 }
 
+// Returns the root of the group of blob_id in the forest groups.
+static int BlobGroup(const vector<int>& groups, int blob_id) {
+  while (groups[blob_id] != blob_id) {
+    blob_id = groups[blob_id];
+  }
+  return blob_id;
+}
+
+template <typename Dtype>
+void Net<Dtype>::ReuseBlobMemory(const NetParameter& param) {
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (layer_need_backward_[layer_id]) {
+      LOG(INFO) << "Not reusing blob memory: " << layer_names_[layer_id]
+          << " needs backward computation.";
+      return;
+    }
+  }
+  // Group the blobs that have to stay in the same memory: the ones backed by
+  // the same SyncedMemory already, and the tops of the layers that share the
+  // data of their bottom in Forward with it.
+  const int num_blobs = blobs_.size();
+  vector<int> groups(num_blobs);
+  vector<bool> keep(num_blobs, false);
+  map<SyncedMemory*, int> memory_blobs;
+  map<SyncedMemory*, int> memory_owners;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    groups[blob_id] = blob_id;
+    if (!blobs_[blob_id]->count()) {
+      keep[blob_id] = true;
+      continue;
+    }
+    SyncedMemory* memory = blobs_[blob_id]->data().get();
+    if (memory_owners.count(memory)) {
+      groups[blob_id] = memory_owners[memory];
+    } else {
+      memory_owners[memory] = blob_id;
+    }
+    ++memory_blobs[memory];
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (!layers_[layer_id]->SharesBottomData()) {
+      continue;
+    }
+    const int bottom_group = BlobGroup(groups, bottom_id_vecs_[layer_id][0]);
+    for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+      const int top_group = BlobGroup(groups, top_id_vecs_[layer_id][top_id]);
+      if (top_group != bottom_group) {
+        groups[top_group] = bottom_group;
+      }
+    }
+  }
+  // Keep the inputs and outputs of the net, the blobs asked for, the tops of
+  // the layers without bottoms, which may fill them only once or swap them
+  // with prefetched ones, and the blobs whose memory also backs blobs out of
+  // the net.
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    keep[net_input_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    keep[net_output_blob_indices_[i]] = true;
+  }
+  for (int i = 0; i < param.keep_blob_size(); ++i) {
+    CHECK(has_blob(param.keep_blob(i))) << "Unknown blob to keep "
+        << param.keep_blob(i);
+    keep[blob_names_index_[param.keep_blob(i)]] = true;
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    if (bottom_id_vecs_[layer_id].empty()) {
+      for (int top_id = 0; top_id < top_id_vecs_[layer_id].size(); ++top_id) {
+        keep[top_id_vecs_[layer_id][top_id]] = true;
+      }
+    }
+  }
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (blobs_[blob_id]->count()) {
+      const shared_ptr<SyncedMemory>& memory = blobs_[blob_id]->data();
+      if (memory.use_count() > memory_blobs[memory.get()]) {
+        keep[blob_id] = true;
+      }
+    }
+  }
+  // The lifetime of each group spans from the first layer writing one of its
+  // blobs to the last layer reading or writing one; its memory is that of its
+  // largest blob.
+  vector<int> first_layer(num_blobs, layers_.size());
+  vector<int> last_layer(num_blobs, -1);
+  vector<size_t> sizes(num_blobs, 0);
+  vector<bool> keep_group(num_blobs, false);
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const int group = BlobGroup(groups, blob_id);
+    keep_group[group] = keep_group[group] || keep[blob_id];
+    if (blobs_[blob_id]->count()) {
+      sizes[group] = std::max(sizes[group], blobs_[blob_id]->data()->size());
+    }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int group = BlobGroup(groups, bottom_id_vecs_[layer_id][i]);
+      last_layer[group] = std::max(last_layer[group], layer_id);
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int group = BlobGroup(groups, top_id_vecs_[layer_id][i]);
+      first_layer[group] = std::min(first_layer[group], layer_id);
+      last_layer[group] = std::max(last_layer[group], layer_id);
+    }
+  }
+  // Going through the groups in the order they are written, give each one the
+  // free memory closest to its size, growing the largest one if none is large
+  // enough, or new memory if none is free.
+  vector<pair<int, int> > order;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    if (BlobGroup(groups, blob_id) == blob_id && !keep_group[blob_id] &&
+        sizes[blob_id]) {
+      order.push_back(std::make_pair(first_layer[blob_id], blob_id));
+    }
+  }
+  std::sort(order.begin(), order.end());
+  vector<size_t> memory_sizes;
+  vector<int> memory_free_after;
+  vector<int> group_memory(num_blobs, -1);
+  size_t shared_size = 0;
+  for (int i = 0; i < order.size(); ++i) {
+    const int group = order[i].second;
+    int best = -1;
+    for (int m = 0; m < memory_sizes.size(); ++m) {
+      if (memory_free_after[m] >= first_layer[group]) {
+        continue;
+      }
+      if (best < 0) {
+        best = m;
+      } else if (memory_sizes[best] < sizes[group]) {
+        if (memory_sizes[m] > memory_sizes[best]) {
+          best = m;
+        }
+      } else if (memory_sizes[m] >= sizes[group] &&
+                 memory_sizes[m] < memory_sizes[best]) {
+        best = m;
+      }
+    }
+    if (best < 0) {
+      best = memory_sizes.size();
+      memory_sizes.push_back(0);
+      memory_free_after.push_back(-1);
+    }
+    memory_sizes[best] = std::max(memory_sizes[best], sizes[group]);
+    memory_free_after[best] = last_layer[group];
+    group_memory[group] = best;
+    shared_size += sizes[group];
+  }
+  vector<shared_ptr<SyncedMemory> > memories(memory_sizes.size());
+  size_t reused_size = 0;
+  for (int m = 0; m < memory_sizes.size(); ++m) {
+    memories[m].reset(new SyncedMemory(memory_sizes[m]));
+    reused_size += memory_sizes[m];
+  }
+  int num_shared_blobs = 0;
+  for (int blob_id = 0; blob_id < num_blobs; ++blob_id) {
+    const int memory = group_memory[BlobGroup(groups, blob_id)];
+    if (memory >= 0) {
+      blobs_[blob_id]->ShareDataMemory(memories[memory]);
+      ++num_shared_blobs;
+    }
+  }
+  memory_used_ -= (shared_size - reused_size) / sizeof(Dtype);
+  LOG(INFO) << "Reusing blob memory: " << num_shared_blobs << " blobs share "
+      << memories.size() << " buffers of " << reused_size << " bytes instead "
+      << "of " << shared_size << " bytes.";
+}
+
 template <typename Dtype>
 void Net<Dtype>::FilterNet(const NetParameter& param,
     NetParameter* param_filtered) {
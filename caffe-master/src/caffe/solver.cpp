@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 
+#include "caffe/data_layers.hpp"
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/solver.hpp"
@@ -172,16 +173,19 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   // For a network that is trained by the solver, no bottom or top vecs
   // should be given, and we will just provide dummy vecs.
   vector<Blob<Dtype>*> bottom_vec;
+  ResetDataStarvation();
   for (; iter_ < param_.max_iter(); ++iter_) {
     // Save a snapshot if needed.
     if (param_.snapshot() && iter_ > start_iter &&
         iter_ % param_.snapshot() == 0) {
       Snapshot();
+      ResetDataStarvation();
     }
 
     if (param_.test_interval() && iter_ % param_.test_interval() == 0
         && (iter_ > 0 || param_.test_initialization())) {
       TestAll();
+      ResetDataStarvation();
     }
 
     const bool display = param_.display() && iter_ % param_.display() == 0;
@@ -208,6 +212,7 @@ void Solver<Dtype>::Solve(const char* resume_file) {
               << result_vec[k] << loss_msg_stream.str();
         }
       }
+      DisplayDataStarvation();
     }
 
     ComputeUpdateValue();
@@ -234,6 +239,46 @@ void Solver<Dtype>::Solve(const char* resume_file) {
 }
 
 
+template <typename Dtype>
+void Solver<Dtype>::DisplayDataStarvation() {
+  const double interval = display_timer_.MilliSeconds();
+  display_timer_.Start();
+  double wait_time = 0;
+  double idle_time = 0;
+  int num_data_layers = 0;
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    BasePrefetchingDataLayer<Dtype>* data_layer =
+        dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layers[i].get());
+    if (!data_layer) {
+      continue;
+    }
+    wait_time += data_layer->forward_wait_time();
+    idle_time += data_layer->prefetch_idle_time();
+    data_layer->ResetPrefetchTimes();
+    ++num_data_layers;
+  }
+  if (num_data_layers == 0 || interval <= 0) {
+    return;
+  }
+  LOG(INFO) << "    Data starvation: " << 100 * wait_time / interval
+      << "% of the time (prefetch threads idle "
+      << 100 * idle_time / num_data_layers / interval << "%)";
+}
+
+template <typename Dtype>
+void Solver<Dtype>::ResetDataStarvation() {
+  display_timer_.Start();
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    BasePrefetchingDataLayer<Dtype>* data_layer =
+        dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layers[i].get());
+    if (data_layer) {
+      data_layer->ResetPrefetchTimes();
+    }
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
   for (int test_net_id = 0; test_net_id < test_nets_.size(); ++test_net_id) {
@@ -254,6 +299,17 @@ void Solver<Dtype>::Test(const int test_net_id) {
   vector<int> test_score_output_id;
   vector<Blob<Dtype>*> bottom_vec;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
+  // Start the streaming metrics of the test net over for this pass.
+  vector<StreamingMetrics*> metrics;
+  vector<string> metrics_layer_names;
+  for (int i = 0; i < test_net->layers().size(); ++i) {
+    StreamingMetrics* layer_metrics = test_net->layers()[i]->metrics();
+    if (layer_metrics) {
+      layer_metrics->Reset();
+      metrics.push_back(layer_metrics);
+      metrics_layer_names.push_back(test_net->layer_names()[i]);
+    }
+  }
   Dtype loss = 0;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
     Dtype iter_loss;
@@ -298,6 +354,20 @@ void Solver<Dtype>::Test(const int test_net_id) {
     LOG(INFO) << "    Test net output #" << i << ": " << output_name << " = "
         << mean_score << loss_msg_stream.str();
   }
+  for (int i = 0; i < metrics.size(); ++i) {
+    LOG(INFO) << "    Test net metrics of " << metrics_layer_names[i]
+        << ": AUC = " << metrics[i]->AUC()
+        << ", average precision = " << metrics[i]->AveragePrecision()
+        << ", precision = " << metrics[i]->Precision()
+        << ", recall = " << metrics[i]->Recall()
+        << " (" << metrics[i]->num_positives() << " positives, "
+        << metrics[i]->num_negatives() << " negatives)";
+    if (metrics[i]->num_bags()) {
+      LOG(INFO) << "    Test net metrics of " << metrics_layer_names[i]
+          << ": bag accuracy = " << metrics[i]->BagAccuracy()
+          << " (" << metrics[i]->num_bags() << " bags)";
+    }
+  }
   Caffe::set_phase(Caffe::TRAIN);
 }
 
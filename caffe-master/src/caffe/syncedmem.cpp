@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstring>
 
 #include "caffe/common.hpp"
@@ -108,6 +109,14 @@ void* SyncedMemory::mutable_gpu_data() {
 #endif
 }
 
+void SyncedMemory::swap(SyncedMemory* other) {
+  CHECK(other);
+  CHECK_EQ(size_, other->size_) << "Can only swap memory of the same size";
+  std::swap(cpu_ptr_, other->cpu_ptr_);
+  std::swap(gpu_ptr_, other->gpu_ptr_);
+  std::swap(head_, other->head_);
+  std::swap(own_cpu_data_, other->own_cpu_data_);
+}
 
 }  // namespace caffe
 
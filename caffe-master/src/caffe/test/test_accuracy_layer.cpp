@@ -8,6 +8,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/rng.hpp"
 #include "caffe/vision_layers.hpp"
 
@@ -137,4 +138,57 @@ TYPED_TEST(AccuracyLayerTest, TestForwardCPUTopK) {
               num_correct_labels / 100.0, 1e-4);
 }
 
+TYPED_TEST(AccuracyLayerTest, TestSemiAccuracyForwardCPU) {
+  // A right positive, a wrong negative, a right bag of two items whose best
+  // one is positive, then a wrong bag.
+  Blob<TypeParam> data(6, 1, 1, 1);
+  Blob<TypeParam> label(6, 1, 1, 1);
+  const TypeParam scores[] = {2, 1, -3, 0.5, -1, -2};
+  const TypeParam labels[] = {-1, -2, 4, 4, 5, 5};
+  caffe_copy(6, scores, data.mutable_cpu_data());
+  caffe_copy(6, labels, label.mutable_cpu_data());
+  vector<Blob<TypeParam>*> bottom_vec;
+  bottom_vec.push_back(&data);
+  bottom_vec.push_back(&label);
+  LayerParameter layer_param;
+  Caffe::set_mode(Caffe::CPU);
+  SemiAccuracyLayer<TypeParam> layer(layer_param);
+  layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+  layer.Forward(bottom_vec, &(this->blob_top_vec_));
+  EXPECT_NEAR(this->blob_top_->data_at(0, 0, 0, 0), 0.5, 1e-4);
+}
+
+TYPED_TEST(AccuracyLayerTest, TestSemiAccuracyStreamingMetricsCPU) {
+  Blob<TypeParam> data(6, 1, 1, 1);
+  Blob<TypeParam> label(6, 1, 1, 1);
+  const TypeParam scores[] = {2, 1, -3, 0.5, -1, -2};
+  const TypeParam labels[] = {-1, -2, 4, 4, 5, 5};
+  caffe_copy(6, scores, data.mutable_cpu_data());
+  caffe_copy(6, labels, label.mutable_cpu_data());
+  vector<Blob<TypeParam>*> bottom_vec;
+  bottom_vec.push_back(&data);
+  bottom_vec.push_back(&label);
+  LayerParameter layer_param;
+  layer_param.mutable_semi_accuracy_param()->set_streaming_metrics(true);
+  Caffe::set_mode(Caffe::CPU);
+  SemiAccuracyLayer<TypeParam> layer(layer_param);
+  layer.SetUp(bottom_vec, &(this->blob_top_vec_));
+  ASSERT_TRUE(layer.metrics());
+  // The metrics accumulate over the batches of TEST only.
+  Caffe::set_phase(Caffe::TRAIN);
+  layer.Forward(bottom_vec, &(this->blob_top_vec_));
+  EXPECT_EQ(0, layer.metrics()->num_positives());
+  Caffe::set_phase(Caffe::TEST);
+  layer.Forward(bottom_vec, &(this->blob_top_vec_));
+  layer.Forward(bottom_vec, &(this->blob_top_vec_));
+  Caffe::set_phase(Caffe::TRAIN);
+  EXPECT_EQ(2, layer.metrics()->num_positives());
+  EXPECT_EQ(2, layer.metrics()->num_negatives());
+  EXPECT_EQ(4, layer.metrics()->num_bags());
+  EXPECT_NEAR(1, layer.metrics()->AUC(), 1e-4);
+  EXPECT_NEAR(0.5, layer.metrics()->Precision(), 1e-4);
+  EXPECT_NEAR(1, layer.metrics()->Recall(), 1e-4);
+  EXPECT_NEAR(0.5, layer.metrics()->BagAccuracy(), 1e-4);
+}
+
 }  // namespace caffe
@@ -0,0 +1,130 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/bag_sampler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class BagSamplerTest : public ::testing::Test {
+ protected:
+  BagSamplerTest() : batch_size_(10) {
+    param_.set_positives(2);
+    param_.set_negatives(2);
+    // 4 positives, 4 negatives, then bags of 3, 2 and 4 records.
+    const int labels[] = {-1, -1, -1, -1, -2, -2, -2, -2,
+                          10, 10, 10, 11, 11, 12, 12, 12, 12};
+    labels_.assign(labels, labels + sizeof(labels) / sizeof(labels[0]));
+  }
+
+  // Checks that batch holds at least its quotas of positives then negatives,
+  // then whole bags, each of them once, and returns the labels of its bags.
+  vector<int> CheckBatch(const vector<int>& batch) {
+    EXPECT_EQ(batch_size_, batch.size());
+    int i = 0;
+    for (; i < batch.size() && labels_[batch[i]] == -1; ++i) {}
+    EXPECT_GE(i, param_.positives());
+    const int positives = i;
+    for (; i < batch.size() && labels_[batch[i]] == -2; ++i) {}
+    EXPECT_GE(i - positives, param_.negatives());
+    vector<int> bags;
+    while (i < batch.size()) {
+      const int label = labels_[batch[i]];
+      EXPECT_GE(label, 0);
+      for (int j = 0; j < bags.size(); ++j) {
+        EXPECT_NE(label, bags[j]);
+      }
+      bags.push_back(label);
+      // The bag starts at its first record, and its records follow in order.
+      int record = batch[i];
+      EXPECT_TRUE(record == 0 || labels_[record - 1] != label);
+      for (; i < batch.size() && labels_[batch[i]] == label; ++i, ++record) {
+        EXPECT_EQ(record, batch[i]);
+      }
+      EXPECT_TRUE(record == labels_.size() || labels_[record] != label);
+    }
+    return bags;
+  }
+
+  BagSamplingParameter param_;
+  const int batch_size_;
+  vector<int> labels_;
+};
+
+TEST_F(BagSamplerTest, TestKeyOrder) {
+  BagSampler sampler(param_, batch_size_, labels_, false);
+  EXPECT_EQ(3, sampler.num_bags());
+  EXPECT_EQ(4, sampler.num_positives());
+  EXPECT_EQ(4, sampler.num_negatives());
+  // The bags of 3 and 2 records fit in the 6 slots left by the quotas, and
+  // the last slot goes to a positive.
+  vector<int> batch;
+  sampler.NextBatch(&batch);
+  const int expected[] = {0, 1, 2, 4, 5, 8, 9, 10, 11, 12};
+  for (int i = 0; i < batch_size_; ++i) {
+    EXPECT_EQ(expected[i], batch[i]);
+  }
+  CheckBatch(batch);
+  // The next batch starts with the bag of 4 records.
+  batch.clear();
+  sampler.NextBatch(&batch);
+  EXPECT_EQ(12, CheckBatch(batch)[0]);
+}
+
+TEST_F(BagSamplerTest, TestShuffle) {
+  Caffe::set_random_seed(1701);
+  BagSampler sampler(param_, batch_size_, labels_, true);
+  vector<int> bag_counts(3, 0);
+  for (int iter = 0; iter < 30; ++iter) {
+    vector<int> batch;
+    sampler.NextBatch(&batch);
+    const vector<int> bags = CheckBatch(batch);
+    EXPECT_FALSE(bags.empty());
+    for (int i = 0; i < bags.size(); ++i) {
+      ++bag_counts[bags[i] - 10];
+    }
+  }
+  for (int i = 0; i < bag_counts.size(); ++i) {
+    EXPECT_GT(bag_counts[i], 0);
+  }
+}
+
+TEST_F(BagSamplerTest, TestBagsOfTheSameLabel) {
+  // Two bags labelled 10, apart in key order, would read as one bag in the
+  // same batch.
+  const int labels[] = {10, 10, -1, -2, 10, 10, -1, -2};
+  labels_.assign(labels, labels + sizeof(labels) / sizeof(labels[0]));
+  param_.set_positives(1);
+  param_.set_negatives(1);
+  BagSampler sampler(param_, batch_size_, labels_, false);
+  EXPECT_EQ(2, sampler.num_bags());
+  for (int iter = 0; iter < 4; ++iter) {
+    vector<int> batch;
+    sampler.NextBatch(&batch);
+    EXPECT_EQ(1, CheckBatch(batch).size());
+  }
+}
+
+TEST_F(BagSamplerTest, TestBagsOnly) {
+  // Without positives or negatives, 5 bags of 2 records fill each batch.
+  const int labels[] = {10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15,
+                        16, 16, 17, 17};
+  labels_.assign(labels, labels + sizeof(labels) / sizeof(labels[0]));
+  param_.set_positives(0);
+  param_.set_negatives(0);
+  Caffe::set_random_seed(1701);
+  BagSampler sampler(param_, batch_size_, labels_, true);
+  EXPECT_EQ(8, sampler.num_bags());
+  EXPECT_EQ(0, sampler.num_positives());
+  EXPECT_EQ(0, sampler.num_negatives());
+  for (int iter = 0; iter < 20; ++iter) {
+    vector<int> batch;
+    sampler.NextBatch(&batch);
+    EXPECT_EQ(5, CheckBatch(batch).size());
+  }
+}
+
+}  // namespace caffe
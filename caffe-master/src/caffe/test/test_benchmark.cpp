@@ -85,4 +85,20 @@ TYPED_TEST(BenchmarkTest, TestTimerSeconds) {
   EXPECT_TRUE(timer.has_run_at_least_once());
 }
 
+TYPED_TEST(BenchmarkTest, TestCPUTimerMilliSeconds) {
+  CPUTimer timer;
+  EXPECT_EQ(timer.MilliSeconds(), 0);
+  EXPECT_FALSE(timer.running());
+  EXPECT_FALSE(timer.has_run_at_least_once());
+  timer.Start();
+  usleep(3 * 1000);
+  EXPECT_GE(timer.MilliSeconds(), 3);
+  EXPECT_LE(timer.MilliSeconds(), 13);
+  EXPECT_FALSE(timer.running());
+  EXPECT_TRUE(timer.has_run_at_least_once());
+  // Restarting the timer times a new interval.
+  timer.Start();
+  EXPECT_LE(timer.MilliSeconds(), 3);
+}
+
 }  // namespace caffe
@@ -54,4 +54,23 @@ TYPED_TEST(BlobSimpleTest, TestReshape) {
   EXPECT_EQ(this->blob_->count(), 120);
 }
 
+TYPED_TEST(BlobSimpleTest, TestSwapData) {
+  typedef TypeParam Dtype;
+  Blob<Dtype> other(2, 3, 4, 5);
+  Blob<Dtype> sharer(2, 3, 4, 5);
+  sharer.ShareData(*this->blob_preshaped_);
+  caffe_set(other.count(), Dtype(1), other.mutable_cpu_data());
+  caffe_set(this->blob_preshaped_->count(), Dtype(2),
+      this->blob_preshaped_->mutable_cpu_data());
+  const Dtype* other_data = other.cpu_data();
+  this->blob_preshaped_->SwapData(&other);
+  // The buffers are exchanged, not copied.
+  EXPECT_EQ(other_data, this->blob_preshaped_->cpu_data());
+  EXPECT_EQ(other_data, sharer.cpu_data());
+  for (int i = 0; i < other.count(); ++i) {
+    EXPECT_EQ(1, this->blob_preshaped_->cpu_data()[i]);
+    EXPECT_EQ(2, other.cpu_data()[i]);
+  }
+}
+
 }  // namespace caffe
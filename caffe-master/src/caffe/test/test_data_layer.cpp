@@ -1,3 +1,6 @@
+#include <unistd.h>  // for usleep
+
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -8,7 +11,9 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/hard_negative_cache.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/raw_file.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -64,6 +69,33 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     delete db;
   }
 
+  // Fill num_shards LevelDBs named filename_ + "_shard<k>" with 3 records
+  // each, labelled and filled with 10 * k + i.
+  void FillLevelDBShards(const int num_shards) {
+    backend_ = DataParameter_DB_LEVELDB;
+    for (int k = 0; k < num_shards; ++k) {
+      stringstream shard_name;
+      shard_name << *filename_ << "_shard" << k;
+      leveldb::DB* db;
+      leveldb::Options options;
+      options.error_if_exists = true;
+      options.create_if_missing = true;
+      CHECK(leveldb::DB::Open(options, shard_name.str(), &db).ok());
+      for (int i = 0; i < 3; ++i) {
+        Datum datum;
+        datum.set_label(10 * k + i);
+        datum.set_channels(2);
+        datum.set_height(3);
+        datum.set_width(4);
+        datum.mutable_data()->assign(24, static_cast<char>(10 * k + i));
+        stringstream ss;
+        ss << i;
+        db->Put(leveldb::WriteOptions(), ss.str(), datum.SerializeAsString());
+      }
+      delete db;
+    }
+  }
+
   // Fill the LMDB with data: unique_pixels has same meaning as in FillLevelDB.
   void FillLMDB(const bool unique_pixels) {
     backend_ = DataParameter_DB_LMDB;
@@ -112,13 +144,200 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     mdb_env_close(env);
   }
 
-  void TestRead() {
+  // Fill a raw file with data: unique_pixels has same meaning as in
+  // FillLevelDB. The records hold float values if float_data.
+  void FillRaw(const bool unique_pixels, const bool float_data = false) {
+    backend_ = DataParameter_DB_RAW;
+    LOG(INFO) << "Using temporary raw file " << *filename_;
+    RawFileWriter writer;
+    writer.Open(*filename_);
+    for (int i = 0; i < 5; ++i) {
+      Datum datum;
+      datum.set_label(i);
+      datum.set_channels(2);
+      datum.set_height(3);
+      datum.set_width(4);
+      for (int j = 0; j < 24; ++j) {
+        int datum_value = unique_pixels ? j : i;
+        if (float_data) {
+          datum.add_float_data(datum_value);
+        } else {
+          datum.mutable_data()->push_back(static_cast<uint8_t>(datum_value));
+        }
+      }
+      writer.Write(datum);
+    }
+    writer.Close();
+  }
+
+  // Fill the LevelDB with the same image as encoded datums with labels 0-4,
+  // and return its decoded version in raw_datum.
+  void FillEncodedLevelDB(Datum* raw_datum) {
+    backend_ = DataParameter_DB_LEVELDB;
+    const string image = EXAMPLES_SOURCE_DIR "images/cat.jpg";
+    CHECK(ReadImageToDatum(image, 0, raw_datum));
+    leveldb::DB* db;
+    leveldb::Options options;
+    options.error_if_exists = true;
+    options.create_if_missing = true;
+    CHECK(leveldb::DB::Open(options, filename_->c_str(), &db).ok());
+    for (int i = 0; i < 5; ++i) {
+      Datum datum;
+      CHECK(ReadEncodedImageToDatum(image, i, 0, 0, true, &datum));
+      CHECK(datum.encoded());
+      stringstream ss;
+      ss << i;
+      db->Put(leveldb::WriteOptions(), ss.str(), datum.SerializeAsString());
+    }
+    delete db;
+  }
+
+  void TestReadEncoded(const Datum& raw_datum) {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_workers(2);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), 5);
+    EXPECT_EQ(blob_top_data_->channels(), raw_datum.channels());
+    EXPECT_EQ(blob_top_data_->height(), raw_datum.height());
+    EXPECT_EQ(blob_top_data_->width(), raw_datum.width());
+
+    layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    const string& pixels = raw_datum.data();
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+      const Dtype* data =
+          blob_top_data_->cpu_data() + blob_top_data_->offset(i);
+      for (int j = 0; j < pixels.size(); ++j) {
+        ASSERT_EQ(static_cast<uint8_t>(pixels[j]), data[j])
+            << "debug: i " << i << " j " << j;
+      }
+    }
+  }
+
+  // Reads 2 shards of 3 records (see FillLevelDBShards) in turn.
+  void TestReadShardsRoundRobin() {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(4);
+    data_param->set_source(*filename_ + "_shard*");
+    data_param->set_backend(backend_);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    int next_record[2] = {0, 0};
+    for (int iter = 0; iter < 3; ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+      for (int i = 0; i < 4; ++i) {
+        const int shard = i % 2;
+        const int expected_label = 10 * shard + next_record[shard];
+        next_record[shard] = (next_record[shard] + 1) % 3;
+        EXPECT_EQ(expected_label, blob_top_label_->cpu_data()[i])
+            << "debug: iter " << iter << " i " << i;
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(expected_label,
+              blob_top_data_->cpu_data()[blob_top_data_->offset(i) + j]);
+        }
+      }
+    }
+  }
+
+  // Reads 2 shards of 3 records (see FillLevelDBShards) in random order.
+  void TestReadShardsRandom() {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(4);
+    data_param->set_source(*filename_ + "_shard0");
+    data_param->add_shard(*filename_ + "_shard1");
+    data_param->set_backend(backend_);
+    data_param->set_shard_order(DataParameter_ShardOrder_RANDOM);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    // Each shard is still read in order.
+    int next_record[2] = {0, 0};
+    int num_read[2] = {0, 0};
+    for (int iter = 0; iter < 6; ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+      for (int i = 0; i < 4; ++i) {
+        const int label = blob_top_label_->cpu_data()[i];
+        const int shard = label / 10;
+        ASSERT_TRUE(shard == 0 || shard == 1) << "label " << label;
+        EXPECT_EQ(next_record[shard], label % 10);
+        next_record[shard] = (next_record[shard] + 1) % 3;
+        ++num_read[shard];
+      }
+    }
+    EXPECT_GT(num_read[0], 0);
+    EXPECT_GT(num_read[1], 0);
+  }
+
+  // Reads the 5 records in shuffled order, one epoch per batch.
+  void TestReadShuffle(const bool in_memory = false) {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    data_param->set_in_memory(in_memory);
+
+    vector<vector<int> > epochs;
+    Caffe::set_random_seed(seed_);
+    {
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+      for (int iter = 0; iter < 10; ++iter) {
+        layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+        vector<int> epoch;
+        for (int i = 0; i < 5; ++i) {
+          const int label = blob_top_label_->cpu_data()[i];
+          for (int j = 0; j < 24; ++j) {
+            EXPECT_EQ(label,
+                blob_top_data_->cpu_data()[blob_top_data_->offset(i) + j]);
+          }
+          epoch.push_back(label);
+        }
+        epochs.push_back(epoch);
+      }
+    }
+    // Each epoch reads every record once, in an order reshuffled each time.
+    bool reshuffled = false;
+    for (int iter = 0; iter < epochs.size(); ++iter) {
+      vector<int> sorted(epochs[iter]);
+      std::sort(sorted.begin(), sorted.end());
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, sorted[i]);
+      }
+      reshuffled |= (iter > 0 && epochs[iter] != epochs[iter - 1]);
+    }
+    EXPECT_TRUE(reshuffled);
+
+    // The same seed gives the same order.
+    Caffe::set_random_seed(seed_);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    for (int iter = 0; iter < epochs.size(); ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(epochs[iter][i], blob_top_label_->cpu_data()[i]);
+      }
+    }
+  }
+
+  void TestRead(const bool in_memory = false) {
     const Dtype scale = 3;
     LayerParameter param;
     DataParameter* data_param = param.mutable_data_param();
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_in_memory(in_memory);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -149,6 +368,155 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // The prefetch thread accounts for the time of each stage of the batches
+  // it loads, and Forward for the time it waits for them.
+  void TestPrefetchTimes() {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    }
+    EXPECT_GE(layer.forward_wait_time(), 0);
+    EXPECT_GE(layer.prefetch_idle_time(), 0);
+    layer.ResetPrefetchTimes();
+    EXPECT_EQ(0, layer.forward_wait_time());
+    EXPECT_EQ(0, layer.prefetch_idle_time());
+    layer.JoinPrefetchThread();
+    EXPECT_GE(layer.batches_loaded(), 10);
+    const map<string, double>& stage_times = layer.stage_times();
+    EXPECT_EQ(3, stage_times.size());
+    ASSERT_EQ(1, stage_times.count("read"));
+    ASSERT_EQ(1, stage_times.count("parse+decode"));
+    ASSERT_EQ(1, stage_times.count("transform"));
+    EXPECT_GE(stage_times.find("read")->second, 0);
+    EXPECT_GE(stage_times.find("parse+decode")->second, 0);
+    EXPECT_GE(stage_times.find("transform")->second, 0);
+  }
+
+  // The time the prefetch thread spent blocked on a full queue before the
+  // prefetch times were reset, e.g. during a test pass, does not count.
+  void TestResetPrefetchTimesWhileIdle() {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    // The prefetch thread fills the freed batch, then waits for another.
+    usleep(300 * 1000);
+    layer.ResetPrefetchTimes();
+    CPUTimer timer;
+    timer.Start();
+    // Go through every batch of the queue, including the one loaded after
+    // the thread waited.
+    for (int iter = 0; iter < 2 * data_param->prefetch(); ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+    }
+    EXPECT_LE(layer.prefetch_idle_time(), timer.MilliSeconds());
+  }
+
+  // Cached hard negatives replace replay_ratio of the negatives of the TRAIN
+  // batches, and leave the cache as they are replayed.
+  void TestReplayHardNegatives() {
+    backend_ = DataParameter_DB_LEVELDB;
+    leveldb::DB* db;
+    leveldb::Options options;
+    options.error_if_exists = true;
+    options.create_if_missing = true;
+    CHECK(leveldb::DB::Open(options, filename_->c_str(), &db).ok());
+    for (int i = 0; i < 5; ++i) {
+      Datum datum;
+      datum.set_label(-2);
+      datum.set_channels(2);
+      datum.set_height(3);
+      datum.set_width(4);
+      datum.mutable_data()->assign(24, static_cast<char>(i));
+      stringstream ss;
+      ss << i;
+      db->Put(leveldb::WriteOptions(), ss.str(), datum.SerializeAsString());
+    }
+    delete db;
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->mutable_hard_negatives()->set_cache("data_layer_test");
+    data_param->mutable_hard_negatives()->set_replay_ratio(0.4);
+    Caffe::set_phase(Caffe::TRAIN);
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    shared_ptr<HardNegativeCache<Dtype> > cache =
+        HardNegativeCache<Dtype>::Find("data_layer_test");
+    ASSERT_TRUE(cache.get());
+    // Cache the 3 negatives of a batch of pixels 100.
+    const vector<Dtype> data(5 * 24, Dtype(100));
+    const Dtype labels[] = {-1, -1, -2, -2, -2};
+    const Dtype losses[] = {0, 0, 1, 2, 3};
+    cache->Stage(&data[0], labels, 5);
+    cache->Update(losses, 5);
+    int replayed = 0;
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(-2, blob_top_label_->cpu_data()[i]);
+        if (blob_top_data_->cpu_data()[i * 24] == 100) {
+          // Two negatives of the five at most are replayed.
+          EXPECT_LT(i, 2);
+          ++replayed;
+        }
+      }
+    }
+    EXPECT_EQ(3, replayed);
+    EXPECT_EQ(0, cache->size());
+  }
+
+  // Batches that do not divide the database evenly must still come out of the
+  // prefetch queue in database order, wrapping around at the end.
+  void TestReadPrefetchOrder(const int prefetch, const int workers,
+      const bool in_memory = false) {
+    LayerParameter param;
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(2);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_prefetch(prefetch);
+    data_param->set_workers(workers);
+    data_param->set_in_memory(in_memory);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), 2);
+    EXPECT_EQ(blob_top_label_->num(), 2);
+    // Batches are swapped into the tops; blobs sharing their data, as e.g.
+    // split layers do, must still see every new batch.
+    Blob<Dtype> shared_data(2, 2, 3, 4);
+    shared_data.ShareData(*blob_top_data_);
+
+    int expected_label = 0;
+    for (int iter = 0; iter < 12; ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+      for (int i = 0; i < 2; ++i) {
+        EXPECT_EQ(expected_label, blob_top_label_->cpu_data()[i])
+            << "debug: iter " << iter << " i " << i;
+        for (int j = 0; j < 24; ++j) {
+          EXPECT_EQ(expected_label, blob_top_data_->cpu_data()[i * 24 + j]);
+          EXPECT_EQ(expected_label, shared_data.cpu_data()[i * 24 + j]);
+        }
+        expected_label = (expected_label + 1) % 5;
+      }
+    }
+  }
+
   void TestReadCrop() {
     const Dtype scale = 3;
     LayerParameter param;
@@ -202,12 +570,13 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
-  void TestReadCropTrainSequenceSeeded() {
+  void TestReadCropTrainSequenceSeeded(const int workers) {
     LayerParameter param;
     DataParameter* data_param = param.mutable_data_param();
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_workers(workers);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -331,6 +700,65 @@ TYPED_TEST(DataLayerTest, TestReadLevelDB) {
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestReadPrefetchOrderLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  this->TestReadPrefetchOrder(1, 1);
+}
+
+TYPED_TEST(DataLayerTest, TestReadDeepPrefetchOrderLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  this->TestReadPrefetchOrder(8, 1);
+}
+
+// More workers than items per batch: some workers get an empty slice.
+TYPED_TEST(DataLayerTest, TestReadWorkersOrderLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  this->TestReadPrefetchOrder(3, 3);
+}
+
+TYPED_TEST(DataLayerTest, TestReadEncodedLevelDB) {
+  Datum raw_datum;
+  this->FillEncodedLevelDB(&raw_datum);
+  this->TestReadEncoded(raw_datum);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardsRoundRobinLevelDB) {
+  this->FillLevelDBShards(2);
+  this->TestReadShardsRoundRobin();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShardsRandomLevelDB) {
+  this->FillLevelDBShards(2);
+  this->TestReadShardsRandom();
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  this->TestReadShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestReadInMemoryLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  this->TestRead(true);
+}
+
+TYPED_TEST(DataLayerTest, TestReadInMemoryWorkersOrderLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  this->TestReadPrefetchOrder(3, 3, true);
+}
+
+TYPED_TEST(DataLayerTest, TestReadInMemoryShuffleLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLevelDB(unique_pixels);
+  this->TestReadShuffle(true);
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLevelDB) {
   Caffe::set_phase(Caffe::TRAIN);
   const bool unique_pixels = true;  // all images the same; pixels different
@@ -344,7 +772,7 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededLevelDB) {
   Caffe::set_phase(Caffe::TRAIN);
   const bool unique_pixels = true;  // all images the same; pixels different
   this->FillLevelDB(unique_pixels);
-  this->TestReadCropTrainSequenceSeeded();
+  this->TestReadCropTrainSequenceSeeded(1);
 }
 
 // Test that the sequence of random crops differs across iterations when
@@ -363,12 +791,58 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
   this->TestReadCrop();
 }
 
+TYPED_TEST(DataLayerTest, TestReplayHardNegativesLevelDB) {
+  this->TestReplayHardNegatives();
+}
+
 TYPED_TEST(DataLayerTest, TestReadLMDB) {
   const bool unique_pixels = false;  // all pixels the same; images different
   this->FillLMDB(unique_pixels);
   this->TestRead();
 }
 
+TYPED_TEST(DataLayerTest, TestPrefetchTimesLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLMDB(unique_pixels);
+  this->TestPrefetchTimes();
+}
+
+TYPED_TEST(DataLayerTest, TestResetPrefetchTimesWhileIdleLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLMDB(unique_pixels);
+  this->TestResetPrefetchTimesWhileIdle();
+}
+
+TYPED_TEST(DataLayerTest, TestReadDeepPrefetchOrderLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLMDB(unique_pixels);
+  this->TestReadPrefetchOrder(8, 1);
+}
+
+TYPED_TEST(DataLayerTest, TestReadWorkersOrderLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLMDB(unique_pixels);
+  this->TestReadPrefetchOrder(3, 2);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLMDB(unique_pixels);
+  this->TestReadShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestReadInMemoryLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLMDB(unique_pixels);
+  this->TestRead(true);
+}
+
+TYPED_TEST(DataLayerTest, TestReadInMemoryShuffleLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillLMDB(unique_pixels);
+  this->TestReadShuffle(true);
+}
+
 TYPED_TEST(DataLayerTest, TestReadCropTrainLMDB) {
   Caffe::set_phase(Caffe::TRAIN);
   const bool unique_pixels = true;  // all images the same; pixels different
@@ -382,7 +856,15 @@ TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededLMDB) {
   Caffe::set_phase(Caffe::TRAIN);
   const bool unique_pixels = true;  // all images the same; pixels different
   this->FillLMDB(unique_pixels);
-  this->TestReadCropTrainSequenceSeeded();
+  this->TestReadCropTrainSequenceSeeded(1);
+}
+
+// Same with several transform workers, each having its own RNG.
+TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededWorkersLMDB) {
+  Caffe::set_phase(Caffe::TRAIN);
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->FillLMDB(unique_pixels);
+  this->TestReadCropTrainSequenceSeeded(3);
 }
 
 // Test that the sequence of random crops differs across iterations when
@@ -401,4 +883,51 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   this->TestReadCrop();
 }
 
+TYPED_TEST(DataLayerTest, TestReadRaw) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillRaw(unique_pixels);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestReadFloatRaw) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  const bool float_data = true;
+  this->FillRaw(unique_pixels, float_data);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestCloseRaw) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillRaw(unique_pixels);
+  RawFile file;
+  file.Open(*this->filename_, false);
+  EXPECT_EQ(5, file.size());
+  EXPECT_EQ(24, file.record_size());
+  EXPECT_EQ(3, file.label(3));
+  // A closed file holds no record.
+  file.Close();
+  EXPECT_EQ(0, file.size());
+  EXPECT_EQ(0, file.record_size());
+  EXPECT_TRUE(file.record(0) == NULL);
+}
+
+TYPED_TEST(DataLayerTest, TestReadWorkersOrderRaw) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillRaw(unique_pixels);
+  this->TestReadPrefetchOrder(3, 2);
+}
+
+TYPED_TEST(DataLayerTest, TestReadShuffleRaw) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->FillRaw(unique_pixels);
+  this->TestReadShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainRaw) {
+  Caffe::set_phase(Caffe::TRAIN);
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->FillRaw(unique_pixels);
+  this->TestReadCrop();
+}
+
 }  // namespace caffe
@@ -0,0 +1,157 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/math_functions.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class DataTransformTest : public ::testing::Test {
+ protected:
+  DataTransformTest() : channels_(3), height_(33), width_(33) {}
+
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    datum_.set_channels(channels_);
+    datum_.set_height(height_);
+    datum_.set_width(width_);
+    datum_.set_label(0);
+    string* data = datum_.mutable_data();
+    const int size = channels_ * height_ * width_;
+    for (int j = 0; j < size; ++j) {
+      data->push_back(static_cast<char>(caffe_rng_rand() % 256));
+      mean_.push_back(static_cast<Dtype>(caffe_rng_rand() % 128));
+    }
+  }
+
+  // The straightforward transformation of the datum, with a crop at
+  // (h_off, w_off) and a per-channel mean if mean_values is not empty.
+  void Reference(const int crop_size, const int h_off, const int w_off,
+      const bool mirror, const vector<Dtype>& mean_values, const Dtype scale,
+      vector<Dtype>* result) {
+    const int out_height = crop_size ? crop_size : height_;
+    const int out_width = crop_size ? crop_size : width_;
+    result->resize(channels_ * out_height * out_width);
+    for (int c = 0; c < channels_; ++c) {
+      for (int h = 0; h < out_height; ++h) {
+        for (int w = 0; w < out_width; ++w) {
+          const int data_index = (c * height_ + h + h_off) * width_ + w + w_off;
+          const Dtype pixel = static_cast<uint8_t>(datum_.data()[data_index]);
+          const Dtype mean = mean_values.size() ?
+              mean_values[mean_values.size() == 1 ? 0 : c] : mean_[data_index];
+          const int out_w = mirror ? out_width - 1 - w : w;
+          (*result)[(c * out_height + h) * out_width + out_w] =
+              (pixel - mean) * scale;
+        }
+      }
+    }
+  }
+
+  void ExpectNear(const vector<Dtype>& expected, const Dtype* actual) {
+    for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_NEAR(expected[i], actual[i], 1e-4) << "debug: i " << i;
+    }
+  }
+
+  const int channels_;
+  const int height_;
+  const int width_;
+  Datum datum_;
+  vector<Dtype> mean_;
+};
+
+TYPED_TEST_CASE(DataTransformTest, TestDtypes);
+
+TYPED_TEST(DataTransformTest, TestCopyMeanFile) {
+  Caffe::set_phase(Caffe::TEST);
+  TransformationParameter param;
+  param.set_scale(0.5);
+  DataTransformer<TypeParam> transformer(param);
+  transformer.InitRand();
+  vector<TypeParam> expected;
+  this->Reference(0, 0, 0, false, vector<TypeParam>(), 0.5, &expected);
+  // Transform the second item of a batch of two.
+  vector<TypeParam> transformed(2 * expected.size());
+  transformer.Transform(1, this->datum_, &this->mean_[0], &transformed[0]);
+  this->ExpectNear(expected, &transformed[expected.size()]);
+}
+
+TYPED_TEST(DataTransformTest, TestCropCenterMeanValue) {
+  Caffe::set_phase(Caffe::TEST);
+  TransformationParameter param;
+  param.set_crop_size(21);
+  param.add_mean_value(100);
+  DataTransformer<TypeParam> transformer(param);
+  transformer.InitRand();
+  vector<TypeParam> expected;
+  this->Reference(21, 6, 6, false, vector<TypeParam>(1, 100), 1, &expected);
+  vector<TypeParam> transformed(expected.size());
+  // The mean image is ignored in favor of mean_value.
+  transformer.Transform(0, this->datum_, &this->mean_[0], &transformed[0]);
+  this->ExpectNear(expected, &transformed[0]);
+}
+
+TYPED_TEST(DataTransformTest, TestMirrorCropPerChannelMean) {
+  Caffe::set_phase(Caffe::TRAIN);
+  TransformationParameter param;
+  // One pixel smaller than the datum, so that the random offsets are 0.
+  param.set_crop_size(32);
+  param.set_mirror(true);
+  param.set_scale(0.25);
+  vector<TypeParam> mean_values;
+  for (int c = 0; c < this->channels_; ++c) {
+    param.add_mean_value(10 * (c + 1));
+    mean_values.push_back(10 * (c + 1));
+  }
+  DataTransformer<TypeParam> transformer(param);
+  transformer.InitRand();
+  vector<TypeParam> expected, expected_mirror;
+  this->Reference(32, 0, 0, false, mean_values, 0.25, &expected);
+  this->Reference(32, 0, 0, true, mean_values, 0.25, &expected_mirror);
+  vector<TypeParam> transformed(expected.size());
+  int num_mirrored = 0;
+  const int num_iter = 20;
+  for (int iter = 0; iter < num_iter; ++iter) {
+    transformer.Transform(0, this->datum_, NULL, &transformed[0]);
+    // The first output pixel tells whether the crop was mirrored.
+    if (transformed[0] == expected_mirror[0]) {
+      ++num_mirrored;
+      this->ExpectNear(expected_mirror, &transformed[0]);
+    } else {
+      this->ExpectNear(expected, &transformed[0]);
+    }
+  }
+  EXPECT_GT(num_mirrored, 0);
+  EXPECT_LT(num_mirrored, num_iter);
+}
+
+TYPED_TEST(DataTransformTest, TestFloatDataMeanValue) {
+  Caffe::set_phase(Caffe::TEST);
+  TransformationParameter param;
+  param.set_scale(2);
+  param.add_mean_value(1);
+  param.add_mean_value(2);
+  DataTransformer<TypeParam> transformer(param);
+  transformer.InitRand();
+  Datum datum;
+  datum.set_channels(2);
+  datum.set_height(1);
+  datum.set_width(3);
+  for (int j = 0; j < 6; ++j) {
+    datum.add_float_data(j);
+  }
+  TypeParam transformed[6];
+  transformer.Transform(0, datum, NULL, transformed);
+  for (int j = 0; j < 6; ++j) {
+    EXPECT_EQ((j - (j < 3 ? 1 : 2)) * 2, transformed[j]);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,68 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/datum_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class DatumCacheTest : public ::testing::Test {
+ protected:
+  // A datum of size uint8 pixels, all equal to value.
+  shared_ptr<const Datum> MakeDatum(const int size, const char value) {
+    shared_ptr<Datum> datum(new Datum());
+    datum->set_channels(1);
+    datum->set_height(1);
+    datum->set_width(size);
+    datum->set_data(string(size, value));
+    return datum;
+  }
+};
+
+TEST_F(DatumCacheTest, TestHitsAndMisses) {
+  DatumCache cache(1 << 20);
+  EXPECT_FALSE(cache.Get("a").get());
+  shared_ptr<const Datum> datum = MakeDatum(100, 1);
+  cache.Put("a", datum);
+  shared_ptr<const Datum> cached = cache.Get("a");
+  // The cached datum is shared, not copied.
+  EXPECT_EQ(datum.get(), cached.get());
+  EXPECT_FALSE(cache.Get("b").get());
+  EXPECT_EQ(1, cache.hits());
+  EXPECT_EQ(2, cache.misses());
+  EXPECT_EQ(1, cache.count());
+  EXPECT_GE(cache.size(), 100);
+}
+
+TEST_F(DatumCacheTest, TestEvictLeastRecentlyUsed) {
+  const int size = 1000;
+  // Room for 3 datums, but not 4.
+  DatumCache cache(3 * size + size / 2);
+  cache.Put("a", MakeDatum(size, 1));
+  cache.Put("b", MakeDatum(size, 2));
+  cache.Put("c", MakeDatum(size, 3));
+  EXPECT_EQ(3, cache.count());
+  // Using a makes b the least recently used.
+  EXPECT_TRUE(cache.Get("a").get());
+  cache.Put("d", MakeDatum(size, 4));
+  EXPECT_EQ(3, cache.count());
+  EXPECT_LE(cache.size(), cache.capacity());
+  EXPECT_FALSE(cache.Get("b").get());
+  EXPECT_EQ(1, cache.Get("a")->data()[0]);
+  EXPECT_EQ(3, cache.Get("c")->data()[0]);
+  EXPECT_EQ(4, cache.Get("d")->data()[0]);
+}
+
+TEST_F(DatumCacheTest, TestSkipLargerThanCapacity) {
+  DatumCache cache(100);
+  cache.Put("a", MakeDatum(1000, 1));
+  EXPECT_FALSE(cache.Get("a").get());
+  EXPECT_EQ(0, cache.count());
+  EXPECT_EQ(0, cache.size());
+}
+
+}  // namespace caffe
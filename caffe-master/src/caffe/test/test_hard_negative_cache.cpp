@@ -0,0 +1,87 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/hard_negative_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class HardNegativeCacheTest : public ::testing::Test {
+ protected:
+  HardNegativeCacheTest() : cache_(2, 3) {
+    // A positive, then three negatives; each item filled with its index.
+    const Dtype labels[] = {-1, -2, -2, -2};
+    labels_.assign(labels, labels + 4);
+    for (int i = 0; i < 4; ++i) {
+      data_.insert(data_.end(), 3, Dtype(i));
+    }
+  }
+
+  HardNegativeCache<Dtype> cache_;
+  vector<Dtype> labels_;
+  vector<Dtype> data_;
+};
+
+TYPED_TEST_CASE(HardNegativeCacheTest, TestDtypes);
+
+TYPED_TEST(HardNegativeCacheTest, TestKeepHardest) {
+  this->cache_.Stage(&this->data_[0], &this->labels_[0], 4);
+  // The positive is never cached, however high its loss.
+  const TypeParam losses[] = {9, 1, 3, 2};
+  this->cache_.Update(losses, 4);
+  EXPECT_EQ(2, this->cache_.size());
+  // The negatives come out hardest first, the easiest one evicted.
+  vector<TypeParam> item(3);
+  ASSERT_TRUE(this->cache_.Pop(&item[0]));
+  EXPECT_EQ(TypeParam(2), item[0]);
+  EXPECT_EQ(TypeParam(2), item[2]);
+  ASSERT_TRUE(this->cache_.Pop(&item[0]));
+  EXPECT_EQ(TypeParam(3), item[0]);
+  EXPECT_FALSE(this->cache_.Pop(&item[0]));
+}
+
+TYPED_TEST(HardNegativeCacheTest, TestEvictEasiest) {
+  this->cache_.Stage(&this->data_[0], &this->labels_[0], 4);
+  const TypeParam losses[] = {0, 1, 3, 2};
+  this->cache_.Update(losses, 4);
+  // A harder negative evicts the easiest cached one, an easier one does not
+  // get in.
+  this->data_.assign(12, TypeParam(7));
+  this->cache_.Stage(&this->data_[0], &this->labels_[0], 4);
+  const TypeParam new_losses[] = {0, 0.5, 5, 1};
+  this->cache_.Update(new_losses, 4);
+  EXPECT_EQ(2, this->cache_.size());
+  vector<TypeParam> item(3);
+  ASSERT_TRUE(this->cache_.Pop(&item[0]));
+  EXPECT_EQ(TypeParam(7), item[0]);
+  ASSERT_TRUE(this->cache_.Pop(&item[0]));
+  EXPECT_EQ(TypeParam(2), item[0]);
+}
+
+TYPED_TEST(HardNegativeCacheTest, TestUpdateUnstaged) {
+  // Without a staged batch, or once it was updated, losses are ignored.
+  const TypeParam losses[] = {0, 1, 3, 2};
+  this->cache_.Update(losses, 4);
+  EXPECT_EQ(0, this->cache_.size());
+  this->cache_.Stage(&this->data_[0], &this->labels_[0], 4);
+  this->cache_.Update(losses, 4);
+  this->cache_.Update(losses, 4);
+  EXPECT_EQ(2, this->cache_.size());
+}
+
+TYPED_TEST(HardNegativeCacheTest, TestShareByName) {
+  EXPECT_FALSE(HardNegativeCache<TypeParam>::Find("test_cache").get());
+  shared_ptr<HardNegativeCache<TypeParam> > cache =
+      HardNegativeCache<TypeParam>::Get("test_cache", 5, 3);
+  EXPECT_EQ(cache, HardNegativeCache<TypeParam>::Get("test_cache", 5, 3));
+  EXPECT_EQ(cache, HardNegativeCache<TypeParam>::Find("test_cache"));
+  cache.reset();
+  // The cache goes with the last layer holding it.
+  EXPECT_FALSE(HardNegativeCache<TypeParam>::Find("test_cache").get());
+}
+
+}  // namespace caffe
@@ -120,4 +120,60 @@ TYPED_TEST(HDF5OutputLayerTest, TestForward) {
       this->output_file_name_;
 }
 
+TYPED_TEST(HDF5OutputLayerTest, TestAppendBatches) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num_batches = 5;
+  this->blob_data_->Reshape(this->num_, this->channels_, this->height_,
+      this->width_);
+  this->blob_label_->Reshape(this->num_, 1, 1, 1);
+  this->blob_bottom_vec_.push_back(this->blob_data_);
+  this->blob_bottom_vec_.push_back(this->blob_label_);
+
+  LayerParameter param;
+  HDF5OutputParameter* hdf5_output_param = param.mutable_hdf5_output_param();
+  hdf5_output_param->set_file_name(this->output_file_name_);
+  // Fewer buffered batches than batches, and chunks spanning batches.
+  hdf5_output_param->set_queue_size(2);
+  hdf5_output_param->set_chunk_size(3);
+  hdf5_output_param->set_compression(1);
+  {
+    HDF5OutputLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int b = 0; b < num_batches; ++b) {
+      // Overwriting the bottoms once forwarded must not change the output.
+      Dtype* data = this->blob_data_->mutable_cpu_data();
+      for (int i = 0; i < this->blob_data_->count(); ++i) {
+        data[i] = b * this->blob_data_->count() + i;
+      }
+      Dtype* label = this->blob_label_->mutable_cpu_data();
+      for (int i = 0; i < this->num_; ++i) {
+        label[i] = b * this->num_ + i;
+      }
+      layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    }
+  }
+  hid_t file_id = H5Fopen(this->output_file_name_.c_str(), H5F_ACC_RDONLY,
+                          H5P_DEFAULT);
+  ASSERT_GE(file_id, 0) << "Failed to open HDF5 file" <<
+      this->output_file_name_;
+  Blob<Dtype> blob_data;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_DATASET_NAME, 0, 4, &blob_data);
+  EXPECT_EQ(num_batches * this->num_, blob_data.num());
+  EXPECT_EQ(this->channels_, blob_data.channels());
+  EXPECT_EQ(this->height_, blob_data.height());
+  EXPECT_EQ(this->width_, blob_data.width());
+  for (int i = 0; i < blob_data.count(); ++i) {
+    EXPECT_EQ(i, blob_data.cpu_data()[i]);
+  }
+  Blob<Dtype> blob_label;
+  hdf5_load_nd_dataset(file_id, HDF5_DATA_LABEL_NAME, 0, 4, &blob_label);
+  EXPECT_EQ(num_batches * this->num_, blob_label.num());
+  for (int i = 0; i < blob_label.count(); ++i) {
+    EXPECT_EQ(i, blob_label.cpu_data()[i]);
+  }
+  herr_t status = H5Fclose(file_id);
+  EXPECT_GE(status, 0) << "Failed to close HDF5 file " <<
+      this->output_file_name_;
+}
+
 }  // namespace caffe
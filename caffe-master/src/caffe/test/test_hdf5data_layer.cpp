@@ -1,3 +1,4 @@
+#include <map>
 #include <string>
 #include <vector>
 
@@ -121,4 +122,95 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   }
 }
 
+// Chunks smaller than the files and not a multiple of the batch size: the
+// rows still come in order, across chunks and files.
+TYPED_TEST(HDF5DataLayerTest, TestReadChunks) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 4;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_source(*(this->filename));
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+
+  // Each file has 10 rows of 240 values; see generate_sample_data.
+  const int num_rows = 10;
+  const int data_size = 8 * 6 * 5;
+  int row = 0;
+  for (int iter = 0; iter < 12; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int i = 0; i < batch_size; ++i, ++row) {
+      const int file_offset = ((row / num_rows) % 2) ? 2400 : 0;
+      const int file_row = row % num_rows;
+      EXPECT_EQ(file_row + 1, this->blob_top_label_->cpu_data()[i])
+          << "debug: iter " << iter << " i " << i;
+      for (int j = 0; j < data_size; ++j) {
+        EXPECT_EQ(file_offset + file_row * data_size + j,
+            this->blob_top_data_->cpu_data()[i * data_size + j])
+            << "debug: iter " << iter << " i " << i << " j " << j;
+      }
+    }
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestShuffle) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  const int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_chunk_size(3);
+  hdf5_data_param->set_shuffle(true);
+  hdf5_data_param->set_shuffle_window(2);
+  hdf5_data_param->set_source(*(this->filename));
+
+  // Each file has 10 rows of 240 values; see generate_sample_data.
+  const int num_rows = 10;
+  const int data_size = 8 * 6 * 5;
+  const int num_iters = 8;
+  vector<Dtype> rows;
+  for (int run = 0; run < 2; ++run) {
+    Caffe::set_random_seed(1701);
+    HDF5DataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int iter = 0; iter < num_iters; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+      for (int i = 0; i < batch_size; ++i) {
+        const Dtype* data =
+            this->blob_top_data_->cpu_data() + i * data_size;
+        const Dtype label = this->blob_top_label_->cpu_data()[i];
+        // Rows stay whole, with their label.
+        const int file_row = static_cast<int>(data[0]) % 2400 / data_size;
+        EXPECT_EQ(file_row + 1, label);
+        for (int j = 0; j < data_size; ++j) {
+          EXPECT_EQ(data[0] + j, data[j]);
+        }
+        // The same seed gives the same rows.
+        if (run == 0) {
+          rows.push_back(data[0]);
+        } else {
+          EXPECT_EQ(rows[iter * batch_size + i], data[0]);
+        }
+      }
+    }
+  }
+  // Over 2 epochs, every row is read at least once and at most 3 times, and
+  // not in file order.
+  std::map<Dtype, int> counts;
+  int num_in_order = 0;
+  for (int i = 0; i < rows.size(); ++i) {
+    ++counts[rows[i]];
+    num_in_order += (rows[i] == (i % (2 * num_rows)) * data_size);
+  }
+  EXPECT_EQ(2 * num_rows, counts.size());
+  for (typename std::map<Dtype, int>::iterator it = counts.begin();
+      it != counts.end(); ++it) {
+    EXPECT_GE(it->second, 1);
+    EXPECT_LE(it->second, 3);
+  }
+  EXPECT_GT(rows.size(), num_in_order);
+}
+
 }  // namespace caffe
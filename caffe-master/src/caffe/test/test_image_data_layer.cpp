@@ -107,6 +107,107 @@ TYPED_TEST(ImageDataLayerTest, TestResize) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(5);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_new_height(256);
+  image_data_param->set_new_width(256);
+  image_data_param->set_shuffle(false);
+  image_data_param->set_cache_size(1);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_data_->num(), 5);
+  EXPECT_EQ(this->blob_top_data_->channels(), 3);
+  EXPECT_EQ(this->blob_top_data_->height(), 256);
+  EXPECT_EQ(this->blob_top_data_->width(), 256);
+  // The image is decoded once; cached copies give the same pixels, with the
+  // label of each line.
+  layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+  const int count = this->blob_top_data_->count();
+  vector<Dtype> first(this->blob_top_data_->cpu_data(),
+      this->blob_top_data_->cpu_data() + count);
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(first[i], this->blob_top_data_->cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(ImageDataLayerTest, TestMissingImage) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The second line names a file that does not exist.
+  std::ofstream outfile(this->filename_.c_str(), std::ofstream::out);
+  outfile << EXAMPLES_SOURCE_DIR "images/cat.jpg 0\n";
+  outfile << EXAMPLES_SOURCE_DIR "images/missing.jpg 1\n";
+  outfile << EXAMPLES_SOURCE_DIR "images/cat.jpg 2\n";
+  outfile.close();
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(3);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_new_height(64);
+  image_data_param->set_new_width(64);
+  image_data_param->set_shuffle(false);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  // The item of the missing image is zeroed, with the label of its line.
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+    const int item_size = this->blob_top_data_->count() / 3;
+    const Dtype* item = this->blob_top_data_->cpu_data() + item_size;
+    for (int i = 0; i < item_size; ++i) {
+      EXPECT_EQ(0, item[i]);
+    }
+  }
+}
+
+TYPED_TEST(ImageDataLayerTest, TestWorkersOrder) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(3);
+  image_data_param->set_source(this->filename_.c_str());
+  image_data_param->set_new_height(64);
+  image_data_param->set_new_width(64);
+  image_data_param->set_shuffle(true);
+  // Read the same shuffled sequence with one worker, then with several.
+  vector<vector<Dtype> > labels;
+  vector<vector<Dtype> > data;
+  for (int workers = 1; workers <= 4; workers += 3) {
+    image_data_param->set_workers(workers);
+    Caffe::set_random_seed(this->seed_);
+    ImageDataLayer<Dtype> layer(param);
+    layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+      const Dtype* label = this->blob_top_label_->cpu_data();
+      const Dtype* top_data = this->blob_top_data_->cpu_data();
+      if (workers == 1) {
+        labels.push_back(vector<Dtype>(label, label + 3));
+        data.push_back(vector<Dtype>(top_data,
+            top_data + this->blob_top_data_->count()));
+        continue;
+      }
+      for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(labels[iter][i], label[i]);
+      }
+      for (int i = 0; i < this->blob_top_data_->count(); ++i) {
+        EXPECT_EQ(data[iter][i], top_data[i]);
+      }
+    }
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestShuffle) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
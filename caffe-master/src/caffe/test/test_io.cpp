@@ -0,0 +1,81 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class IOTest : public ::testing::Test {};
+
+TEST_F(IOTest, TestParseDatumSkippingData) {
+  Datum datum;
+  datum.set_channels(2);
+  datum.set_height(3);
+  datum.set_width(4);
+  datum.set_label(7);
+  for (int j = 0; j < 24; ++j) {
+    datum.mutable_data()->push_back(static_cast<char>(j * 10));
+  }
+  const string record = datum.SerializeAsString();
+
+  Datum parsed;
+  parsed.set_data("stale");
+  const char* data;
+  int data_size;
+  EXPECT_TRUE(ParseDatumSkippingData(record.data(), record.size(), &parsed,
+      &data, &data_size));
+  EXPECT_EQ(2, parsed.channels());
+  EXPECT_EQ(3, parsed.height());
+  EXPECT_EQ(4, parsed.width());
+  EXPECT_EQ(7, parsed.label());
+  EXPECT_FALSE(parsed.encoded());
+  EXPECT_EQ(0, parsed.data().size());
+  // The data is not copied, it points into the record.
+  EXPECT_EQ(24, data_size);
+  EXPECT_GE(data, record.data());
+  EXPECT_LE(data + data_size, record.data() + record.size());
+  EXPECT_EQ(datum.data(), string(data, data_size));
+}
+
+TEST_F(IOTest, TestParseDatumSkippingDataFloat) {
+  Datum datum;
+  datum.set_channels(1);
+  datum.set_height(1);
+  datum.set_width(3);
+  datum.set_label(1);
+  for (int j = 0; j < 3; ++j) {
+    datum.add_float_data(j + 0.5);
+  }
+  const string record = datum.SerializeAsString();
+
+  Datum parsed;
+  const char* data;
+  int data_size;
+  EXPECT_TRUE(ParseDatumSkippingData(record.data(), record.size(), &parsed,
+      &data, &data_size));
+  EXPECT_TRUE(data == NULL);
+  EXPECT_EQ(0, data_size);
+  EXPECT_EQ(datum.SerializeAsString(), parsed.SerializeAsString());
+}
+
+TEST_F(IOTest, TestParseDatumSkippingDataTruncated) {
+  Datum datum;
+  datum.set_channels(1);
+  datum.set_height(1);
+  datum.set_width(4);
+  datum.set_data("abcd");
+  const string record = datum.SerializeAsString();
+
+  Datum parsed;
+  const char* data;
+  int data_size;
+  EXPECT_FALSE(ParseDatumSkippingData(record.data(), record.size() - 2,
+      &parsed, &data, &data_size));
+}
+
+}  // namespace caffe
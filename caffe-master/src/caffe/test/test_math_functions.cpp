@@ -120,6 +120,17 @@ TYPED_TEST(MathFunctionsTest, TestFabsCPU) {
   }
 }
 
+TYPED_TEST(MathFunctionsTest, TestLog1pCPU) {
+  int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_abs<TypeParam>(n, x, x);
+  caffe_log1p<TypeParam>(n, x, this->blob_bottom_->mutable_cpu_diff());
+  const TypeParam* log1p_val = this->blob_bottom_->cpu_diff();
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(log1p_val[i], std::log(1 + x[i]), 1e-5 * (1 + x[i]));
+  }
+}
+
 TYPED_TEST(MathFunctionsTest, TestScaleCPU) {
   int n = this->blob_bottom_->count();
   TypeParam alpha = this->blob_bottom_->cpu_diff()[caffe_rng_rand() %
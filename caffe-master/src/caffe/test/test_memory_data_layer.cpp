@@ -3,6 +3,7 @@
 
 #include "caffe/data_layers.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/internal_thread.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -57,6 +58,29 @@ class MemoryDataLayerTest : public MultiDeviceTest<TypeParam> {
   vector<Blob<Dtype>*> blob_top_vec_;
 };
 
+// Adds the rows of data and labels to a MemoryDataLayer with a ring, passes
+// times over, from its own thread.
+template <typename Dtype>
+class MemoryDataProducer : public InternalThread {
+ public:
+  MemoryDataProducer(MemoryDataLayer<Dtype>* layer, const Blob<Dtype>& data,
+      const Blob<Dtype>& labels, const int passes)
+      : layer_(layer), data_(data), labels_(labels), passes_(passes) {}
+  virtual ~MemoryDataProducer() { StopInternalThread(); }
+
+ protected:
+  virtual void InternalThreadEntry() {
+    for (int i = 0; i < passes_; ++i) {
+      layer_->AddBatches(data_.cpu_data(), labels_.cpu_data(), data_.num());
+    }
+  }
+
+  MemoryDataLayer<Dtype>* layer_;
+  const Blob<Dtype>& data_;
+  const Blob<Dtype>& labels_;
+  const int passes_;
+};
+
 TYPED_TEST_CASE(MemoryDataLayerTest, TestDtypesAndDevices);
 
 TYPED_TEST(MemoryDataLayerTest, TestSetup) {
@@ -164,4 +188,39 @@ TYPED_TEST(MemoryDataLayerTest, AddDatumVectorDefaultTransform) {
   }
 }
 
+// feed the ring from another thread and check that every batch appears once,
+//  in order
+TYPED_TEST(MemoryDataLayerTest, TestForwardRing) {
+  typedef typename TypeParam::Dtype Dtype;
+
+  LayerParameter layer_param;
+  MemoryDataParameter* md_param = layer_param.mutable_memory_data_param();
+  md_param->set_batch_size(this->batch_size_);
+  md_param->set_channels(this->channels_);
+  md_param->set_height(this->height_);
+  md_param->set_width(this->width_);
+  md_param->set_ring_size(3);
+  MemoryDataLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &this->blob_top_vec_);
+  EXPECT_EQ(3, layer.ring_size());
+  const int passes = 4;
+  MemoryDataProducer<Dtype> producer(&layer, *this->data_, *this->labels_,
+      passes);
+  ASSERT_TRUE(producer.StartInternalThread());
+  for (int i = 0; i < this->batches_ * passes; ++i) {
+    int batch_num = i % this->batches_;
+    layer.Forward(this->blob_bottom_vec_, &this->blob_top_vec_);
+    for (int j = 0; j < this->data_blob_->count(); ++j) {
+      EXPECT_EQ(this->data_blob_->cpu_data()[j],
+          this->data_->cpu_data()[
+              this->data_->offset(1) * this->batch_size_ * batch_num + j]);
+    }
+    for (int j = 0; j < this->label_blob_->count(); ++j) {
+      EXPECT_EQ(this->label_blob_->cpu_data()[j],
+          this->labels_->cpu_data()[this->batch_size_ * batch_num + j]);
+    }
+  }
+  EXPECT_TRUE(producer.WaitForInternalThreadToExit());
+}
+
 }  // namespace caffe
@@ -534,8 +534,8 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
-  virtual void InitReshapableNet() {
-    const string& proto =
+  virtual void InitReshapableNet(const bool reuse_blob_memory = false) {
+    string proto =
         "name: 'ReshapableNetwork' "
         "input: 'data' "
         "input_dim: 1 "
@@ -593,6 +593,9 @@ class NetTest : public MultiDeviceTest<TypeParam> {
         "  bottom: 'norm1' "
         "  top: 'softmax' "
         "} ";
+    if (reuse_blob_memory) {
+      proto += "reuse_blob_memory: true keep_blob: 'pool1' ";
+    }
     InitNetFromProtoString(proto);
   }
 
@@ -2149,4 +2152,52 @@ TYPED_TEST(NetTest, TestReshape) {
   }
 }
 
+TYPED_TEST(NetTest, TestReuseBlobMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(2, 3, 12, 10);
+  filler.Fill(&input);
+  vector<Blob<Dtype>*> bottom_vec(1, &input);
+
+  Caffe::set_random_seed(this->seed_);
+  this->InitReshapableNet();
+  this->net_->input_blobs()[0]->Reshape(2, 3, 12, 10);
+  this->net_->Forward(bottom_vec);
+  vector<shared_ptr<Blob<Dtype> > > blobs;
+  this->CopyNetBlobs(false, &blobs);
+
+  Caffe::set_random_seed(this->seed_);
+  const bool kReuseBlobMemory = true;
+  this->InitReshapableNet(kReuseBlobMemory);
+  // conv1 is last read by pool1, before norm1 is written: they share memory.
+  // pool1 is kept, and the input and output of the net as well.
+  const shared_ptr<Blob<Dtype> > conv1 = this->net_->blob_by_name("conv1");
+  const shared_ptr<Blob<Dtype> > pool1 = this->net_->blob_by_name("pool1");
+  const shared_ptr<Blob<Dtype> > norm1 = this->net_->blob_by_name("norm1");
+  EXPECT_EQ(conv1->data().get(), norm1->data().get());
+  EXPECT_NE(conv1->data().get(), pool1->data().get());
+  EXPECT_NE(norm1->data().get(),
+      this->net_->blob_by_name("softmax")->data().get());
+  EXPECT_NE(conv1->data().get(),
+      this->net_->blob_by_name("data")->data().get());
+  this->net_->input_blobs()[0]->Reshape(2, 3, 12, 10);
+  this->net_->Forward(bottom_vec);
+  const vector<shared_ptr<Blob<Dtype> > >& net_blobs = this->net_->blobs();
+  ASSERT_EQ(blobs.size(), net_blobs.size());
+  for (int i = 0; i < net_blobs.size(); ++i) {
+    const string& name = this->net_->blob_names()[i];
+    if (name == "conv1") {
+      continue;
+    }
+    ASSERT_EQ(blobs[i]->count(), net_blobs[i]->count());
+    for (int j = 0; j < net_blobs[i]->count(); ++j) {
+      EXPECT_EQ(blobs[i]->cpu_data()[j], net_blobs[i]->cpu_data()[j])
+          << name;
+    }
+  }
+}
+
 }  // namespace caffe
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/common_layers.hpp"
+#include "caffe/filler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+#include "caffe/test/test_gradient_check_util.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class SegmentReductionLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  SegmentReductionLayerTest()
+      : blob_bottom_data_(new Blob<Dtype>(8, 2, 1, 2)),
+        blob_bottom_label_(new Blob<Dtype>(8, 1, 1, 1)),
+        blob_top_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {
+    Caffe::set_random_seed(1701);
+    FillerParameter filler_param;
+    GaussianFiller<Dtype> filler(filler_param);
+    filler.Fill(this->blob_bottom_data_);
+    // Two positives, a bag of 3, a bag of 2 and a negative: 5 segments.
+    const Dtype labels[] = {-1, -1, 3, 3, 3, 7, 7, -2};
+    std::copy(labels, labels + 8, blob_bottom_label_->mutable_cpu_data());
+    blob_bottom_vec_.push_back(blob_bottom_data_);
+    blob_bottom_vec_.push_back(blob_bottom_label_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~SegmentReductionLayerTest() {
+    delete blob_bottom_data_;
+    delete blob_bottom_label_;
+    delete blob_top_;
+    delete blob_top_label_;
+  }
+
+  // Checks the top against the reduction of the items of each segment,
+  // computed naively.
+  void TestForward(SegmentReductionParameter_SegmentOp op,
+      const int workers = 1) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    layer_param.mutable_segment_reduction_param()->set_operation(op);
+    layer_param.mutable_segment_reduction_param()->set_workers(workers);
+    SegmentReductionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+    const int begin[] = {0, 1, 2, 5, 7, 8};
+    const Dtype* data = this->blob_bottom_data_->cpu_data();
+    for (int s = 0; s < 5; ++s) {
+      for (int j = 0; j < 4; ++j) {
+        Dtype expected = -1e10;
+        if (op != SegmentReductionParameter_SegmentOp_MAX) {
+          expected = 0;
+        }
+        for (int i = begin[s]; i < begin[s + 1]; ++i) {
+          const Dtype value = data[i * 4 + j];
+          if (op == SegmentReductionParameter_SegmentOp_MAX) {
+            expected = std::max(expected, value);
+          } else if (op == SegmentReductionParameter_SegmentOp_MEAN) {
+            expected += value / (begin[s + 1] - begin[s]);
+          } else {
+            expected += exp(value);
+          }
+        }
+        if (op == SegmentReductionParameter_SegmentOp_LOGSUMEXP) {
+          expected = log(expected);
+        }
+        EXPECT_NEAR(expected, this->blob_top_->cpu_data()[s * 4 + j], 1e-5);
+      }
+    }
+  }
+
+  void TestGradient(SegmentReductionParameter_SegmentOp op,
+      const int workers = 1) {
+    typedef typename TypeParam::Dtype Dtype;
+    LayerParameter layer_param;
+    layer_param.mutable_segment_reduction_param()->set_operation(op);
+    layer_param.mutable_segment_reduction_param()->set_workers(workers);
+    SegmentReductionLayer<Dtype> layer(layer_param);
+    GradientChecker<Dtype> checker(1e-2, 1e-3);
+    checker.CheckGradientExhaustive(&layer, &(this->blob_bottom_vec_),
+        &(this->blob_top_vec_), 0);
+  }
+
+  Blob<Dtype>* const blob_bottom_data_;
+  Blob<Dtype>* const blob_bottom_label_;
+  Blob<Dtype>* const blob_top_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(SegmentReductionLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(SegmentReductionLayerTest, TestSetUp) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SegmentReductionLayer<Dtype> layer(layer_param);
+  this->blob_top_vec_.push_back(this->blob_top_label_);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  EXPECT_EQ(this->blob_top_->num(), 5);
+  EXPECT_EQ(this->blob_top_->channels(), 2);
+  EXPECT_EQ(this->blob_top_->height(), 1);
+  EXPECT_EQ(this->blob_top_->width(), 2);
+  EXPECT_EQ(this->blob_top_label_->num(), 5);
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const Dtype expected[] = {-1, -1, 3, 7, -2};
+  for (int s = 0; s < 5; ++s) {
+    EXPECT_EQ(expected[s], this->blob_top_label_->cpu_data()[s]);
+  }
+  // The segments follow the labels of each batch.
+  this->blob_bottom_label_->mutable_cpu_data()[4] = 7;
+  layer.Reshape(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  EXPECT_EQ(this->blob_top_->num(), 5);
+  this->blob_bottom_label_->mutable_cpu_data()[4] = 5;
+  layer.Reshape(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  EXPECT_EQ(this->blob_top_->num(), 6);
+}
+
+TYPED_TEST(SegmentReductionLayerTest, TestForwardMax) {
+  this->TestForward(SegmentReductionParameter_SegmentOp_MAX);
+}
+
+TYPED_TEST(SegmentReductionLayerTest, TestForwardMean) {
+  this->TestForward(SegmentReductionParameter_SegmentOp_MEAN);
+}
+
+TYPED_TEST(SegmentReductionLayerTest, TestForwardLogSumExp) {
+  this->TestForward(SegmentReductionParameter_SegmentOp_LOGSUMEXP);
+}
+
+TYPED_TEST(SegmentReductionLayerTest, TestForwardWorkers) {
+  // The workers split the 5 segments unevenly.
+  this->TestForward(SegmentReductionParameter_SegmentOp_MAX, 3);
+  this->TestForward(SegmentReductionParameter_SegmentOp_LOGSUMEXP, 3);
+}
+
+TYPED_TEST(SegmentReductionLayerTest, TestGradientMax) {
+  this->TestGradient(SegmentReductionParameter_SegmentOp_MAX);
+}
+
+TYPED_TEST(SegmentReductionLayerTest, TestGradientMean) {
+  this->TestGradient(SegmentReductionParameter_SegmentOp_MEAN);
+}
+
+TYPED_TEST(SegmentReductionLayerTest, TestGradientLogSumExp) {
+  this->TestGradient(SegmentReductionParameter_SegmentOp_LOGSUMEXP);
+}
+
+TYPED_TEST(SegmentReductionLayerTest, TestGradientWorkers) {
+  this->TestGradient(SegmentReductionParameter_SegmentOp_MEAN, 3);
+}
+
+}  // namespace caffe
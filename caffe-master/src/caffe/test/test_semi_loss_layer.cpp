@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
@@ -8,6 +9,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/hard_negative_cache.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/vision_layers.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -32,19 +35,24 @@ class SemiLossLayerTest : public MultiDeviceTest<TypeParam> {
     filler.Fill(this->blob_bottom_data_);
     blob_bottom_vec_.push_back(blob_bottom_data_);
     for (int i = 0; i < 5; ++i) {
-      blob_bottom_label_->mutable_cpu_data()[i] = (caffe_rng_rand() % 2) - 2;//-2 or -1,positive or negative
+      // -2 or -1, negative or positive
+      blob_bottom_label_->mutable_cpu_data()[i] =
+          static_cast<int>(caffe_rng_rand() % 2) - 2;
     }
     for (int i = 5; i < 10; ++i) {
       blob_bottom_label_->mutable_cpu_data()[i] = 5600;//weakly bag, img idx = 0
     }
     for (int i = 10; i < 15; ++i) {
-      blob_bottom_label_->mutable_cpu_data()[i] = (caffe_rng_rand() % 2) - 2;//-2 or -1,positive or negative
+      // -2 or -1, negative or positive
+      blob_bottom_label_->mutable_cpu_data()[i] =
+          static_cast<int>(caffe_rng_rand() % 2) - 2;
     }
     for (int i = 15; i < 20; ++i) {
       blob_bottom_label_->mutable_cpu_data()[i] = 7562;//weakly bag, img idx = 1
     }
     for (int i = 20; i < 25; ++i) {
-      blob_bottom_label_->mutable_cpu_data()[i] = (caffe_rng_rand() % 2) - 2;
+      blob_bottom_label_->mutable_cpu_data()[i] =
+          static_cast<int>(caffe_rng_rand() % 2) - 2;
     }
     blob_bottom_vec_.push_back(blob_bottom_label_);
     blob_top_vec_.push_back(blob_top_loss_);
@@ -73,5 +81,96 @@ TYPED_TEST(SemiLossLayerTest, TestGradientL1) {
       &(this->blob_top_vec_), 0);
 }
 
+TYPED_TEST(SemiLossLayerTest, TestForward) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  SemiLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  // Sum the losses naively, in double precision: -log(sigmoid(x)) is
+  // log(1 + exp(-x)), and -log(1 - sigmoid(x)) is log(1 + exp(x)).
+  const Dtype* score = this->blob_bottom_data_->cpu_data();
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  double loss_p = 0, loss_n = 0, loss_w = 0;
+  int num_p = 0, num_n = 0;
+  for (int i = 0; i < 25; ++i) {
+    if (label[i] == -1) {
+      loss_p += std::log(1 + std::exp(-static_cast<double>(score[i])));
+      ++num_p;
+    } else if (label[i] == -2) {
+      loss_n += std::log(1 + std::exp(static_cast<double>(score[i])));
+      ++num_n;
+    }
+  }
+  // The fixture has two bags, of items 5 to 9 and 15 to 19.
+  for (int bag = 5; bag < 25; bag += 10) {
+    const double best = *std::max_element(score + bag, score + bag + 5);
+    loss_w += std::log(1 + std::exp(-best)) / 2;
+  }
+  double expected = 0.3 * loss_w;
+  if (num_p) {
+    expected += 0.5 * loss_p / num_p;
+  }
+  if (num_n) {
+    expected += 0.4 * loss_n / num_n;
+  }
+  EXPECT_NEAR(expected, this->blob_top_loss_->cpu_data()[0],
+      1e-4 * std::max(1., expected));
+}
+
+TYPED_TEST(SemiLossLayerTest, TestReportHardNegatives) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The items are single scores, staged as their own pixels.
+  shared_ptr<HardNegativeCache<Dtype> > cache =
+      HardNegativeCache<Dtype>::Get("semi_loss_test", 25, 1);
+  LayerParameter layer_param;
+  layer_param.mutable_semi_loss_param()->set_hard_negative_cache(
+      "semi_loss_test");
+  SemiLossLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  const Dtype* score = this->blob_bottom_data_->cpu_data();
+  const Dtype* label = this->blob_bottom_label_->cpu_data();
+  cache->Stage(score, label, 25);
+  Caffe::set_phase(Caffe::TRAIN);
+  layer.Forward(this->blob_bottom_vec_, &(this->blob_top_vec_));
+  // Every negative is cached; the higher its score, the harder it is.
+  int num_negatives = 0;
+  for (int i = 0; i < 25; ++i) {
+    num_negatives += label[i] == -2;
+  }
+  ASSERT_GT(num_negatives, 1);
+  EXPECT_EQ(num_negatives, cache->size());
+  Dtype previous;
+  ASSERT_TRUE(cache->Pop(&previous));
+  Dtype item;
+  while (cache->Pop(&item)) {
+    EXPECT_LE(item, previous);
+    previous = item;
+  }
+}
+
+TYPED_TEST(SemiLossLayerTest, TestGradientPerClass) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Two classes, with their own labels: the bags of the second class are
+  // split differently.
+  Blob<Dtype> data(8, 2, 1, 1);
+  Blob<Dtype> label(8, 2, 1, 1);
+  FillerParameter filler_param;
+  filler_param.set_std(3);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(&data);
+  const Dtype labels[] = {-1, -2, -2, 3, 7, 3, 7, 3,
+                          7, 4, 7, 4, -1, -1, -2, -2};
+  caffe_copy(label.count(), labels, label.mutable_cpu_data());
+  vector<Blob<Dtype>*> bottom_vec;
+  bottom_vec.push_back(&data);
+  bottom_vec.push_back(&label);
+  LayerParameter layer_param;
+  SemiLossLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 2e-3, 1701);
+  checker.CheckGradientExhaustive(&layer, &bottom_vec,
+      &(this->blob_top_vec_), 0);
+}
+
 
 }  // namespace caffe
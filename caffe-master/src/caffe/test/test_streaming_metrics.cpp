@@ -0,0 +1,95 @@
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/streaming_metrics.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class StreamingMetricsTest : public ::testing::Test {};
+
+TEST_F(StreamingMetricsTest, TestEmpty) {
+  StreamingMetrics metrics(10);
+  EXPECT_EQ(0, metrics.AUC());
+  EXPECT_EQ(0, metrics.AveragePrecision());
+  EXPECT_EQ(0, metrics.Precision());
+  EXPECT_EQ(0, metrics.Recall());
+  EXPECT_EQ(0, metrics.BagAccuracy());
+}
+
+TEST_F(StreamingMetricsTest, TestSeparated) {
+  StreamingMetrics metrics(100);
+  for (int i = 0; i < 5; ++i) {
+    metrics.AddPositive(1 + i);
+    metrics.AddNegative(-1 - i);
+  }
+  EXPECT_DOUBLE_EQ(1, metrics.AUC());
+  EXPECT_DOUBLE_EQ(1, metrics.AveragePrecision());
+  EXPECT_DOUBLE_EQ(1, metrics.Precision());
+  EXPECT_DOUBLE_EQ(1, metrics.Recall());
+  // Swapped, every negative is above every positive.
+  metrics.Reset();
+  for (int i = 0; i < 5; ++i) {
+    metrics.AddPositive(-1 - i);
+    metrics.AddNegative(1 + i);
+  }
+  EXPECT_DOUBLE_EQ(0, metrics.AUC());
+  EXPECT_DOUBLE_EQ(0, metrics.Precision());
+  EXPECT_DOUBLE_EQ(0, metrics.Recall());
+}
+
+TEST_F(StreamingMetricsTest, TestRanking) {
+  StreamingMetrics metrics(1000);
+  // In decreasing order: positive, negative, positive, negative. Three of
+  // the four pairs are ranked right.
+  metrics.AddPositive(3);
+  metrics.AddNegative(1);
+  metrics.AddPositive(-1);
+  metrics.AddNegative(-3);
+  EXPECT_DOUBLE_EQ(0.75, metrics.AUC());
+  // Precision 1 at the first positive, 2 / 3 at the second.
+  EXPECT_DOUBLE_EQ((1 + 2. / 3) / 2, metrics.AveragePrecision());
+  EXPECT_DOUBLE_EQ(0.5, metrics.Precision());
+  EXPECT_DOUBLE_EQ(0.5, metrics.Recall());
+}
+
+TEST_F(StreamingMetricsTest, TestTies) {
+  // A single bin ties all the scores.
+  StreamingMetrics metrics(1);
+  metrics.AddPositive(3);
+  metrics.AddNegative(-3);
+  EXPECT_DOUBLE_EQ(0.5, metrics.AUC());
+  EXPECT_DOUBLE_EQ(1, metrics.Precision());
+}
+
+TEST_F(StreamingMetricsTest, TestSaturated) {
+  // The confident scores of a trained net, whose sigmoids all round to 0 or
+  // 1, stay apart.
+  StreamingMetrics metrics;
+  for (int i = 0; i < 5; ++i) {
+    metrics.AddPositive(12 + i);
+    metrics.AddNegative(7 + i);
+    metrics.AddNegative(-10 - i);
+  }
+  EXPECT_DOUBLE_EQ(1, metrics.AUC());
+  EXPECT_DOUBLE_EQ(1, metrics.AveragePrecision());
+  // Scores beyond the range tie.
+  metrics.Reset();
+  metrics.AddPositive(40);
+  metrics.AddNegative(30);
+  EXPECT_DOUBLE_EQ(0.5, metrics.AUC());
+}
+
+TEST_F(StreamingMetricsTest, TestBags) {
+  StreamingMetrics metrics;
+  metrics.AddBag(2);
+  metrics.AddBag(-1);
+  metrics.AddBag(0);
+  metrics.AddBag(0.5);
+  EXPECT_EQ(4, metrics.num_bags());
+  EXPECT_DOUBLE_EQ(0.5, metrics.BagAccuracy());
+  EXPECT_EQ(0, metrics.num_positives());
+}
+
+}  // namespace caffe
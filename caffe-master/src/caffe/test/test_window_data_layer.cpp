@@ -0,0 +1,175 @@
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_layers.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class WindowDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  WindowDataLayerTest()
+      : seed_(1701),
+        blob_top_data_(new Blob<Dtype>()),
+        blob_top_label_(new Blob<Dtype>()) {}
+  virtual void SetUp() {
+    MakeTempFilename(&filename_);
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_label_);
+    Caffe::set_random_seed(seed_);
+    // Create a window file with a foreground and a background window in
+    // each of two images.
+    std::ofstream outfile(filename_.c_str(), std::ofstream::out);
+    LOG(INFO) << "Using temporary file " << filename_;
+    outfile << "# 0\n" EXAMPLES_SOURCE_DIR "images/cat.jpg\n3\n360\n480\n2\n"
+        << "1 0.8 10 20 200 300\n"
+        << "0 0.1 100 50 479 250\n";
+    outfile << "# 1\n" EXAMPLES_SOURCE_DIR "images/fish-bike.jpg\n"
+        << "3\n323\n481\n2\n"
+        << "2 0.9 0 0 240 160\n"
+        << "0 0.2 200 100 400 322\n";
+    outfile.close();
+  }
+
+  virtual ~WindowDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_label_;
+  }
+
+  void FillParam(LayerParameter* param) {
+    WindowDataParameter* window_data_param =
+        param->mutable_window_data_param();
+    window_data_param->set_batch_size(6);
+    window_data_param->set_source(filename_.c_str());
+    window_data_param->set_fg_fraction(0.5);
+    window_data_param->set_context_pad(4);
+    TransformationParameter* transform_param =
+        param->mutable_transform_param();
+    transform_param->set_crop_size(32);
+    transform_param->set_mirror(true);
+  }
+
+  // Reads a number of batches from a layer seeded with seed_.
+  void ReadBatches(const LayerParameter& param, const int num_batches,
+      vector<vector<Dtype> >* data, vector<vector<Dtype> >* labels) {
+    Caffe::set_random_seed(seed_);
+    WindowDataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, &blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), 6);
+    EXPECT_EQ(blob_top_data_->channels(), 3);
+    EXPECT_EQ(blob_top_data_->height(), 32);
+    EXPECT_EQ(blob_top_data_->width(), 32);
+    EXPECT_EQ(blob_top_label_->num(), 6);
+    for (int iter = 0; iter < num_batches; ++iter) {
+      layer.Forward(blob_bottom_vec_, &blob_top_vec_);
+      const Dtype* top_data = blob_top_data_->cpu_data();
+      const Dtype* label = blob_top_label_->cpu_data();
+      data->push_back(vector<Dtype>(top_data,
+          top_data + blob_top_data_->count()));
+      labels->push_back(vector<Dtype>(label,
+          label + blob_top_label_->count()));
+    }
+  }
+
+  int seed_;
+  string filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_label_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(WindowDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(WindowDataLayerTest, TestWorkersOrder) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  this->FillParam(&param);
+  // Read the same windows with one worker, then with several.
+  vector<vector<Dtype> > data, labels;
+  param.mutable_window_data_param()->set_workers(1);
+  this->ReadBatches(param, 4, &data, &labels);
+  vector<vector<Dtype> > workers_data, workers_labels;
+  param.mutable_window_data_param()->set_workers(4);
+  this->ReadBatches(param, 4, &workers_data, &workers_labels);
+  for (int iter = 0; iter < 4; ++iter) {
+    for (int i = 0; i < 6; ++i) {
+      EXPECT_EQ(labels[iter][i], workers_labels[iter][i]);
+    }
+    for (int i = 0; i < data[iter].size(); ++i) {
+      EXPECT_EQ(data[iter][i], workers_data[iter][i]);
+    }
+  }
+}
+
+TYPED_TEST(WindowDataLayerTest, TestCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  this->FillParam(&param);
+  // The batches after the first crop their windows out of cached images;
+  // they must match the batches of a layer that decodes every image.
+  vector<vector<Dtype> > data, labels;
+  this->ReadBatches(param, 4, &data, &labels);
+  vector<vector<Dtype> > cached_data, cached_labels;
+  param.mutable_window_data_param()->set_cache_size(16);
+  this->ReadBatches(param, 4, &cached_data, &cached_labels);
+  for (int iter = 0; iter < 4; ++iter) {
+    for (int i = 0; i < 6; ++i) {
+      EXPECT_EQ(labels[iter][i], cached_labels[iter][i]);
+    }
+    for (int i = 0; i < data[iter].size(); ++i) {
+      EXPECT_EQ(data[iter][i], cached_data[iter][i]);
+    }
+  }
+}
+
+TYPED_TEST(WindowDataLayerTest, TestMissingImage) {
+  typedef typename TypeParam::Dtype Dtype;
+  // The foreground windows of class 2 are in an image that does not exist.
+  std::ofstream outfile(this->filename_.c_str(), std::ofstream::out);
+  outfile << "# 0\n" EXAMPLES_SOURCE_DIR "images/cat.jpg\n3\n360\n480\n2\n"
+      << "1 0.8 10 20 200 300\n"
+      << "0 0.1 100 50 479 250\n";
+  outfile << "# 1\n" EXAMPLES_SOURCE_DIR "images/missing.jpg\n"
+      << "3\n360\n480\n1\n"
+      << "2 0.9 100 50 400 250\n";
+  outfile.close();
+  LayerParameter param;
+  this->FillParam(&param);
+  param.mutable_transform_param()->add_mean_value(1);
+  // Read enough batches for the prefetch buffers to be reused, so that the
+  // items of the missing image land where windows were read before.
+  vector<vector<Dtype> > data, labels;
+  this->ReadBatches(param, 8, &data, &labels);
+  // Those items are zeroed, and keep the label of their window.
+  const int item_size = 3 * 32 * 32;
+  int num_missing = 0;
+  for (int iter = 0; iter < 8; ++iter) {
+    for (int i = 0; i < 6; ++i) {
+      int num_zeros = 0;
+      for (int j = 0; j < item_size; ++j) {
+        num_zeros += data[iter][i * item_size + j] == 0;
+      }
+      if (labels[iter][i] == 2) {
+        EXPECT_EQ(item_size, num_zeros);
+        ++num_missing;
+      } else {
+        EXPECT_LT(num_zeros, item_size);
+      }
+    }
+  }
+  EXPECT_GT(num_missing, 0);
+}
+
+}  // namespace caffe
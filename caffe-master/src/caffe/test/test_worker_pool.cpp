@@ -0,0 +1,38 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/worker_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+// Each worker counts its calls in its own slot.
+class CountingTask : public ParallelTask {
+ public:
+  explicit CountingTask(const int num_workers) : calls_(num_workers, 0) {}
+  virtual void Run(const int worker_id, const int num_workers) {
+    EXPECT_EQ(calls_.size(), num_workers);
+    ++calls_[worker_id];
+  }
+  vector<int> calls_;
+};
+
+class WorkerPoolTest : public ::testing::Test {};
+
+TEST_F(WorkerPoolTest, TestRunOnEachWorker) {
+  const int num_workers = 4;
+  WorkerPool pool(num_workers);
+  EXPECT_EQ(num_workers, pool.num_workers());
+  CountingTask task(num_workers);
+  for (int iter = 0; iter < 10; ++iter) {
+    pool.Run(&task);
+    for (int i = 0; i < num_workers; ++i) {
+      EXPECT_EQ(iter + 1, task.calls_[i]);
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/bag_sampler.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe {
+
+BagSampler::BagSampler(const BagSamplingParameter& param,
+    const int batch_size, const vector<int>& labels, const bool shuffle)
+    : batch_size_(batch_size), num_positives_(param.positives()),
+      num_negatives_(param.negatives()), lookahead_(param.lookahead()),
+      bag_pos_(0), positive_pos_(0), negative_pos_(0) {
+  CHECK_GT(lookahead_, 0) << "lookahead must be positive";
+  const int bag_slots = batch_size_ - num_positives_ - num_negatives_;
+  CHECK_GE(bag_slots, 0) << "The positives and negatives of a batch exceed "
+      << "its size";
+  int max_bag_size = 0;
+  for (int i = 0; i < labels.size(); ++i) {
+    if (labels[i] == -1) {
+      positive_order_.push_back(i);
+    } else if (labels[i] == -2) {
+      negative_order_.push_back(i);
+    } else {
+      CHECK_GE(labels[i], 0) << "Unexpected label " << labels[i];
+      if (i > 0 && labels[i - 1] == labels[i]) {
+        ++bags_.back().second;
+      } else {
+        bags_.push_back(make_pair(i, 1));
+        bag_labels_.push_back(labels[i]);
+      }
+      max_bag_size = std::max(max_bag_size, bags_.back().second);
+    }
+  }
+  CHECK(num_positives_ == 0 || !positive_order_.empty())
+      << "No positive (label -1) to sample";
+  CHECK(num_negatives_ == 0 || !negative_order_.empty())
+      << "No negative (label -2) to sample";
+  CHECK_LE(max_bag_size, bag_slots) << "A bag of " << max_bag_size
+      << " records does not fit in the slots a batch leaves for bags";
+  if (positive_order_.empty() && negative_order_.empty() && bag_slots > 0) {
+    // No positive or negative can fill the slots no bag fits in, so the bags
+    // have to fill every batch exactly: be of one size that divides the
+    // slots, have distinct labels, and be enough to fill a batch within
+    // lookahead_.
+    bool one_size = !bags_.empty();
+    for (int i = 1; i < bags_.size() && one_size; ++i) {
+      one_size = bags_[i].second == bags_[0].second;
+    }
+    const std::set<int> distinct_labels(bag_labels_.begin(),
+        bag_labels_.end());
+    CHECK(one_size && bag_slots % bags_[0].second == 0 &&
+        distinct_labels.size() == bags_.size() &&
+        std::min<int>(lookahead_, bags_.size()) >=
+        bag_slots / bags_[0].second)
+        << "Without positives or negatives, the bags cannot always fill the "
+        << bag_slots << " slots of a batch exactly: they need one size that "
+        << "divides it, distinct labels, and enough of them within lookahead";
+  }
+  bag_order_.resize(bags_.size());
+  for (int i = 0; i < bag_order_.size(); ++i) {
+    bag_order_[i] = i;
+  }
+  if (shuffle) {
+    const unsigned int rng_seed = caffe_rng_rand();
+    rng_.reset(new Caffe::RNG(rng_seed));
+    Shuffle(&bag_order_);
+    Shuffle(&positive_order_);
+    Shuffle(&negative_order_);
+  }
+  LOG(INFO) << "Sampling batches out of " << bags_.size() << " bags, "
+      << positive_order_.size() << " positives and "
+      << negative_order_.size() << " negatives";
+}
+
+void BagSampler::Shuffle(vector<int>* order) {
+  if (rng_) {
+    caffe::rng_t* rng = static_cast<caffe::rng_t*>(rng_->generator());
+    shuffle(order->begin(), order->end(), rng);
+  }
+}
+
+int BagSampler::NextItem(vector<int>* order, int* pos) {
+  if (*pos == order->size()) {
+    Shuffle(order);
+    *pos = 0;
+  }
+  return (*order)[(*pos)++];
+}
+
+void BagSampler::NextBatch(vector<int>* batch) {
+  // Fit as many of the next bags as possible in the slots left by the
+  // positives and negatives, trying the first lookahead_ ones that remain
+  // in the epoch.
+  int slots = batch_size_ - num_positives_ - num_negatives_;
+  vector<int> bag_records;
+  std::set<int> labels;
+  while (slots > 0 && !bags_.empty()) {
+    if (bag_pos_ == bag_order_.size()) {
+      Shuffle(&bag_order_);
+      bag_pos_ = 0;
+    }
+    const int end = std::min<int>(bag_pos_ + lookahead_, bag_order_.size());
+    int fit = -1;
+    for (int i = bag_pos_; i < end && fit < 0; ++i) {
+      const int bag = bag_order_[i];
+      if (bags_[bag].second <= slots && !labels.count(bag_labels_[bag])) {
+        fit = i;
+      }
+    }
+    if (fit < 0) {
+      break;
+    }
+    std::swap(bag_order_[bag_pos_], bag_order_[fit]);
+    const int bag = bag_order_[bag_pos_++];
+    labels.insert(bag_labels_[bag]);
+    for (int i = 0; i < bags_[bag].second; ++i) {
+      bag_records.push_back(bags_[bag].first + i);
+    }
+    slots -= bags_[bag].second;
+  }
+  // Share the slots no bag fits in between positives and negatives.
+  int positives = num_positives_;
+  int negatives = num_negatives_;
+  if (!positive_order_.empty() && !negative_order_.empty()) {
+    positives += (slots + 1) / 2;
+    negatives += slots / 2;
+  } else if (!positive_order_.empty()) {
+    positives += slots;
+  } else {
+    CHECK(slots == 0 || !negative_order_.empty()) << "No positive or "
+        << "negative to fill the " << slots << " slots no bag fits in";
+    negatives += slots;
+  }
+  for (int i = 0; i < positives; ++i) {
+    batch->push_back(NextItem(&positive_order_, &positive_pos_));
+  }
+  for (int i = 0; i < negatives; ++i) {
+    batch->push_back(NextItem(&negative_order_, &negative_pos_));
+  }
+  batch->insert(batch->end(), bag_records.begin(), bag_records.end());
+}
+
+}  // namespace caffe
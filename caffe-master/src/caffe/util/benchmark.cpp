@@ -94,4 +94,34 @@ void Timer::Init() {
   }
 }
 
+void CPUTimer::Start() {
+  if (!running()) {
+    start_cpu_ = boost::posix_time::microsec_clock::local_time();
+    running_ = true;
+    has_run_at_least_once_ = true;
+  }
+}
+
+void CPUTimer::Stop() {
+  if (running()) {
+    stop_cpu_ = boost::posix_time::microsec_clock::local_time();
+    running_ = false;
+  }
+}
+
+float CPUTimer::MilliSeconds() {
+  if (!has_run_at_least_once()) {
+    LOG(WARNING) << "Timer has never been run before reading time.";
+    return 0;
+  }
+  if (running()) {
+    Stop();
+  }
+  return (stop_cpu_ - start_cpu_).total_microseconds() / 1000.;
+}
+
+float CPUTimer::Seconds() {
+  return MilliSeconds() / 1000.;
+}
+
 }  // namespace caffe
@@ -0,0 +1,78 @@
+#include <boost/thread.hpp>
+#include <string>
+
+#include "caffe/util/datum_cache.hpp"
+
+namespace caffe {
+
+class DatumCache::Sync {
+ public:
+  mutable boost::mutex mutex_;
+};
+
+// The memory held by a cached datum, approximately.
+static size_t DatumBytes(const string& key, const Datum& datum) {
+  return key.size() + datum.data().size() +
+      datum.float_data_size() * sizeof(float) + sizeof(Datum);
+}
+
+DatumCache::DatumCache(const size_t capacity)
+    : capacity_(capacity), size_(0), hits_(0), misses_(0),
+      sync_(new Sync()) {
+}
+
+shared_ptr<const Datum> DatumCache::Get(const string& key) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  std::map<string, Entries::iterator>::iterator it = index_.find(key);
+  if (it == index_.end()) {
+    ++misses_;
+    return shared_ptr<const Datum>();
+  }
+  ++hits_;
+  // Move the entry to the front, as the most recently used.
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->second;
+}
+
+void DatumCache::Put(const string& key, const shared_ptr<const Datum>& datum) {
+  const size_t bytes = DatumBytes(key, *datum);
+  if (bytes > capacity_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (index_.count(key)) {
+    // Another thread cached the same datum meanwhile.
+    return;
+  }
+  while (size_ + bytes > capacity_) {
+    const std::pair<string, shared_ptr<const Datum> >& lru = entries_.back();
+    size_ -= DatumBytes(lru.first, *lru.second);
+    index_.erase(lru.first);
+    entries_.pop_back();
+  }
+  entries_.push_front(std::make_pair(key, datum));
+  index_[key] = entries_.begin();
+  size_ += bytes;
+}
+
+size_t DatumCache::size() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return size_;
+}
+
+size_t DatumCache::count() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return entries_.size();
+}
+
+size_t DatumCache::hits() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return hits_;
+}
+
+size_t DatumCache::misses() const {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return misses_;
+}
+
+}  // namespace caffe
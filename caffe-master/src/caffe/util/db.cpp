@@ -0,0 +1,94 @@
+#include <string>
+
+#include "caffe/util/db.hpp"
+#include "caffe/util/io.hpp"
+
+namespace caffe { namespace db {
+
+void LevelDBCursor::Seek(const string& key) {
+  iter_->Seek(key);
+  missed_seek_ = iter_->Valid() && iter_->key() != leveldb::Slice(key);
+}
+
+void LevelDB::Open(const string& source) {
+  leveldb::Options options = GetLevelDBOptions();
+  options.create_if_missing = false;
+  LOG(INFO) << "Opening leveldb " << source;
+  leveldb::Status status = leveldb::DB::Open(options, source, &db_);
+  CHECK(status.ok()) << "Failed to open leveldb " << source << std::endl
+                     << status.ToString();
+}
+
+void LevelDB::Close() {
+  delete db_;
+  db_ = NULL;
+}
+
+LevelDBCursor* LevelDB::NewCursor() {
+  CHECK(db_);
+  return new LevelDBCursor(db_->NewIterator(leveldb::ReadOptions()));
+}
+
+void LMDBCursor::Seek(const string& key) {
+  mdb_key_.mv_size = key.size();
+  mdb_key_.mv_data = const_cast<char*>(key.data());
+  Get(MDB_SET_KEY);
+}
+
+void LMDBCursor::Get(MDB_cursor_op op) {
+  const int rc = mdb_cursor_get(mdb_cursor_, &mdb_key_, &mdb_value_, op);
+  CHECK(rc == MDB_SUCCESS || rc == MDB_NOTFOUND) << "mdb_cursor_get failed: "
+      << mdb_strerror(rc);
+  valid_ = (rc == MDB_SUCCESS);
+}
+
+void LMDB::Open(const string& source) {
+  CHECK_EQ(mdb_env_create(&mdb_env_), MDB_SUCCESS) << "mdb_env_create failed";
+  CHECK_EQ(mdb_env_set_mapsize(mdb_env_, 1099511627776), MDB_SUCCESS);  // 1TB
+  CHECK_EQ(mdb_env_open(mdb_env_, source.c_str(), MDB_RDONLY|MDB_NOTLS, 0664),
+      MDB_SUCCESS) << "mdb_env_open failed";
+  MDB_txn* mdb_txn;
+  CHECK_EQ(mdb_txn_begin(mdb_env_, NULL, MDB_RDONLY, &mdb_txn), MDB_SUCCESS)
+      << "mdb_txn_begin failed";
+  CHECK_EQ(mdb_open(mdb_txn, NULL, 0, &mdb_dbi_), MDB_SUCCESS)
+      << "mdb_open failed";
+  CHECK_EQ(mdb_txn_commit(mdb_txn), MDB_SUCCESS) << "mdb_txn_commit failed";
+  LOG(INFO) << "Opening lmdb " << source;
+}
+
+void LMDB::Close() {
+  if (mdb_env_ != NULL) {
+    mdb_close(mdb_env_, mdb_dbi_);
+    mdb_env_close(mdb_env_);
+    mdb_env_ = NULL;
+  }
+}
+
+LMDBCursor* LMDB::NewCursor() {
+  CHECK(mdb_env_);
+  MDB_txn* mdb_txn;
+  MDB_cursor* mdb_cursor;
+  CHECK_EQ(mdb_txn_begin(mdb_env_, NULL, MDB_RDONLY, &mdb_txn), MDB_SUCCESS)
+      << "mdb_txn_begin failed";
+  CHECK_EQ(mdb_cursor_open(mdb_txn, mdb_dbi_, &mdb_cursor), MDB_SUCCESS)
+      << "mdb_cursor_open failed";
+  return new LMDBCursor(mdb_txn, mdb_cursor);
+}
+
+DB* GetDB(DataParameter::DB backend) {
+  switch (backend) {
+  case DataParameter_DB_LEVELDB:
+    return new LevelDB();
+  case DataParameter_DB_LMDB:
+    return new LMDB();
+  case DataParameter_DB_RAW:
+    LOG(FATAL) << "RAW files are not databases, DataLayer maps them";
+    return NULL;
+  default:
+    LOG(FATAL) << "Unknown database backend";
+    return NULL;
+  }
+}
+
+}  // namespace db
+}  // namespace caffe
@@ -0,0 +1,133 @@
+#include <boost/thread.hpp>
+#include <boost/weak_ptr.hpp>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/util/hard_negative_cache.hpp"
+
+namespace caffe {
+
+// The caches held by layers, by name.
+static boost::mutex caches_mutex;
+
+template <typename Dtype>
+static std::map<string, boost::weak_ptr<HardNegativeCache<Dtype> > >&
+    Caches() {
+  static std::map<string, boost::weak_ptr<HardNegativeCache<Dtype> > > caches;
+  return caches;
+}
+
+template <typename Dtype>
+shared_ptr<HardNegativeCache<Dtype> > HardNegativeCache<Dtype>::Get(
+    const string& name, const int capacity, const int dim) {
+  boost::mutex::scoped_lock lock(caches_mutex);
+  shared_ptr<HardNegativeCache> cache = Caches<Dtype>()[name].lock();
+  if (cache) {
+    CHECK_EQ(cache->dim(), dim) << "The items of hard negative cache "
+        << name << " differ in size between its data layers";
+  } else {
+    LOG(INFO) << "Caching up to " << capacity << " hard negatives in "
+        << name;
+    cache.reset(new HardNegativeCache(capacity, dim));
+    Caches<Dtype>()[name] = cache;
+  }
+  return cache;
+}
+
+template <typename Dtype>
+shared_ptr<HardNegativeCache<Dtype> > HardNegativeCache<Dtype>::Find(
+    const string& name) {
+  boost::mutex::scoped_lock lock(caches_mutex);
+  return Caches<Dtype>()[name].lock();
+}
+
+template <typename Dtype>
+class HardNegativeCache<Dtype>::Sync {
+ public:
+  boost::mutex mutex_;
+};
+
+template <typename Dtype>
+HardNegativeCache<Dtype>::HardNegativeCache(const int capacity, const int dim)
+    : capacity_(capacity), dim_(dim), sync_(new Sync()), staged_num_(0) {
+  CHECK_GT(capacity, 0) << "A hard negative cache needs a capacity";
+}
+
+template <typename Dtype>
+void HardNegativeCache<Dtype>::Stage(const Dtype* data, const Dtype* labels,
+    const int num) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  staged_items_.clear();
+  for (int i = 0; i < num; ++i) {
+    if (labels[i] == Dtype(-2)) {
+      staged_items_.push_back(i);
+    }
+  }
+  staged_data_.resize(staged_items_.size() * dim_);
+  for (int j = 0; j < staged_items_.size(); ++j) {
+    const Dtype* item = data + staged_items_[j] * dim_;
+    std::copy(item, item + dim_, staged_data_.begin() + j * dim_);
+  }
+  staged_num_ = num;
+}
+
+template <typename Dtype>
+void HardNegativeCache<Dtype>::Update(const Dtype* losses, const int num) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (!staged_num_) {
+    return;
+  }
+  CHECK_EQ(num, staged_num_) << "The batch of the losses is not the one "
+      << "staged in the hard negative cache";
+  for (int j = 0; j < staged_items_.size(); ++j) {
+    const Dtype loss = losses[staged_items_[j]];
+    int slot;
+    if (entries_.size() < capacity_) {
+      if (free_slots_.empty()) {
+        slot = slots_.size();
+        slots_.push_back(vector<Dtype>(dim_));
+      } else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+      }
+    } else if (loss > entries_.begin()->first) {
+      // Evict the easiest negative.
+      slot = entries_.begin()->second;
+      entries_.erase(entries_.begin());
+    } else {
+      continue;
+    }
+    std::copy(staged_data_.begin() + j * dim_,
+        staged_data_.begin() + (j + 1) * dim_, slots_[slot].begin());
+    entries_.insert(std::make_pair(loss, slot));
+  }
+  staged_items_.clear();
+  staged_num_ = 0;
+}
+
+template <typename Dtype>
+bool HardNegativeCache<Dtype>::Pop(Dtype* data) {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  if (entries_.empty()) {
+    return false;
+  }
+  typename std::multimap<Dtype, int>::iterator hardest = entries_.end();
+  --hardest;
+  const vector<Dtype>& slot = slots_[hardest->second];
+  std::copy(slot.begin(), slot.end(), data);
+  free_slots_.push_back(hardest->second);
+  entries_.erase(hardest);
+  return true;
+}
+
+template <typename Dtype>
+int HardNegativeCache<Dtype>::size() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  return entries_.size();
+}
+
+INSTANTIATE_CLASS(HardNegativeCache);
+
+}  // namespace caffe
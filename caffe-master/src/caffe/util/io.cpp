@@ -2,6 +2,7 @@
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/text_format.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <leveldb/db.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -9,6 +10,7 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <stdint.h>
 
+#include <boost/thread.hpp>
 #include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
@@ -27,6 +29,7 @@ using google::protobuf::io::CodedInputStream;
 using google::protobuf::io::ZeroCopyOutputStream;
 using google::protobuf::io::CodedOutputStream;
 using google::protobuf::Message;
+using google::protobuf::internal::WireFormatLite;
 
 bool ReadProtoFromTextFile(const char* filename, Message* proto) {
   int fd = open(filename, O_RDONLY);
@@ -66,6 +69,37 @@ void WriteProtoToBinaryFile(const Message& proto, const char* filename) {
   CHECK(proto.SerializeToOstream(&output));
 }
 
+// Copies the pixels of cv_img into the data of datum, channel by channel.
+static void CVMatToDatum(const cv::Mat& cv_img, Datum* datum) {
+  const int num_channels = cv_img.channels();
+  datum->set_channels(num_channels);
+  datum->set_height(cv_img.rows);
+  datum->set_width(cv_img.cols);
+  datum->set_encoded(false);
+  datum->clear_data();
+  datum->clear_float_data();
+  string* datum_string = datum->mutable_data();
+  datum_string->resize(num_channels * cv_img.rows * cv_img.cols);
+  int index = 0;
+  if (num_channels == 3) {
+    for (int c = 0; c < num_channels; ++c) {
+      for (int h = 0; h < cv_img.rows; ++h) {
+        const cv::Vec3b* row = cv_img.ptr<cv::Vec3b>(h);
+        for (int w = 0; w < cv_img.cols; ++w) {
+          (*datum_string)[index++] = static_cast<char>(row[w][c]);
+        }
+      }
+    }
+  } else {  // Faster than repeatedly testing is_color for each pixel w/i loop
+    for (int h = 0; h < cv_img.rows; ++h) {
+      const uchar* row = cv_img.ptr<uchar>(h);
+      for (int w = 0; w < cv_img.cols; ++w) {
+        (*datum_string)[index++] = static_cast<char>(row[w]);
+      }
+    }
+  }
+}
+
 bool ReadImageToDatum(const string& filename, const int label,
     const int height, const int width, const bool is_color, Datum* datum) {
   cv::Mat cv_img;
@@ -82,32 +116,106 @@ bool ReadImageToDatum(const string& filename, const int label,
   } else {
     cv_img = cv_img_origin;
   }
+  CVMatToDatum(cv_img, datum);
+  datum->set_label(label);
+  return true;
+}
 
-  int num_channels = (is_color ? 3 : 1);
-  datum->set_channels(num_channels);
-  datum->set_height(cv_img.rows);
-  datum->set_width(cv_img.cols);
+bool ReadEncodedImageToDatum(const string& filename, const int label,
+    const int height, const int width, const bool is_color, Datum* datum) {
+  string* datum_string = datum->mutable_data();
+  if (height > 0 && width > 0) {
+    int cv_read_flag = (is_color ? CV_LOAD_IMAGE_COLOR :
+      CV_LOAD_IMAGE_GRAYSCALE);
+    cv::Mat cv_img_origin = cv::imread(filename, cv_read_flag);
+    if (!cv_img_origin.data) {
+      LOG(ERROR) << "Could not open or find file " << filename;
+      return false;
+    }
+    cv::Mat cv_img;
+    cv::resize(cv_img_origin, cv_img, cv::Size(width, height));
+    const size_t dot = filename.rfind('.');
+    const string extension =
+        (dot == string::npos) ? string(".png") : filename.substr(dot);
+    std::vector<uchar> buffer;
+    if (!cv::imencode(extension, cv_img, buffer)) {
+      LOG(ERROR) << "Could not encode " << filename;
+      return false;
+    }
+    datum_string->assign(buffer.begin(), buffer.end());
+    datum->set_height(height);
+    datum->set_width(width);
+  } else {
+    std::ifstream file(filename.c_str(),
+        std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+      LOG(ERROR) << "Could not open or find file " << filename;
+      return false;
+    }
+    const std::streampos size = file.tellg();
+    datum_string->resize(size);
+    file.seekg(0, std::ios::beg);
+    file.read(&(*datum_string)[0], size);
+    datum->clear_height();
+    datum->clear_width();
+  }
+  datum->set_channels(is_color ? 3 : 1);
   datum->set_label(label);
-  datum->clear_data();
+  datum->set_encoded(true);
   datum->clear_float_data();
-  string* datum_string = datum->mutable_data();
-  if (is_color) {
-    for (int c = 0; c < num_channels; ++c) {
-      for (int h = 0; h < cv_img.rows; ++h) {
-        for (int w = 0; w < cv_img.cols; ++w) {
-          datum_string->push_back(
-            static_cast<char>(cv_img.at<cv::Vec3b>(h, w)[c]));
-        }
+  return true;
+}
+
+bool ParseDatumSkippingData(const char* buffer, const int size, Datum* datum,
+    const char** data, int* data_size) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(buffer);
+  *data = NULL;
+  *data_size = 0;
+  // Find where the data field lies in the record...
+  int data_begin = size;
+  int data_end = size;
+  CodedInputStream input(bytes, size);
+  for (uint32_t tag = input.ReadTag(); tag != 0; tag = input.ReadTag()) {
+    if (WireFormatLite::GetTagFieldNumber(tag) == Datum::kDataFieldNumber &&
+        WireFormatLite::GetTagWireType(tag) ==
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      // Skip the tag itself (a single byte for field 4) and the length.
+      data_begin = input.CurrentPosition() - 1;
+      uint32_t length;
+      if (!input.ReadVarint32(&length) || !input.Skip(length)) {
+        return false;
       }
+      data_end = input.CurrentPosition();
+      *data = buffer + data_end - length;
+      *data_size = length;
+      break;
     }
-  } else {  // Faster than repeatedly testing is_color for each pixel w/i loop
-    for (int h = 0; h < cv_img.rows; ++h) {
-      for (int w = 0; w < cv_img.cols; ++w) {
-        datum_string->push_back(
-          static_cast<char>(cv_img.at<uchar>(h, w)));
-        }
-      }
+    if (!WireFormatLite::SkipField(&input, tag)) {
+      return false;
+    }
+  }
+  // ... and parse the fields around it.
+  if (!datum->ParseFromArray(bytes, data_begin)) {
+    return false;
   }
+  CodedInputStream rest(bytes + data_end, size - data_end);
+  return datum->MergeFromCodedStream(&rest);
+}
+
+bool DecodeDatum(Datum* datum) {
+  if (!datum->encoded()) {
+    return true;
+  }
+  const string& data = datum->data();
+  const int cv_read_flag = (datum->channels() == 1 ? CV_LOAD_IMAGE_GRAYSCALE :
+    CV_LOAD_IMAGE_COLOR);
+  cv::Mat cv_img = cv::imdecode(cv::Mat(1, data.size(), CV_8UC1,
+      const_cast<char*>(data.data())), cv_read_flag);
+  if (!cv_img.data) {
+    LOG(ERROR) << "Could not decode datum";
+    return false;
+  }
+  CVMatToDatum(cv_img, datum);
   return true;
 }
 
@@ -119,6 +227,19 @@ leveldb::Options GetLevelDBOptions() {
   return options;
 }
 
+static boost::recursive_mutex hdf5_mutex;
+
+HDF5Lock::HDF5Lock() {
+  hdf5_mutex.lock();
+}
+
+HDF5Lock::~HDF5Lock() {
+  hdf5_mutex.unlock();
+}
+
+template <> hid_t hdf5_native_type<float>() { return H5T_NATIVE_FLOAT; }
+template <> hid_t hdf5_native_type<double>() { return H5T_NATIVE_DOUBLE; }
+
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
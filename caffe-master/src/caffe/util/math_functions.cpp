@@ -206,6 +206,16 @@ void caffe_exp<double>(const int n, const double* a, double* y) {
   vdExp(n, a, y);
 }
 
+template <>
+void caffe_log1p<float>(const int n, const float* a, float* y) {
+  vsLog1p(n, a, y);
+}
+
+template <>
+void caffe_log1p<double>(const int n, const double* a, double* y) {
+  vdLog1p(n, a, y);
+}
+
 template <>
 void caffe_abs<float>(const int n, const float* a, float* y) {
     vsAbs(n, a, y);
@@ -0,0 +1,166 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "caffe/util/raw_file.hpp"
+
+namespace caffe {
+
+// The header of a raw file. The labels follow the records, at the next
+// multiple of 4 bytes.
+struct RawFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t float_data;
+  int32_t num;
+  int32_t channels;
+  int32_t height;
+  int32_t width;
+};
+
+static const char kRawFileMagic[8] = {'C', 'A', 'F', 'F', 'E', 'R', 'A', 'W'};
+static const uint32_t kRawFileVersion = 1;
+
+static size_t LabelsOffset(const size_t records_end) {
+  return (records_end + 3) & ~static_cast<size_t>(3);
+}
+
+RawFile::RawFile()
+    : map_(NULL), map_size_(0), size_(0), float_data_(false),
+      record_size_(0), records_(NULL), labels_(NULL) {
+}
+
+RawFile::~RawFile() {
+  Close();
+}
+
+void RawFile::Open(const string& filename, const bool shuffle) {
+  Close();
+  filename_ = filename;
+  LOG(INFO) << "Opening raw file " << filename;
+  const int fd = open(filename.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Failed to open raw file " << filename;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat raw file " << filename;
+  map_size_ = st.st_size;
+  CHECK_GE(map_size_, sizeof(RawFileHeader)) << "Truncated raw file "
+      << filename;
+  map_ = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  CHECK(map_ != MAP_FAILED) << "Failed to map raw file " << filename;
+  RawFileHeader header;
+  memcpy(&header, map_, sizeof(header));
+  CHECK(memcmp(header.magic, kRawFileMagic, sizeof(kRawFileMagic)) == 0)
+      << filename << " is not a raw file";
+  CHECK_EQ(header.version, kRawFileVersion) << "Unsupported version of "
+      << filename;
+  size_ = header.num;
+  CHECK_GT(size_, 0) << "No record in " << filename;
+  datum_.set_channels(header.channels);
+  datum_.set_height(header.height);
+  datum_.set_width(header.width);
+  float_data_ = header.float_data;
+  record_size_ = static_cast<size_t>(header.channels) * header.height *
+      header.width * (float_data_ ? sizeof(float) : sizeof(uint8_t));
+  const size_t labels_offset =
+      LabelsOffset(sizeof(header) + size_ * record_size_);
+  CHECK_EQ(map_size_, labels_offset + size_ * sizeof(int32_t))
+      << "Truncated raw file " << filename;
+  records_ = static_cast<const char*>(map_) + sizeof(header);
+  labels_ = reinterpret_cast<const int32_t*>(
+      static_cast<const char*>(map_) + labels_offset);
+  // Without shuffle, the kernel reads ahead of the records in use.
+  madvise(map_, map_size_, shuffle ? MADV_RANDOM : MADV_SEQUENTIAL);
+}
+
+void RawFile::Close() {
+  if (map_) {
+    munmap(map_, map_size_);
+    map_ = NULL;
+    map_size_ = 0;
+  }
+  // Do not leave pointers into the unmapped file behind.
+  size_ = 0;
+  record_size_ = 0;
+  records_ = NULL;
+  labels_ = NULL;
+}
+
+void RawFile::WillNeed(const int index) const {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t begin = record(index) - static_cast<const char*>(map_);
+  const size_t page_begin = begin - begin % page_size;
+  madvise(static_cast<char*>(map_) + page_begin,
+      begin + record_size_ - page_begin, MADV_WILLNEED);
+}
+
+void RawFileWriter::Open(const string& filename) {
+  Close();
+  filename_ = filename;
+  LOG(INFO) << "Opening raw file " << filename;
+  file_ = fopen(filename.c_str(), "wb");
+  CHECK(file_) << "Failed to open raw file " << filename;
+  // The header is written last, once the number of records is known.
+  RawFileHeader header;
+  memset(&header, 0, sizeof(header));
+  CHECK_EQ(fwrite(&header, sizeof(header), 1, file_), 1);
+  labels_.clear();
+}
+
+void RawFileWriter::Write(const Datum& datum) {
+  CHECK(file_);
+  CHECK(!datum.encoded()) << "Raw files hold decoded pixels only";
+  if (labels_.empty()) {
+    datum_.set_channels(datum.channels());
+    datum_.set_height(datum.height());
+    datum_.set_width(datum.width());
+    float_data_ = datum.data().empty();
+  }
+  CHECK(datum.channels() == datum_.channels() &&
+        datum.height() == datum_.height() &&
+        datum.width() == datum_.width())
+      << "All the records of a raw file must have the same shape";
+  const size_t count = static_cast<size_t>(datum.channels()) *
+      datum.height() * datum.width();
+  if (float_data_) {
+    CHECK_EQ(datum.float_data_size(), count) << "Incorrect float data size";
+    CHECK_EQ(fwrite(datum.float_data().data(), sizeof(float), count, file_),
+        count) << "Failed to write to " << filename_;
+  } else {
+    CHECK_EQ(datum.data().size(), count) << "Incorrect data size";
+    CHECK_EQ(fwrite(datum.data().data(), 1, count, file_), count)
+        << "Failed to write to " << filename_;
+  }
+  labels_.push_back(datum.label());
+}
+
+void RawFileWriter::Close() {
+  if (!file_) {
+    return;
+  }
+  const long records_end = ftell(file_);  // NOLINT(runtime/int)
+  const size_t padding = LabelsOffset(records_end) - records_end;
+  const char zeros[4] = {0, 0, 0, 0};
+  CHECK_EQ(fwrite(zeros, 1, padding, file_), padding);
+  CHECK_EQ(fwrite(labels_.data(), sizeof(int32_t), labels_.size(), file_),
+      labels_.size()) << "Failed to write to " << filename_;
+  RawFileHeader header;
+  memcpy(header.magic, kRawFileMagic, sizeof(kRawFileMagic));
+  header.version = kRawFileVersion;
+  header.float_data = float_data_;
+  header.num = labels_.size();
+  header.channels = datum_.channels();
+  header.height = datum_.height();
+  header.width = datum_.width();
+  CHECK_EQ(fseek(file_, 0, SEEK_SET), 0);
+  CHECK_EQ(fwrite(&header, sizeof(header), 1, file_), 1);
+  CHECK_EQ(fclose(file_), 0) << "Failed to close " << filename_;
+  file_ = NULL;
+}
+
+}  // namespace caffe
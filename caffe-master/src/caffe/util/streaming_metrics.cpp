@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/streaming_metrics.hpp"
+
+namespace caffe {
+
+StreamingMetrics::StreamingMetrics(const int num_bins,
+    const double score_range)
+    : score_range_(score_range), positives_(num_bins), negatives_(num_bins) {
+  CHECK_GT(num_bins, 0) << "StreamingMetrics needs at least one bin";
+  CHECK_GT(score_range, 0) << "StreamingMetrics needs a positive score range";
+  Reset();
+}
+
+void StreamingMetrics::Reset() {
+  std::fill(positives_.begin(), positives_.end(), 0);
+  std::fill(negatives_.begin(), negatives_.end(), 0);
+  num_positives_ = 0;
+  num_negatives_ = 0;
+  num_bags_ = 0;
+  true_positives_ = 0;
+  false_positives_ = 0;
+  right_bags_ = 0;
+}
+
+int StreamingMetrics::Bin(const double score) const {
+  const double clamped = std::max(-score_range_, std::min(score_range_, score));
+  const double position = (clamped + score_range_) / (2 * score_range_);
+  return std::min(static_cast<int>(position * num_bins()), num_bins() - 1);
+}
+
+void StreamingMetrics::AddPositive(const double score) {
+  ++positives_[Bin(score)];
+  ++num_positives_;
+  true_positives_ += score > 0;
+}
+
+void StreamingMetrics::AddNegative(const double score) {
+  ++negatives_[Bin(score)];
+  ++num_negatives_;
+  false_positives_ += score > 0;
+}
+
+void StreamingMetrics::AddBag(const double best_score) {
+  ++num_bags_;
+  right_bags_ += best_score > 0;
+}
+
+double StreamingMetrics::AUC() const {
+  if (!num_positives_ || !num_negatives_) {
+    return 0;
+  }
+  // Count the pairs of a positive above a negative, from the lowest bin up,
+  // the pairs of the same bin for half.
+  double pairs = 0;
+  double negatives_below = 0;
+  for (int b = 0; b < num_bins(); ++b) {
+    pairs += positives_[b] * (negatives_below + 0.5 * negatives_[b]);
+    negatives_below += negatives_[b];
+  }
+  return pairs / (static_cast<double>(num_positives_) * num_negatives_);
+}
+
+double StreamingMetrics::AveragePrecision() const {
+  if (!num_positives_) {
+    return 0;
+  }
+  // Lower the threshold a bin at a time, from the highest one down.
+  double ap = 0;
+  double true_positives = 0;
+  double false_positives = 0;
+  for (int b = num_bins() - 1; b >= 0; --b) {
+    true_positives += positives_[b];
+    false_positives += negatives_[b];
+    if (positives_[b]) {
+      ap += true_positives / (true_positives + false_positives) *
+          positives_[b];
+    }
+  }
+  return ap / num_positives_;
+}
+
+double StreamingMetrics::Precision() const {
+  const uint64_t predicted = true_positives_ + false_positives_;
+  return predicted ? static_cast<double>(true_positives_) / predicted : 0;
+}
+
+double StreamingMetrics::Recall() const {
+  return num_positives_ ?
+      static_cast<double>(true_positives_) / num_positives_ : 0;
+}
+
+double StreamingMetrics::BagAccuracy() const {
+  return num_bags_ ? static_cast<double>(right_bags_) / num_bags_ : 0;
+}
+
+}  // namespace caffe
@@ -0,0 +1,60 @@
+#include <boost/thread.hpp>
+
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/worker_pool.hpp"
+
+namespace caffe {
+
+class WorkerPool::Worker : public InternalThread {
+ public:
+  Worker(const int worker_id, WorkerPool* pool)
+      : worker_id_(worker_id), pool_(pool) {}
+
+  BlockingQueue<ParallelTask*> tasks_;
+
+ protected:
+  virtual void InternalThreadEntry() {
+    try {
+      while (!must_stop()) {
+        ParallelTask* task = tasks_.pop();
+        task->Run(worker_id_, pool_->num_workers());
+        pool_->done_.push(worker_id_);
+      }
+    } catch (boost::thread_interrupted&) {
+      // Interrupted while waiting for a task; exit cleanly.
+    }
+  }
+
+  const int worker_id_;
+  WorkerPool* pool_;
+};
+
+WorkerPool::WorkerPool(const int num_workers) {
+  CHECK_GT(num_workers, 0) << "A worker pool needs at least one worker";
+  workers_.resize(num_workers);
+  for (int i = 0; i < num_workers; ++i) {
+    workers_[i].reset(new Worker(i, this));
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    CHECK(workers_[i]->StartInternalThread()) << "Thread execution failed";
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  for (int i = 0; i < workers_.size(); ++i) {
+    CHECK(workers_[i]->StopInternalThread()) << "Thread joining failed";
+  }
+}
+
+void WorkerPool::Run(ParallelTask* task) {
+  CHECK(task);
+  for (int i = 0; i < workers_.size(); ++i) {
+    workers_[i]->tasks_.push(task);
+  }
+  boost::this_thread::disable_interruption no_interruption;
+  for (int i = 0; i < workers_.size(); ++i) {
+    done_.pop();
+  }
+}
+
+}  // namespace caffe
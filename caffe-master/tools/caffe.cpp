@@ -1,14 +1,21 @@
 #include <glog/logging.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <map>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "caffe/caffe.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 
+using caffe::BasePrefetchingDataLayer;
 using caffe::Blob;
 using caffe::Caffe;
+using caffe::CPUTimer;
+using caffe::LayerParameter;
 using caffe::Net;
 using caffe::Layer;
 using caffe::shared_ptr;
@@ -29,6 +36,9 @@ DEFINE_string(weights, "",
     "Cannot be set simultaneously with snapshot.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_string(workers, "",
+    "Optional; data_bench: the comma-separated numbers of workers to time "
+    "the data layers with, e.g. 1,2,4. By default, those of the model.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -266,6 +276,139 @@ int time() {
 }
 RegisterBrewFunction(time);
 
+
+// Sets the number of workers of a data layer. Returns false if its type has
+// none.
+static bool SetDataWorkers(LayerParameter* param, const int workers) {
+  switch (param->type()) {
+  case caffe::LayerParameter_LayerType_DATA:
+    param->mutable_data_param()->set_workers(workers);
+    return true;
+  case caffe::LayerParameter_LayerType_IMAGE_DATA:
+    param->mutable_image_data_param()->set_workers(workers);
+    return true;
+  case caffe::LayerParameter_LayerType_WINDOW_DATA:
+    param->mutable_window_data_param()->set_workers(workers);
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Times FLAGS_iterations batches of a data layer, then reports its
+// throughput, the latency of its Forward and the time its prefetch thread
+// spent in each stage of loading a batch.
+static void TimeDataLayer(const LayerParameter& param) {
+  shared_ptr<Layer<float> > layer(caffe::GetLayer<float>(param));
+  BasePrefetchingDataLayer<float>* data_layer =
+      dynamic_cast<BasePrefetchingDataLayer<float>*>(layer.get());
+  if (!data_layer) {
+    LOG(INFO) << "Skipping " << param.name() << ", which does not prefetch.";
+    return;
+  }
+  vector<shared_ptr<Blob<float> > > top_blobs(param.top_size());
+  vector<Blob<float>*> bottom_vec, top_vec;
+  for (int i = 0; i < top_blobs.size(); ++i) {
+    top_blobs[i].reset(new Blob<float>());
+    top_vec.push_back(top_blobs[i].get());
+  }
+  layer->SetUp(bottom_vec, &top_vec);
+  // The first batch also waits for the sources to be opened.
+  layer->Forward(bottom_vec, &top_vec);
+  data_layer->ResetPrefetchTimes();
+  vector<float> latencies(FLAGS_iterations);
+  CPUTimer total_timer;
+  total_timer.Start();
+  CPUTimer timer;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    timer.Start();
+    layer->Forward(bottom_vec, &top_vec);
+    latencies[i] = timer.MilliSeconds();
+  }
+  const float total_ms = total_timer.MilliSeconds();
+  data_layer->JoinPrefetchThread();
+  std::sort(latencies.begin(), latencies.end());
+  const int batch_size = top_vec[0]->num();
+  LOG(INFO) << param.name() << ": "
+      << 1000. * batch_size * FLAGS_iterations / total_ms << " images/s.";
+  LOG(INFO) << "  Forward latency: p50 "
+      << latencies[FLAGS_iterations / 2] << ", p90 "
+      << latencies[FLAGS_iterations * 9 / 10] << ", p99 "
+      << latencies[FLAGS_iterations * 99 / 100] << ", max "
+      << latencies.back() << " milliseconds.";
+  LOG(INFO) << "  Forward waited for batches "
+      << 100 * data_layer->forward_wait_time() / total_ms
+      << "% of the time, the prefetch thread for free batches "
+      << 100 * data_layer->prefetch_idle_time() / total_ms
+      << "%.";
+  // The prefetch thread may have loaded a few batches more than Forward took.
+  const int batches = data_layer->batches_loaded();
+  const std::map<caffe::string, double>& stage_times =
+      data_layer->stage_times();
+  for (std::map<caffe::string, double>::const_iterator it =
+       stage_times.begin(); it != stage_times.end(); ++it) {
+    LOG(INFO) << "  " << it->first << ": " << it->second / batches
+        << " milliseconds per batch.";
+  }
+}
+
+// Data bench: benchmark the data layers of a model alone, to tell whether
+// they can keep up with the rest of the net, and with how many workers.
+int data_bench() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
+  CHECK_GT(FLAGS_iterations, 0) << "Need iterations to time.";
+
+  // Set device id and mode
+  if (FLAGS_gpu >= 0) {
+    LOG(INFO) << "Use GPU with device ID " << FLAGS_gpu;
+    Caffe::SetDevice(FLAGS_gpu);
+    Caffe::set_mode(Caffe::GPU);
+  } else {
+    LOG(INFO) << "Use CPU.";
+    Caffe::set_mode(Caffe::CPU);
+  }
+  // Keep the data layers of the training net.
+  Caffe::set_phase(Caffe::TRAIN);
+  caffe::NetParameter param, filtered_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &param);
+  Net<float>::FilterNet(param, &filtered_param);
+
+  // 0 stands for the number of workers of the model.
+  vector<int> workers;
+  std::stringstream workers_stream(FLAGS_workers);
+  caffe::string token;
+  while (std::getline(workers_stream, token, ',')) {
+    workers.push_back(atoi(token.c_str()));
+    CHECK_GT(workers.back(), 0) << "Invalid number of workers: " << token;
+  }
+  if (workers.empty()) {
+    workers.push_back(0);
+  }
+
+  LOG(INFO) << "*** Benchmark begins ***";
+  LOG(INFO) << "Testing for " << FLAGS_iterations << " iterations.";
+  for (int i = 0; i < filtered_param.layers_size(); ++i) {
+    if (filtered_param.layers(i).bottom_size() > 0) {
+      continue;
+    }
+    for (int j = 0; j < workers.size(); ++j) {
+      LayerParameter layer_param(filtered_param.layers(i));
+      if (workers[j] > 0) {
+        if (!SetDataWorkers(&layer_param, workers[j])) {
+          LOG(INFO) << layer_param.name() << " has no workers to set.";
+          TimeDataLayer(layer_param);
+          break;
+        }
+        LOG(INFO) << "With " << workers[j] << " workers:";
+      }
+      TimeDataLayer(layer_param);
+    }
+  }
+  LOG(INFO) << "*** Benchmark ends ***";
+  return 0;
+}
+RegisterBrewFunction(data_bench);
+
 int main(int argc, char** argv) {
   // Print output to stderr (while still logging).
   FLAGS_alsologtostderr = 1;
@@ -276,7 +419,8 @@ int main(int argc, char** argv) {
       "  train           train or finetune a model\n"
       "  test            score a model\n"
       "  device_query    show GPU diagnostic information\n"
-      "  time            benchmark model execution time");
+      "  time            benchmark model execution time\n"
+      "  data_bench      benchmark the data layers of a model");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
   if (argc == 2) {
@@ -1,5 +1,6 @@
 // This program converts a set of images to a lmdb/leveldb by storing them
-// as Datum proto buffers.
+// as Datum proto buffers, or to a raw file of fixed-size records (see
+// caffe/util/raw_file.hpp).
 // Usage:
 //   convert_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME
 //
@@ -23,6 +24,7 @@
 
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/raw_file.hpp"
 #include "caffe/util/rng.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
@@ -33,9 +35,12 @@ DEFINE_bool(gray, false,
     "When this option is on, treat images as grayscale ones");
 DEFINE_bool(shuffle, false,
     "Randomly shuffle the order of images and their labels");
-DEFINE_string(backend, "lmdb", "The backend for storing the result");
+DEFINE_string(backend, "lmdb",
+    "The backend for storing the result: lmdb, leveldb or raw");
 DEFINE_int32(resize_width, 0, "Width images are resized to");
 DEFINE_int32(resize_height, 0, "Height images are resized to");
+DEFINE_bool(encoded, false,
+    "Store the compressed image files instead of their decoded pixels");
 
 int main(int argc, char** argv) {
   ::google::InitGoogleLogging(argv[0]);
@@ -91,6 +96,8 @@ int main(int argc, char** argv) {
   options.create_if_missing = true;
   options.write_buffer_size = 268435456;
   leveldb::WriteBatch* batch = NULL;
+  // raw
+  RawFileWriter raw_writer;
 
   // Open db
   if (db_backend == "leveldb") {  // leveldb
@@ -113,6 +120,9 @@ int main(int argc, char** argv) {
         << "mdb_txn_begin failed";
     CHECK_EQ(mdb_open(mdb_txn, NULL, 0, &mdb_dbi), MDB_SUCCESS)
         << "mdb_open failed. Does the lmdb already exist? ";
+  } else if (db_backend == "raw") {  // raw
+    CHECK(!FLAGS_encoded) << "Raw files hold decoded pixels, drop --encoded";
+    raw_writer.Open(db_path);
   } else {
     LOG(FATAL) << "Unknown db backend " << db_backend;
   }
@@ -127,14 +137,22 @@ int main(int argc, char** argv) {
   bool data_size_initialized = false;
 
   for (int line_id = 0; line_id < lines.size(); ++line_id) {
-    if (!ReadImageToDatum(root_folder + lines[line_id].first,
-        lines[line_id].second, resize_height, resize_width, is_color, &datum)) {
+    bool status;
+    if (FLAGS_encoded) {
+      status = ReadEncodedImageToDatum(root_folder + lines[line_id].first,
+          lines[line_id].second, resize_height, resize_width, is_color, &datum);
+    } else {
+      status = ReadImageToDatum(root_folder + lines[line_id].first,
+          lines[line_id].second, resize_height, resize_width, is_color, &datum);
+    }
+    if (!status) {
       continue;
     }
-    if (!data_size_initialized) {
+    // The size of encoded images is checked when decoding them.
+    if (!FLAGS_encoded && !data_size_initialized) {
       data_size = datum.channels() * datum.height() * datum.width();
       data_size_initialized = true;
-    } else {
+    } else if (!FLAGS_encoded) {
       const string& data = datum.data();
       CHECK_EQ(data.size(), data_size) << "Incorrect data field size "
           << data.size();
@@ -143,13 +161,16 @@ int main(int argc, char** argv) {
     snprintf(key_cstr, kMaxKeyLength, "%08d_%s", line_id,
         lines[line_id].first.c_str());
     string value;
-    datum.SerializeToString(&value);
     string keystr(key_cstr);
 
     // Put in db
-    if (db_backend == "leveldb") {  // leveldb
+    if (db_backend == "raw") {  // raw: records are numbered, not keyed
+      raw_writer.Write(datum);
+    } else if (db_backend == "leveldb") {  // leveldb
+      datum.SerializeToString(&value);
       batch->Put(keystr, value);
     } else if (db_backend == "lmdb") {  // lmdb
+      datum.SerializeToString(&value);
       mdb_data.mv_size = value.size();
       mdb_data.mv_data = reinterpret_cast<void*>(&value[0]);
       mdb_key.mv_size = keystr.size();
@@ -171,6 +192,8 @@ int main(int argc, char** argv) {
             << "mdb_txn_commit failed";
         CHECK_EQ(mdb_txn_begin(mdb_env, NULL, 0, &mdb_txn), MDB_SUCCESS)
             << "mdb_txn_begin failed";
+      } else if (db_backend == "raw") {  // raw
+        // The records are written as they come.
       } else {
         LOG(FATAL) << "Unknown db backend " << db_backend;
       }
@@ -187,10 +210,15 @@ int main(int argc, char** argv) {
       CHECK_EQ(mdb_txn_commit(mdb_txn), MDB_SUCCESS) << "mdb_txn_commit failed";
       mdb_close(mdb_env, mdb_dbi);
       mdb_env_close(mdb_env);
+    } else if (db_backend == "raw") {  // raw
+      // Closed below, whatever the count.
     } else {
       LOG(FATAL) << "Unknown db backend " << db_backend;
     }
     LOG(ERROR) << "Processed " << count << " files.";
   }
+  if (db_backend == "raw") {  // raw: write the labels and the header
+    raw_writer.Close();
+  }
   return 0;
 }
@@ -12,6 +12,7 @@
 #include "caffe/net.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
 #include "caffe/vision_layers.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
@@ -92,14 +93,23 @@ int feature_extraction_pipeline(int argc, char** argv) {
    }
    */
   string feature_extraction_proto(argv[++arg_pos]);
-  shared_ptr<Net<Dtype> > feature_extraction_net(
-      new Net<Dtype>(feature_extraction_proto));
-  feature_extraction_net->CopyTrainedLayersFrom(pretrained_binary_proto);
-
   string extract_feature_blob_names(argv[++arg_pos]);
   vector<string> blob_names;
   boost::split(blob_names, extract_feature_blob_names, boost::is_any_of(","));
 
+  // Only the feature blobs are read after each forward pass, so let the other
+  // blobs share their memory.
+  NetParameter feature_extraction_param;
+  ReadNetParamsFromTextFileOrDie(feature_extraction_proto,
+      &feature_extraction_param);
+  feature_extraction_param.set_reuse_blob_memory(true);
+  for (size_t i = 0; i < blob_names.size(); ++i) {
+    feature_extraction_param.add_keep_blob(blob_names[i]);
+  }
+  shared_ptr<Net<Dtype> > feature_extraction_net(
+      new Net<Dtype>(feature_extraction_param));
+  feature_extraction_net->CopyTrainedLayersFrom(pretrained_binary_proto);
+
   string save_feature_leveldb_names(argv[++arg_pos]);
   vector<string> leveldb_names;
   boost::split(leveldb_names, save_feature_leveldb_names,